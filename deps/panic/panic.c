@@ -41,7 +41,7 @@ static void vterminate(const char *file, int line, const char *format, va_list a
 __attribute__((__noinline__, __noreturn__, __nonnull__(1, 3), __format__(__printf__, 3, 0)));
 
 Panic_Callback Panic_registerCallback(const Panic_Callback callback) {
-    const Panic_Callback backup = callback;
+    const Panic_Callback backup = globalCallback;
     globalCallback = callback;
     return backup;
 }
@@ -25,17 +25,30 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#define _GNU_SOURCE
+
+#include <time.h>
 #include <wait.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
 #include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <memory.h>
 #include <assert.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
 #include <panic/panic.h>
 #include "process.h"
 
 #define MAGIC_NUMBER    0xdeadbeaf
 
+#define PROCESS_CANCEL_TIMEOUT      2000    // milliseconds granted to a process to terminate after SIGTERM
+#define PROCESS_COPY_SIZE           65536   // bytes copied at once when splice is not available
+#define PROCESS_CAPTURE_READ_SIZE   65536   // minimum room made in a capture before reading
+
 #define expect(condition, ...) \
     __expect((__FILE__), (__LINE__), (condition), __VA_ARGS__)
 
@@ -64,14 +77,58 @@ union Pipe {
 static void Pipe_open(union Pipe *self)
 __attribute__((__nonnull__));
 
+static void Pipe_openCloseOnExec(union Pipe *self)
+__attribute__((__nonnull__));
+
+static void Pipe_close(union Pipe *self)
+__attribute__((__nonnull__));
+
 /*
  * Process
  */
+extern char **environ;
+
 const Error Process_UnableToFork = Error_new("Unable to fork");
+const Error Process_UnableToExec = Error_new("Unable to exec");
 
 static void Process_setExitInfoFromStatus(struct Process *self, int status)
 __attribute__((__nonnull__));
 
+static long Process_splice(int from, int to, size_t size);
+
+static long Process_capture(int from, struct ProcessCapture *capture)
+__attribute__((__nonnull__));
+
+static int Process_openPidFileDescriptor(struct Process *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static bool Process_awaitExit(struct Process *self, int milliseconds)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * ProcessGroup
+ *
+ * Registrations carry the process pointer tagged with the index of the watched kind in the low bits.
+ */
+_Static_assert(_Alignof(struct Process) >= 4, "Process pointers must have two spare low bits");
+
+static uint64_t ProcessGroup_tag(struct Process *process, enum ProcessGroup_EventKind kind)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static const enum ProcessGroup_EventKind ProcessGroup_kinds[] = {
+        PROCESS_GROUP_EXITED, PROCESS_GROUP_OUTPUT_READY, PROCESS_GROUP_ERROR_READY
+};
+
+static void ProcessGroup_unwatch(struct ProcessGroup *self, int fileDescriptor);
+
+static Process_ExitCallback globalExitCallback = NULL;
+
+Process_ExitCallback Process_registerExitCallback(const Process_ExitCallback callback) {
+    const Process_ExitCallback backup = globalExitCallback;
+    globalExitCallback = callback;
+    return backup;
+}
+
 Error Process_spawn(struct Process *const self, void (*const f)(void)) {
     assert(self);
     assert(f);
@@ -107,6 +164,9 @@ Error Process_spawn(struct Process *const self, void (*const f)(void)) {
 
             fflush(NULL);
             f();
+            if (NULL != globalExitCallback) {
+                globalExitCallback();
+            }
             fflush(NULL);
             _exit(0);
         }
@@ -123,6 +183,7 @@ Error Process_spawn(struct Process *const self, void (*const f)(void)) {
             self->_errorFileDescriptor = pipeStderr.inputFileDescriptor;
             self->_outputFileDescriptor = pipeStdout.inputFileDescriptor;
             self->_exitValue = 0;
+            self->_pidFileDescriptor = -1;
             self->_isAlive = true;
             self->_exitNormally = false;
             return Ok;
@@ -130,6 +191,54 @@ Error Process_spawn(struct Process *const self, void (*const f)(void)) {
     }
 }
 
+Error Process_exec(struct Process *const self, const char *const file, char *const arguments[]) {
+    assert(self);
+    assert(file);
+    assert(arguments);
+    pid_t pid;
+    int result;
+    union Pipe pipeStderr, pipeStdout, pipeStdin;
+    posix_spawn_file_actions_t actions;
+
+    fflush(NULL);
+    // every pipe end is closed on exec, only the ones duplicated on the standard streams survive in the child
+    Pipe_openCloseOnExec(&pipeStderr);
+    Pipe_openCloseOnExec(&pipeStdout);
+    Pipe_openCloseOnExec(&pipeStdin);
+
+    ensure(posix_spawn_file_actions_init(&actions) == 0);
+    ensure(posix_spawn_file_actions_adddup2(&actions, pipeStdin.inputFileDescriptor, STDIN_FILENO) == 0);
+    ensure(posix_spawn_file_actions_adddup2(&actions, pipeStdout.outputFileDescriptor, STDOUT_FILENO) == 0);
+    ensure(posix_spawn_file_actions_adddup2(&actions, pipeStderr.outputFileDescriptor, STDERR_FILENO) == 0);
+
+    // glibc uses clone(CLONE_VM | CLONE_VFORK) and reports exec failures through the result
+    result = posix_spawnp(&pid, file, &actions, NULL, arguments, environ);
+    ensure(posix_spawn_file_actions_destroy(&actions) == 0);
+
+    if (result != 0) {
+        Pipe_close(&pipeStdin);
+        Pipe_close(&pipeStderr);
+        Pipe_close(&pipeStdout);
+        return Process_UnableToExec;
+    }
+
+    ensure(close(pipeStdin.inputFileDescriptor) == 0);
+    ensure(close(pipeStderr.outputFileDescriptor) == 0);
+    ensure(close(pipeStdout.outputFileDescriptor) == 0);
+#ifndef NDEBUG
+    self->_magicNumber = MAGIC_NUMBER;
+#endif
+    self->_id = pid;
+    self->_inputFileDescriptor = pipeStdin.outputFileDescriptor;
+    self->_errorFileDescriptor = pipeStderr.inputFileDescriptor;
+    self->_outputFileDescriptor = pipeStdout.inputFileDescriptor;
+    self->_exitValue = 0;
+    self->_pidFileDescriptor = -1;
+    self->_isAlive = true;
+    self->_exitNormally = false;
+    return Ok;
+}
+
 Error Process_wait(struct Process *const self, struct Process_ExitInfo *const out) {
     assert(self);
     assert(self->_magicNumber == MAGIC_NUMBER);
@@ -160,21 +269,15 @@ Error Process_cancel(struct Process *const self, struct Process_ExitInfo *const
         const pid_t pid = self->_id;
 
         for (int i = 0; (i < 8) && (kill(pid, SIGTERM) != 0); i++) {}
-        for (int i = 0; i < 2; i++) {
-            const int w = waitpid(pid, &status, WNOHANG);
-            if (w == pid) {
-                Process_setExitInfoFromStatus(self, status);
-                if (out) {
-                    const Error e = Process_exitInfo(self, out);
-                    assert(e == Ok);
-                    (void) e;
-                }
-                return Ok;
-            } else if (w == 0) {
-                sleep(1);
-            } else {
-                die();
+        if (Process_awaitExit(self, PROCESS_CANCEL_TIMEOUT)) {
+            ensure(waitpid(pid, &status, 0) == pid);
+            Process_setExitInfoFromStatus(self, status);
+            if (out) {
+                const Error e = Process_exitInfo(self, out);
+                assert(e == Ok);
+                (void) e;
             }
+            return Ok;
         }
 
         for (int i = 0; (i < 8) && (kill(pid, SIGKILL) != 0); i++) {}
@@ -229,6 +332,30 @@ long Process_readErrorStream(struct Process *const self, char *const buffer, con
     return read(self->_errorFileDescriptor, buffer, size);
 }
 
+long Process_spliceOutputStream(struct Process *const self, const int fileDescriptor, const size_t size) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    return Process_splice(self->_outputFileDescriptor, fileDescriptor, size);
+}
+
+long Process_spliceErrorStream(struct Process *const self, const int fileDescriptor, const size_t size) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    return Process_splice(self->_errorFileDescriptor, fileDescriptor, size);
+}
+
+long Process_captureOutputStream(struct Process *const self, struct ProcessCapture *const capture) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    return Process_capture(self->_outputFileDescriptor, capture);
+}
+
+long Process_captureErrorStream(struct Process *const self, struct ProcessCapture *const capture) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    return Process_capture(self->_errorFileDescriptor, capture);
+}
+
 int Process_id(const struct Process *const self) {
     assert(self);
     assert(self->_magicNumber == MAGIC_NUMBER);
@@ -258,6 +385,9 @@ void Process_teardown(struct Process *const self) {
     ensure(close(self->_inputFileDescriptor) == 0);
     ensure(close(self->_errorFileDescriptor) == 0);
     ensure(close(self->_outputFileDescriptor) == 0);
+    if (self->_pidFileDescriptor >= 0) {
+        ensure(close(self->_pidFileDescriptor) == 0);
+    }
     memset(self, 0, sizeof(*self));
 }
 
@@ -289,6 +419,278 @@ void Process_setExitInfoFromStatus(struct Process *const self, const int status)
     self->_isAlive = false;
 }
 
+long Process_splice(const int from, const int to, const size_t size) {
+    long result;
+    while ((result = splice(from, NULL, to, NULL, size, SPLICE_F_MOVE)) < 0 && EINTR == errno) {}
+    if (result >= 0 || EINVAL != errno) {
+        return result;
+    }
+
+    // the destination does not support splice (e.g. opened in append mode): copy through a buffer
+    char buffer[PROCESS_COPY_SIZE];
+    while ((result = read(from, buffer, (size < sizeof(buffer)) ? size : sizeof(buffer))) < 0 && EINTR == errno) {}
+    for (long written = 0, w; written < result; written += w) {
+        while ((w = write(to, buffer + written, (size_t) (result - written))) < 0 && EINTR == errno) {}
+        if (w < 0) {
+            return -1;
+        }
+    }
+    return result;
+}
+
+long Process_capture(const int from, struct ProcessCapture *const capture) {
+    assert(capture);
+    if (capture->_begin > 0 && capture->_capacity - capture->_end < PROCESS_CAPTURE_READ_SIZE) {
+        // compact the consumed bytes before growing
+        memmove(capture->_buffer, capture->_buffer + capture->_begin, capture->_end - capture->_begin);
+        capture->_end -= capture->_begin;
+        capture->_begin = 0;
+    }
+    if (capture->_capacity - capture->_end < PROCESS_CAPTURE_READ_SIZE && capture->_capacity < capture->_limit) {
+        size_t capacity = (capture->_capacity > 0) ? capture->_capacity * 2 : PROCESS_CAPTURE_READ_SIZE;
+        capacity = (capacity < capture->_limit) ? capacity : capture->_limit;
+        char *buffer = realloc(capture->_buffer, capacity);
+        if (NULL == buffer) {
+            errno = ENOMEM;
+            return -1;
+        }
+        capture->_buffer = buffer;
+        capture->_capacity = capacity;
+    }
+    if (capture->_end == capture->_capacity) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    long result;
+    while ((result = read(from, capture->_buffer + capture->_end, capture->_capacity - capture->_end)) < 0 &&
+           EINTR == errno) {}
+    if (result > 0) {
+        capture->_end += (size_t) result;
+    }
+    return result;
+}
+
+int Process_openPidFileDescriptor(struct Process *const self) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    if (self->_pidFileDescriptor < 0) {
+        self->_pidFileDescriptor = (int) syscall(SYS_pidfd_open, self->_id, 0);
+        if (self->_pidFileDescriptor >= 0) {
+            ensure(fcntl(self->_pidFileDescriptor, F_SETFD, FD_CLOEXEC) == 0);
+        }
+    }
+    return self->_pidFileDescriptor;
+}
+
+bool Process_awaitExit(struct Process *const self, const int milliseconds) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    const int pidFileDescriptor = Process_openPidFileDescriptor(self);
+
+    if (pidFileDescriptor >= 0) {
+        // the pid file descriptor becomes readable as soon as the process terminates
+        struct pollfd pollFileDescriptor = {.fd=pidFileDescriptor, .events=POLLIN};
+        int result;
+        while ((result = poll(&pollFileDescriptor, 1, milliseconds)) < 0) {
+            ensure(EINTR == errno);
+        }
+        return result > 0;
+    }
+
+    // kernels older than 5.3: fall back to polling
+    for (int elapsed = 0; elapsed <= milliseconds; elapsed += 10) {
+        siginfo_t info = {0};
+        ensure(waitid(P_PID, (id_t) self->_id, &info, WEXITED | WNOHANG | WNOWAIT) == 0);
+        if (info.si_pid == self->_id) {
+            return true;
+        }
+        const struct timespec pause = {.tv_sec=0, .tv_nsec=10000000};
+        nanosleep(&pause, NULL);
+    }
+    return false;
+}
+
+/*
+ * ProcessCapture
+ */
+void ProcessCapture_init(struct ProcessCapture *const self, const size_t limit) {
+    assert(self);
+    assert(limit > 0);
+    memset(self, 0, sizeof(*self));
+    self->_limit = limit;
+}
+
+const char *ProcessCapture_data(const struct ProcessCapture *const self, size_t *const length) {
+    assert(self);
+    assert(length);
+    *length = self->_end - self->_begin;
+    return self->_buffer + self->_begin;
+}
+
+void ProcessCapture_consume(struct ProcessCapture *const self, const size_t size) {
+    assert(self);
+    assert(size <= self->_end - self->_begin);
+    self->_begin += size;
+    if (self->_begin == self->_end) {
+        self->_begin = self->_end = 0;
+    }
+}
+
+bool ProcessCapture_nextLine(struct ProcessCapture *const self, const char **const line, size_t *const length) {
+    assert(self);
+    assert(line);
+    assert(length);
+    const char *const begin = self->_buffer + self->_begin;
+    const char *const end = (self->_begin < self->_end) ? memchr(begin, '\n', self->_end - self->_begin) : NULL;
+    if (NULL == end) {
+        return false;
+    }
+    // the line stays valid until the next capture
+    *line = begin;
+    *length = (size_t) (end - begin);
+    self->_begin += *length + 1;
+    return true;
+}
+
+void ProcessCapture_teardown(struct ProcessCapture *const self) {
+    assert(self);
+    free(self->_buffer);
+    memset(self, 0, sizeof(*self));
+}
+
+/*
+ * ProcessGroup
+ */
+Error ProcessGroup_init(struct ProcessGroup *const self) {
+    assert(self);
+    const int pollFileDescriptor = epoll_create1(EPOLL_CLOEXEC);
+    if (pollFileDescriptor < 0) {
+        return IllegalState;
+    }
+#ifndef NDEBUG
+    self->_magicNumber = MAGIC_NUMBER;
+#endif
+    self->_pollFileDescriptor = pollFileDescriptor;
+    self->_length = 0;
+    return Ok;
+}
+
+Error ProcessGroup_add(struct ProcessGroup *const self, struct Process *const process) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    assert(process);
+    assert(process->_magicNumber == MAGIC_NUMBER);
+
+    if (!process->_isAlive || Process_openPidFileDescriptor(process) < 0) {
+        return IllegalState;
+    }
+
+    const struct { int fileDescriptor; enum ProcessGroup_EventKind kind; } watches[] = {
+            {process->_pidFileDescriptor,    PROCESS_GROUP_EXITED},
+            {process->_outputFileDescriptor, PROCESS_GROUP_OUTPUT_READY},
+            {process->_errorFileDescriptor,  PROCESS_GROUP_ERROR_READY},
+    };
+    for (size_t i = 0; i < sizeof(watches) / sizeof(watches[0]); i++) {
+        struct epoll_event event = {.events=EPOLLIN, .data.u64=ProcessGroup_tag(process, watches[i].kind)};
+        if (PROCESS_GROUP_EXITED != watches[i].kind) {
+            const int flags = fcntl(watches[i].fileDescriptor, F_GETFL);
+            ensure(flags >= 0 && fcntl(watches[i].fileDescriptor, F_SETFL, flags | O_NONBLOCK) == 0);
+        }
+        if (epoll_ctl(self->_pollFileDescriptor, EPOLL_CTL_ADD, watches[i].fileDescriptor, &event) != 0) {
+            for (size_t j = 0; j < i; j++) {
+                ProcessGroup_unwatch(self, watches[j].fileDescriptor);
+            }
+            return IllegalState;
+        }
+    }
+
+    self->_length += 1;
+    return Ok;
+}
+
+void ProcessGroup_remove(struct ProcessGroup *const self, struct Process *const process) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    assert(process);
+    assert(process->_magicNumber == MAGIC_NUMBER);
+    if (process->_pidFileDescriptor >= 0 &&
+        epoll_ctl(self->_pollFileDescriptor, EPOLL_CTL_DEL, process->_pidFileDescriptor, NULL) == 0) {
+        assert(self->_length > 0);
+        self->_length -= 1;
+    }
+    ProcessGroup_unwatch(self, process->_outputFileDescriptor);
+    ProcessGroup_unwatch(self, process->_errorFileDescriptor);
+}
+
+long ProcessGroup_wait(struct ProcessGroup *const self, struct ProcessGroup_Event *const events, const size_t capacity,
+                       const int milliseconds) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    assert(events);
+    struct epoll_event ready[64];
+    const int maxEvents = (int) ((capacity < 64) ? capacity : 64);
+    if (0 == maxEvents) {
+        return 0;
+    }
+
+    const int count = epoll_wait(self->_pollFileDescriptor, ready, maxEvents, milliseconds);
+    if (count < 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        struct Process *const process = (struct Process *) (uintptr_t) (ready[i].data.u64 & ~(uint64_t) 3);
+        const enum ProcessGroup_EventKind kind = ProcessGroup_kinds[ready[i].data.u64 & 3];
+        assert(process->_magicNumber == MAGIC_NUMBER);
+
+        if (PROCESS_GROUP_EXITED == kind) {
+            int status;
+            ensure(waitpid(process->_id, &status, 0) == process->_id);
+            Process_setExitInfoFromStatus(process, status);
+            ensure(epoll_ctl(self->_pollFileDescriptor, EPOLL_CTL_DEL, process->_pidFileDescriptor, NULL) == 0);
+            assert(self->_length > 0);
+            self->_length -= 1;
+        } else if (0 == (ready[i].events & EPOLLIN)) {
+            // the write end has been closed and the pipe is drained: stop watching it to not spin on hang up
+            ProcessGroup_unwatch(self, (PROCESS_GROUP_OUTPUT_READY == kind) ?
+                                       process->_outputFileDescriptor : process->_errorFileDescriptor);
+        }
+        events[i].process = process;
+        events[i].kind = kind;
+    }
+    return count;
+}
+
+size_t ProcessGroup_length(const struct ProcessGroup *const self) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    return self->_length;
+}
+
+void ProcessGroup_teardown(struct ProcessGroup *const self) {
+    assert(self);
+    assert(self->_magicNumber == MAGIC_NUMBER);
+    ensure(close(self->_pollFileDescriptor) == 0);
+    memset(self, 0, sizeof(*self));
+}
+
+uint64_t ProcessGroup_tag(struct Process *const process, const enum ProcessGroup_EventKind kind) {
+    assert(process);
+    uint64_t tag = 0;
+    while (ProcessGroup_kinds[tag] != kind) {
+        tag += 1;
+    }
+    return (uint64_t) (uintptr_t) process | tag;
+}
+
+void ProcessGroup_unwatch(struct ProcessGroup *const self, const int fileDescriptor) {
+    assert(self);
+    if (epoll_ctl(self->_pollFileDescriptor, EPOLL_CTL_DEL, fileDescriptor, NULL) != 0) {
+        ensure(ENOENT == errno || EBADF == errno);
+    }
+}
+
 /*
  * Miscellaneous
  */
@@ -318,3 +720,14 @@ void Pipe_open(union Pipe *const self) {
     assert(self);
     expect(pipe(self->fileDescriptors) == 0, "Unable to open pipe");
 }
+
+void Pipe_openCloseOnExec(union Pipe *const self) {
+    assert(self);
+    expect(pipe2(self->fileDescriptors, O_CLOEXEC) == 0, "Unable to open pipe");
+}
+
+void Pipe_close(union Pipe *const self) {
+    assert(self);
+    ensure(close(self->inputFileDescriptor) == 0);
+    ensure(close(self->outputFileDescriptor) == 0);
+}
@@ -41,19 +41,56 @@ extern "C" {
 #endif
 
 #define PROCESS_VERSION_MAJOR       0
-#define PROCESS_VERSION_MINOR       3
+#define PROCESS_VERSION_MINOR       6
 #define PROCESS_VERSION_PATCH       0
 #define PROCESS_VERSION_SUFFIX      ""
 #define PROCESS_VERSION_IS_RELEASE  0
-#define PROCESS_VERSION_HEX         0x000300
+#define PROCESS_VERSION_HEX         0x000600
 
 extern const Error Process_UnableToFork;
+extern const Error Process_UnableToExec;
 
 struct Process_ExitInfo {
     int exitValue;
     bool exitNormally;
 };
 
+/*
+ * ProcessCapture
+ *
+ * A growable in-memory buffer that collects the output of processes, bounded by a limit to apply backpressure.
+ */
+struct ProcessCapture {
+    /* Do not access these members directly! */
+    char *_buffer;
+    size_t _begin;
+    size_t _end;
+    size_t _capacity;
+    size_t _limit;
+};
+
+extern void ProcessCapture_init(struct ProcessCapture *self, size_t limit)
+__attribute__((__nonnull__));
+
+/*
+ * Returns the captured bytes not consumed yet, storing their number into length.
+ */
+extern const char *ProcessCapture_data(const struct ProcessCapture *self, size_t *length)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern void ProcessCapture_consume(struct ProcessCapture *self, size_t size)
+__attribute__((__nonnull__));
+
+/*
+ * Consumes the next complete line, storing its start and its length (without the newline) into line and length.
+ * Returns false if no complete line has been captured yet.
+ */
+extern bool ProcessCapture_nextLine(struct ProcessCapture *self, const char **line, size_t *length)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern void ProcessCapture_teardown(struct ProcessCapture *self)
+__attribute__((__nonnull__));
+
 struct Process {
     /* Do not access these members directly! */
 #ifndef NDEBUG
@@ -63,6 +100,7 @@ struct Process {
     int _inputFileDescriptor;
     int _errorFileDescriptor;
     int _outputFileDescriptor;
+    int _pidFileDescriptor;
     int _exitValue;
     bool _exitNormally;
     bool _isAlive;
@@ -71,6 +109,28 @@ struct Process {
 extern ErrorOf(Ok, Process_UnableToFork) Process_spawn(struct Process *self, void (*f)(void))
 __attribute__((__warn_unused_result__, __nonnull__));
 
+/*
+ * Type signature of the callback executed by the children of Process_spawn before exiting.
+ */
+typedef void (*Process_ExitCallback)(void);
+
+/*
+ * Registers a callback to execute in the children of Process_spawn once f returns, as they leave through _exit,
+ * skipping the handlers registered through atexit, e.g. to flush buffered output.
+ *
+ * @param callback The callback to be executed, if NULL nothing will be executed.
+ * @return The previous registered callback if any else NULL.
+ */
+extern Process_ExitCallback Process_registerExitCallback(Process_ExitCallback callback);
+
+/*
+ * Runs the executable file (searched in PATH if it does not contain a slash) with the given NULL-terminated
+ * arguments, wiring the standard streams like Process_spawn does.
+ * The parent is not duplicated, so the cost of spawning does not grow with the size of its address space.
+ */
+extern ErrorOf(Ok, Process_UnableToExec) Process_exec(struct Process *self, const char *file, char *const arguments[])
+__attribute__((__warn_unused_result__, __nonnull__));
+
 extern ErrorOf(Ok, IllegalState) Process_wait(struct Process *self, struct Process_ExitInfo *out)
 __attribute__((__warn_unused_result__, __nonnull__(1)));
 
@@ -89,6 +149,30 @@ __attribute__((__warn_unused_result__, __nonnull__));
 extern long Process_readErrorStream(struct Process *self, char *buffer, size_t size)
 __attribute__((__warn_unused_result__, __nonnull__));
 
+/*
+ * Moves up to size bytes from the output (error) stream to fileDescriptor without copying them through user space
+ * when the kernel allows it (splice), falling back to read and write otherwise.
+ * Returns the number of bytes moved, 0 at the end of the stream, or -1 on error with errno set
+ * (EAGAIN if the stream is non-blocking and empty).
+ */
+extern long Process_spliceOutputStream(struct Process *self, int fileDescriptor, size_t size)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern long Process_spliceErrorStream(struct Process *self, int fileDescriptor, size_t size)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Appends what is available on the output (error) stream to capture, reading in large chunks.
+ * Returns the number of bytes captured, 0 at the end of the stream, or -1 on error with errno set
+ * (EAGAIN if the stream is non-blocking and empty, ENOBUFS if capture is full).
+ * A full capture is not read from, so the process blocks on its full pipe until the capture is consumed.
+ */
+extern long Process_captureOutputStream(struct Process *self, struct ProcessCapture *capture)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern long Process_captureErrorStream(struct Process *self, struct ProcessCapture *capture)
+__attribute__((__warn_unused_result__, __nonnull__));
+
 extern int Process_id(const struct Process *self)
 __attribute__((__warn_unused_result__, __nonnull__));
 
@@ -106,6 +190,60 @@ __attribute__((__warn_unused_result__));
 
 extern void Process_sleep(unsigned seconds);
 
+/*
+ * ProcessGroup
+ *
+ * Supervises many processes at once: a single call waits for exits and for output on the standard streams of every
+ * process in the group, without a thread or a sleep per process.
+ */
+enum ProcessGroup_EventKind {
+    PROCESS_GROUP_EXITED = 1,           // the process terminated and has been reaped, see Process_exitInfo
+    PROCESS_GROUP_OUTPUT_READY = 2,     // the output stream can be read without blocking (0 bytes means end of stream)
+    PROCESS_GROUP_ERROR_READY = 4,      // the error stream can be read without blocking (0 bytes means end of stream)
+};
+
+struct ProcessGroup_Event {
+    struct Process *process;
+    enum ProcessGroup_EventKind kind;
+};
+
+struct ProcessGroup {
+    /* Do not access these members directly! */
+#ifndef NDEBUG
+    long _magicNumber;
+#endif
+    int _pollFileDescriptor;
+    size_t _length;
+};
+
+extern ErrorOf(Ok, IllegalState) ProcessGroup_init(struct ProcessGroup *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Adds a live process to the group, its output and error streams are made non-blocking.
+ * The process must not be moved in memory until it is removed from the group.
+ */
+extern ErrorOf(Ok, IllegalState) ProcessGroup_add(struct ProcessGroup *self, struct Process *process)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern void ProcessGroup_remove(struct ProcessGroup *self, struct Process *process)
+__attribute__((__nonnull__));
+
+/*
+ * Waits up to milliseconds (-1 means forever) for events and stores at most capacity of them into events.
+ * Returns the number of events stored, 0 on timeout, or -1 on error with errno set.
+ * Exited processes are reaped and leave the group on their own, output left in their pipes can still be read.
+ */
+extern long ProcessGroup_wait(struct ProcessGroup *self, struct ProcessGroup_Event *events, size_t capacity,
+                              int milliseconds)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern size_t ProcessGroup_length(const struct ProcessGroup *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern void ProcessGroup_teardown(struct ProcessGroup *self)
+__attribute__((__nonnull__));
+
 #ifdef __cplusplus
 }
 #endif
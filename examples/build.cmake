@@ -1,2 +1,21 @@
 add_executable(main ${CMAKE_CURRENT_LIST_DIR}/main.c)
 target_link_libraries(main PRIVATE watchdog process)
+
+add_executable(spawn_benchmark ${CMAKE_CURRENT_LIST_DIR}/spawn_benchmark.c)
+target_link_libraries(spawn_benchmark PRIVATE process panic)
+
+add_executable(report_benchmark ${CMAKE_CURRENT_LIST_DIR}/report_benchmark.c)
+target_link_libraries(report_benchmark PRIVATE watchdog)
+
+# A release build with the runtime switch against an NDEBUG one, whatever the options of the watchdog archive:
+# the switch gets an archive of its own, the NDEBUG build needs none and must not inherit its public definitions
+add_library(watchdog_switch ${CMAKE_CURRENT_LIST_DIR}/../sources/watchdog.c)
+target_compile_definitions(watchdog_switch PUBLIC WATCHDOG_RUNTIME_SWITCH=1 PRIVATE NDEBUG)
+target_link_libraries(watchdog_switch PRIVATE panic process Threads::Threads)
+
+add_executable(switch_benchmark ${CMAKE_CURRENT_LIST_DIR}/switch_benchmark.c)
+target_compile_definitions(switch_benchmark PRIVATE NDEBUG)
+target_link_libraries(switch_benchmark PRIVATE watchdog_switch)
+
+add_executable(switch_benchmark_ndebug ${CMAKE_CURRENT_LIST_DIR}/switch_benchmark.c)
+target_compile_definitions(switch_benchmark_ndebug PRIVATE NDEBUG)
@@ -0,0 +1,78 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures the cost of reporting traced calls: allocates, reallocates and frees blocks of varying sizes in a loop
+ * and prints the nanoseconds per traced call, both wall time and time spent reporting (see Watchdog_getStats).
+ * The trace is written as usual, to the working directory.
+ *
+ * Usage: report_benchmark [calls] [rounds]
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <watchdog.h>
+
+#define BLOCKS  256
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+    const size_t calls = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000000;
+    const int rounds = (argc > 2) ? atoi(argv[2]) : 5;
+    void *blocks[BLOCKS] = {NULL};
+
+    printf("%8s %16s %16s %16s\n", "round", "wall (ns/call)", "report (ns/call)", "report p99 (ns)");
+    for (int round = 0; round < rounds; round++) {
+        const struct Watchdog_Stats before = Watchdog_getStats();
+        const double start = now();
+        for (size_t i = 0; i < calls / 4; i++) {
+            const size_t slot = (i * 7) % BLOCKS;
+            free(blocks[slot]);
+            blocks[slot] = malloc(16 + (i % 1000));
+            blocks[slot] = realloc(blocks[slot], 32 + (i % 4000));
+            void *scratch = calloc(1, 8 + (i % 64));
+            free(scratch);
+        }
+        const double elapsed = now() - start;
+        const struct Watchdog_Stats after = Watchdog_getStats();
+
+        const size_t reported = after.reportedCalls - before.reportedCalls;
+        printf("%8d %16.1f %16.1f %16llu\n", round, elapsed / (double) reported,
+               (double) (after.reportingTime - before.reportingTime) / (double) reported, after.reportingTimeP99);
+    }
+
+    for (size_t i = 0; i < BLOCKS; i++) {
+        free(blocks[i]);
+    }
+    return 0;
+}
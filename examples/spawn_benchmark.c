@@ -0,0 +1,97 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Compares the latency of Process_spawn (fork) and Process_exec (posix_spawn) as the parent address space grows.
+ *
+ * Usage: spawn_benchmark [maxMegabytes] [iterations]
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <panic/panic.h>
+#include <process/process.h>
+
+static void nothing(void) {
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void await(struct Process *const process) {
+    struct Process_ExitInfo info;
+    if (Process_wait(process, &info) != Ok) {
+        Panic_terminate("Unable to wait process: %d", Process_id(process));
+    }
+    Process_teardown(process);
+}
+
+int main(int argc, char **argv) {
+    const size_t maxMegabytes = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1024;
+    const int iterations = (argc > 2) ? atoi(argv[2]) : 20;
+    char *const arguments[] = {"true", NULL};
+    char *heap = NULL;
+
+    printf("%12s %12s %12s\n", "RSS (MiB)", "fork (ms)", "exec (ms)");
+    for (size_t megabytes = 0; megabytes <= maxMegabytes; megabytes = (0 == megabytes) ? 64 : megabytes * 4) {
+        struct Process process;
+        double forkElapsed = 0, execElapsed = 0;
+
+        free(heap);
+        heap = malloc(megabytes * 1024 * 1024 + 1);
+        if (NULL == heap) {
+            Panic_terminate("Out of memory");
+        }
+        memset(heap, 1, megabytes * 1024 * 1024 + 1);   // make pages resident
+
+        for (int i = 0; i < iterations; i++) {
+            double start = now();
+            if (Process_spawn(&process, nothing) != Ok) {
+                Panic_terminate("Unable to fork");
+            }
+            forkElapsed += now() - start;
+            await(&process);
+
+            start = now();
+            if (Process_exec(&process, arguments[0], arguments) != Ok) {
+                Panic_terminate("Unable to exec: %s", arguments[0]);
+            }
+            execElapsed += now() - start;
+            await(&process);
+        }
+
+        printf("%12zu %12.3f %12.3f\n", megabytes, forkElapsed / iterations, execElapsed / iterations);
+    }
+
+    free(heap);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Measures the cost of traced calls guarded by the runtime switch (see WATCHDOG_RUNTIME_SWITCH) while tracing is
+ * disabled, to be compared with the same workload built with NDEBUG (switch_benchmark_ndebug), then with tracing
+ * enabled. Reports the best of the rounds in nanoseconds per malloc and free pair.
+ * Traced rounds write their calls to the trace in the working directory, so they are cut to TRACED_PAIRS pairs
+ * (about 25 MB of trace over the default rounds).
+ *
+ * Usage: switch_benchmark [pairs] [rounds]
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <watchdog.h>
+
+#define BLOCKS          64
+#define TRACED_PAIRS    5000
+#define TRACED(pairs)   (((pairs) < TRACED_PAIRS) ? (pairs) : TRACED_PAIRS)
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double measure(const size_t pairs, const int rounds) {
+    static char *blocks[BLOCKS];
+    double best = 0;
+
+    for (int round = 0; round < rounds; round++) {
+        const double start = now();
+        for (size_t i = 0; i < pairs; i++) {
+            const size_t slot = i % BLOCKS;
+            free(blocks[slot]);
+            blocks[slot] = malloc(16 + (i & 255));
+            blocks[slot][0] = (char) i;
+        }
+        const double elapsed = (now() - start) / (double) pairs;
+        best = (0 == round || elapsed < best) ? elapsed : best;
+    }
+    for (size_t i = 0; i < BLOCKS; i++) {
+        free(blocks[i]);
+        blocks[i] = NULL;
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    const size_t pairs = (argc > 1) ? strtoul(argv[1], NULL, 10) : 20000000;
+    const int rounds = (argc > 2) ? atoi(argv[2]) : 10;
+
+#if WATCHDOG_RUNTIME_SWITCH
+    printf("%-10s %12.2f ns/pair\n", "disabled", measure(pairs, rounds));
+    Watchdog_enable();
+    printf("%-10s %12.2f ns/pair\n", "enabled", measure(TRACED(pairs), rounds));
+#elif defined(NDEBUG)
+    printf("%-10s %12.2f ns/pair\n", "NDEBUG", measure(pairs, rounds));
+#else
+    printf("%-10s %12.2f ns/pair\n", "traced", measure(TRACED(pairs), rounds));
+#endif
+    return 0;
+}
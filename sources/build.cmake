@@ -6,13 +6,40 @@ message("${ARCHIVE_NAME}@${CMAKE_CURRENT_LIST_DIR} using: ${CMAKE_CURRENT_LIST_F
 file(GLOB ARCHIVE_HEADERS ${CMAKE_CURRENT_LIST_DIR}/*.h)
 file(GLOB ARCHIVE_SOURCES ${CMAKE_CURRENT_LIST_DIR}/*.c)
 add_library(${ARCHIVE_NAME} ${ARCHIVE_HEADERS} ${ARCHIVE_SOURCES})
-target_link_libraries(${ARCHIVE_NAME} PRIVATE panic process)
+find_package(Threads REQUIRED)
+target_link_libraries(${ARCHIVE_NAME} PRIVATE panic process Threads::Threads)
 
 # Optional features
 option(WATCHDOG_FORCE_OVERRIDE "Force standard library allocators overriding" OFF)
+option(WATCHDOG_THREAD_NAMES "Add the name of the calling thread to every record" OFF)
+option(WATCHDOG_COLLECTOR "Write the trace from a collector process fed through shared memory" OFF)
+option(WATCHDOG_RUNTIME_SWITCH "Keep tracing compiled in even with NDEBUG, disabled until enabled at runtime" OFF)
 
 if (WATCHDOG_FORCE_OVERRIDE)
     target_compile_definitions(${ARCHIVE_NAME} PUBLIC WATCHDOG_FORCE_OVERRIDE=1)
 else ()
     target_compile_definitions(${ARCHIVE_NAME} PUBLIC WATCHDOG_FORCE_OVERRIDE=0)
 endif (WATCHDOG_FORCE_OVERRIDE)
+
+if (WATCHDOG_THREAD_NAMES)
+    target_compile_definitions(${ARCHIVE_NAME} PRIVATE WATCHDOG_THREAD_NAMES=1)
+endif (WATCHDOG_THREAD_NAMES)
+
+if (WATCHDOG_COLLECTOR)
+    target_compile_definitions(${ARCHIVE_NAME} PRIVATE WATCHDOG_COLLECTOR=1)
+endif (WATCHDOG_COLLECTOR)
+
+if (WATCHDOG_RUNTIME_SWITCH)
+    target_compile_definitions(${ARCHIVE_NAME} PUBLIC WATCHDOG_RUNTIME_SWITCH=1)
+endif (WATCHDOG_RUNTIME_SWITCH)
+
+set(WATCHDOG_MIN_TRACED_SIZE "" CACHE STRING "Do not trace allocations whose size is a compile-time constant below this threshold")
+set(WATCHDOG_ENABLED_MODULES "" CACHE STRING "Mask of the traced modules, see WATCHDOG_MODULE")
+
+if (WATCHDOG_MIN_TRACED_SIZE)
+    target_compile_definitions(${ARCHIVE_NAME} PUBLIC WATCHDOG_MIN_TRACED_SIZE=${WATCHDOG_MIN_TRACED_SIZE})
+endif (WATCHDOG_MIN_TRACED_SIZE)
+
+if (WATCHDOG_ENABLED_MODULES)
+    target_compile_definitions(${ARCHIVE_NAME} PUBLIC WATCHDOG_ENABLED_MODULES=${WATCHDOG_ENABLED_MODULES})
+endif (WATCHDOG_ENABLED_MODULES)
@@ -25,7 +25,10 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#define _GNU_SOURCE
+
 #include "watchdog.h"
+#include "watchdog_counters.h"
 
 /*
  * Un-define overrides over stdlib.h
@@ -39,99 +42,4625 @@ OTHER DEALINGS IN THE SOFTWARE.
 #undef free
 
 #include <time.h>
+#include <errno.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 #include <panic/panic.h>
 #include <process/process.h>
 
+#ifdef __linux__
+#   include <link.h>
+#   include <sys/uio.h>
+#   include <sys/syscall.h>
+#endif
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#   include <malloc.h>
+#   define WATCHDOG_HAS_MALLINFO2   1
+#else
+#   define WATCHDOG_HAS_MALLINFO2   0
+#endif
+
+#ifdef __GLIBC__
+#   include <execinfo.h>
+#   define WATCHDOG_HAS_BACKTRACE   1
+#else
+#   define WATCHDOG_HAS_BACKTRACE   0
+#endif
+
+#ifndef WATCHDOG_THREAD_NAMES
+#   define WATCHDOG_THREAD_NAMES    0
+#endif
+
+#ifndef WATCHDOG_COLLECTOR
+#   define WATCHDOG_COLLECTOR       0
+#endif
+
+#if WATCHDOG_COLLECTOR
+#   ifndef __linux__
+#       error "WATCHDOG_COLLECTOR is supported only on Linux"
+#   endif
+#   include <sched.h>
+#   include <stdalign.h>
+#endif
+
+#define WATCHDOG_SITES_CAPACITY     16384   // must be a power of 2
+#define WATCHDOG_SHARDS_COUNT       64      // must be a power of 2
+#define WATCHDOG_THREAD_NAME_SIZE   16      // including the null terminator, as for pthread_getname_np
+#define WATCHDOG_TAGS_CAPACITY      1024    // must be a power of 2
+#define WATCHDOG_TAGS_DEPTH         32      // of the stack of tags of a thread, deeper tags are ignored
+#define WATCHDOG_TAG_NAME_SIZE      64      // including the null terminator, longer names are truncated
+#define WATCHDOG_MODULES_COUNT      32
+#define WATCHDOG_PENDING_BYTES      65536   // max live bytes a thread accumulates before flushing them
+#define WATCHDOG_PENDING_BLOCKS     64      // max live blocks a thread accumulates before flushing them
+#define WATCHDOG_TOP_SITES_COUNT    5       // number of sites reported when a budget is exceeded
+#define WATCHDOG_OBJECTS_PERIOD     4096    // traced calls between checks for loaded and unloaded objects
+#define WATCHDOG_STATS_BUCKETS      256     // of the histogram of reporting times, 4 per power of 2
+
+/*
+ * Sites
+ *
+ * A site is the place (file, func, line) where a traced call has been issued.
+ * Sites are interned in a fixed-size table: lookups are lock-free, insertions are serialized.
+ */
+struct Watchdog_Site {
+    atomic_bool isUsed;
+    const char *file;
+    const char *func;
+    size_t fileLength;  // names are copied to records without scanning them
+    size_t funcLength;
+    int line;
+    int module;
+    atomic_size_t liveBytes;
+    atomic_size_t liveBlocks;
+    atomic_size_t allocatedBytes;   // cumulative, for profiles
+    atomic_size_t allocations;      // as above
+    atomic_bool isOverBudget;
+    uint64_t hash;  // FNV-1a of "file:line", stable across processes, see Watchdog_Chunk
+    struct Watchdog_CounterSite *_Atomic counter;   // in the slot of the process, see Watchdog_shareCounters
+#if WATCHDOG_COLLECTOR
+    atomic_uint_least64_t sharedStrings;    // offsets of file and func in the collector strings
+#endif
+};
+
+static struct Watchdog_Site *Watchdog_getSite(const char *file, const char *func, int line, int module)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static uint64_t Watchdog_Site_hash(const char *file, int line)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Threads
+ *
+ * Counters are written only by the owning thread, so relaxed loads and stores are enough.
+ * Thread descriptors are never released in order to report totals of exited threads too.
+ * Pending counters hold the live bytes and blocks not yet flushed into the global budget usage.
+ */
+struct Watchdog_Thread {
+    struct Watchdog_Thread *next;
+    long id;
+    char name[WATCHDOG_THREAD_NAME_SIZE * 6];   // JSON escaped
+    atomic_size_t allocations;
+    atomic_size_t allocatedBytes;
+    atomic_size_t frees;
+    atomic_size_t freedBytes;
+    long long pendingBytes;
+    long long pendingBlocks;
+    long long pendingModuleBytes[WATCHDOG_MODULES_COUNT];
+    long long pendingModuleBlocks[WATCHDOG_MODULES_COUNT];
+    unsigned objectsCountdown;  // traced calls before checking the loaded objects, see Watchdog_Objects_check
+    unsigned reportCountdown;   // allocations before reporting the next one, see Watchdog_Governor
+    atomic_size_t reported;     // see Watchdog_Stats
+    atomic_size_t sampledOut;
+    atomic_size_t reportingTime;
+    atomic_size_t reportingTimes[WATCHDOG_STATS_BUCKETS];
+    uintptr_t stackLow;         // see Watchdog_Leaks
+    uintptr_t stackHigh;
+    atomic_bool isRunning;
+#if WATCHDOG_COLLECTOR
+    uint32_t sharedName;    // offset of name in the collector strings
+    bool isNameShared;
+#endif
+};
+
+static struct Watchdog_Thread *Watchdog_getThread(void)
+__attribute__((__warn_unused_result__, __returns_nonnull__));
+
+static void Watchdog_count(atomic_size_t *counter, size_t amount)
+__attribute__((__nonnull__));
+
+/*
+ * Tags
+ *
+ * The logical owners of allocations, e.g. request types or pipeline stages, see Watchdog_pushTag.
+ * Tags are interned by name in a fixed-size table as sites are, every thread keeps a stack of their indexes: the
+ * innermost tag is attached to the blocks the thread allocates, which keep it wherever they are freed, and to the
+ * events it reports. Events refer to tags through their ids, the FNV-1a of their names (0 meaning untagged),
+ * stable across processes; the name of a tag is written once per process in a tag record, along with its first event.
+ */
+struct Watchdog_Tag {
+    atomic_bool isUsed;
+    atomic_bool isWritten;  // the tag record has been written by the current process
+    uint32_t id;
+    char name[WATCHDOG_TAG_NAME_SIZE];
+    char escapedName[WATCHDOG_TAG_NAME_SIZE * 6];   // JSON escaped
+    atomic_size_t liveBytes;
+    atomic_size_t liveBlocks;
+    atomic_size_t allocatedBytes;   // cumulative
+    atomic_size_t allocations;      // as above
+};
+
+static uint16_t Watchdog_Tags_intern(const char *name)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static struct Watchdog_Tag *Watchdog_Tags_get(uint16_t index)
+__attribute__((__warn_unused_result__, __returns_nonnull__));
+
+static uint16_t Watchdog_Tags_current(void)
+__attribute__((__warn_unused_result__));
+
+static void Watchdog_Tags_write(struct Watchdog_Tag *self)
+__attribute__((__nonnull__));
+
+/*
+ * Objects
+ *
+ * The executable and the shared libraries loaded in the process, written to the trace as object records (path,
+ * load address, address range and build id) followed by an objects record, so that the raw return addresses
+ * recorded at runtime can be symbolized offline, see watchdog-symbolize.
+ * Objects are written at the first traced call and again after dlopen or dlclose, which threads check every
+ * WATCHDOG_OBJECTS_PERIOD traced calls.
+ */
+static void Watchdog_Objects_check(void);
+
+/*
+ * Live blocks
+ *
+ * Maps the address of every live traced block to its size, the site and the thread that allocated it.
+ * The table is split in shards, each one an open-addressing hash table guarded by its own mutex.
+ */
+struct Watchdog_Block {
+    uintptr_t address;
+    size_t size;
+    struct Watchdog_Site *site;
+    long threadId;
+    bool isReported;    // the calls on the block are written to the trace, see Watchdog_Governor
+    int8_t allocator;   // the module whose allocator owns the block, see Watchdog_Allocator
+    uint16_t tag;       // index of the tag plus 1, 0 if untagged, see Watchdog_Tags
+    uint32_t redzone;   // bytes before the address if guarded, 0 otherwise, see Watchdog_Guards
+};
+
+struct Watchdog_Shard {
+    pthread_mutex_t mutex;
+    struct Watchdog_Block *blocks;
+    size_t capacity;
+    size_t length;
+    size_t bytes;
+};
+
+static void Watchdog_insertBlock(const struct Watchdog_Block *block)
+__attribute__((__nonnull__));
+
+static bool Watchdog_removeBlock(uintptr_t address, struct Watchdog_Block *out)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static void Watchdog_getLiveTotals(size_t *bytes, size_t *blocks)
+__attribute__((__nonnull__));
+
+/*
+ * Allocators
+ *
+ * Traced calls are served by the allocator of the module of their site, a zeroed one stands for the standard
+ * allocators. Allocators are set before the first traced allocation and never change afterwards, so that every
+ * block is released by the allocator of the module recorded along with it; blocks unknown to watchdog belong to
+ * the standard allocators.
+ * Shipped allocators prefix blocks with a header holding their size, so that they can be moved.
+ */
+#define WATCHDOG_ALLOCATOR_STANDARD     (-1)
+#define WATCHDOG_ALLOCATOR_ALIGNMENT    16u             // of blocks of shipped allocators, the size of their headers
+#define WATCHDOG_SLAB_SIZE              (1u << 16)
+#define WATCHDOG_SLAB_CLASSES_COUNT     40
+#define WATCHDOG_SLAB_MAX_SIZE          32768u          // of the last class
+#define WATCHDOG_SLAB_LARGE             UINT32_MAX      // class of blocks served by the standard allocators
+
+struct Watchdog_Arena {
+    char *begin;
+    char *end;
+    atomic_uintptr_t top;
+};
+
+struct Watchdog_SlabHeader {
+    size_t size;
+    uint32_t sizeClass;
+    uint32_t offset;    // of the header from the start of the underlying block, for large blocks
+};
+
+struct Watchdog_SlabClass {
+    pthread_mutex_t mutex;
+    void *freeList;     // the next free block is stored at the start of every free block
+    char *next;         // the free space of the current slab
+    char *limit;
+};
+
+struct Watchdog_Slab {
+    struct Watchdog_SlabClass classes[WATCHDOG_SLAB_CLASSES_COUNT];
+};
+
+static const struct Watchdog_Allocator *Watchdog_Allocator_get(int module)
+__attribute__((__warn_unused_result__, __returns_nonnull__));
+
+static bool Watchdog_Allocator_isSame(const struct Watchdog_Allocator *self, const struct Watchdog_Allocator *other)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static void *Watchdog_Allocator_allocate(const struct Watchdog_Allocator *self, size_t size)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static void *Watchdog_Allocator_allocateZeroed(const struct Watchdog_Allocator *self,
+                                               size_t numberOfMembers, size_t memberSize)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static void *Watchdog_Allocator_allocateAligned(const struct Watchdog_Allocator *self, size_t alignment, size_t size)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static void *Watchdog_Allocator_move(const struct Watchdog_Allocator *from, const struct Watchdog_Allocator *to,
+                                     void *memory, size_t size, size_t newSize)
+__attribute__((__warn_unused_result__, __nonnull__(1, 2)));
+
+static void Watchdog_Allocator_release(const struct Watchdog_Allocator *self, void *memory)
+__attribute__((__nonnull__(1)));
+
+/*
+ * Shared counters
+ *
+ * See watchdog_counters.h. Sites get an entry in the slot of the process at their first traced call after sharing
+ * started, entries are created while holding gCountersMutex and published through the site. Slots are seeded with
+ * the live blocks of the process when sharing starts, and of the child when forking.
+ */
+static void Watchdog_Counters_create(void);
+
+static struct Watchdog_CounterProcess *Watchdog_Counters_register(bool isChild)
+__attribute__((__warn_unused_result__));
+
+static struct Watchdog_CounterSite *Watchdog_Counters_getSite(struct Watchdog_CounterProcess *process,
+                                                               struct Watchdog_Site *site)
+__attribute__((__warn_unused_result__, __nonnull__, __returns_nonnull__));
+
+static void Watchdog_Counters_add(struct Watchdog_CounterProcess *process, struct Watchdog_Site *site,
+                                  long long bytes, long long blocks)
+__attribute__((__nonnull__));
+
+static void Watchdog_Counters_release(void);
+
+static void Watchdog_Counters_initSite(struct Watchdog_CounterSite *self, const char *file, const char *func,
+                                       int line, int module)
+__attribute__((__nonnull__));
+
+/*
+ * Cross-thread frees
+ *
+ * Counts blocks freed by a thread other than the one which allocated them, per allocation site.
+ * Blocks inherited across fork keep the id of the forking thread in the parent, which is the thread with a new id in
+ * the child: the ids of the forking threads of every generation are mapped to their successors when blocks are freed.
+ */
+#define WATCHDOG_FORKS_DEPTH    64      // generations of forks whose thread ids are mapped, older ones are not
+
+struct Watchdog_CrossThreadFree {
+    struct Watchdog_Site *site;
+    long allocatedBy;
+    long freedBy;
+    size_t frees;
+    size_t freedBytes;
+};
+
+struct Watchdog_Inheritance {
+    long parentId;  // of the forking thread
+    long childId;
+};
+
+static void Watchdog_recordCrossThreadFree(const struct Watchdog_Block *block, long allocatedBy, long freedBy)
+__attribute__((__nonnull__));
+
+static long Watchdog_getOwner(const struct Watchdog_Block *block)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Budgets
+ *
+ * Limits on live bytes and blocks, either global, per module or per site (the same limit applies to every site).
+ * Site usage is checked on every call, while global and module usage are checked when a thread flushes its
+ * pending counters, so they may exceed the limit by at most WATCHDOG_PENDING_BYTES (or BLOCKS) per thread.
+ * A zero limit means unlimited.
+ */
+struct Watchdog_Budget {
+    atomic_size_t maxBytes;
+    atomic_size_t maxBlocks;
+    atomic_bool isExceeded;     // the callback is executed once per breach, it is re-armed when usage decreases
+};
+
+struct Watchdog_Usage {
+    atomic_llong bytes;
+    atomic_llong blocks;
+};
+
+static void Watchdog_Thread_flush(struct Watchdog_Thread *self)
+__attribute__((__nonnull__));
+
+static void Watchdog_Budget_check(const struct Watchdog_Budget *self, atomic_bool *isExceeded,
+                                  long long bytes, long long blocks,
+                                  const char *scope, int module, const struct Watchdog_Site *site)
+__attribute__((__nonnull__(1, 2, 5)));
+
+static size_t Watchdog_collectTopSites(const struct Watchdog_Site **sites, size_t size, int module)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Tickers
+ *
+ * Background threads executing a task at a fixed rate, regardless of the time the task takes.
+ * Tickers do not survive fork, they must be started again in child processes.
+ */
+struct Watchdog_Ticker {
+    pthread_t thread;
+    bool isRunning;
+    bool isLowPriority;     // the thread runs at the lowest priority, where supported
+    unsigned interval;
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    void (*task)(void);
+};
+
+static void Watchdog_Ticker_init(struct Watchdog_Ticker *self)
+__attribute__((__nonnull__));
+
+static void Watchdog_Ticker_start(struct Watchdog_Ticker *self, unsigned milliseconds)
+__attribute__((__nonnull__));
+
+static bool Watchdog_Ticker_stop(struct Watchdog_Ticker *self)
+__attribute__((__nonnull__));
+
+static void *Watchdog_Ticker_run(void *self)
+__attribute__((__nonnull__));
+
+/*
+ * Sampler
+ *
+ * A ticker which periodically appends to the trace the memory usage of the process, as seen by the
+ * kernel and by the allocator, along with the total of live traced bytes, so that fragmentation can be measured.
+ */
+static void Watchdog_Sampler_sample(void);
+
+/*
+ * Snapshots
+ *
+ * The live bytes and blocks of every site, appended to the trace on demand or periodically by a ticker:
+ * a snapshotSite record per site which allocated (along with its cumulative allocations, for profiles),
+ * followed by a snapshot record with the totals.
+ * Site counters are exact, so snapshots cost a scan of the sites table regardless of the number of live blocks.
+ */
+static void Watchdog_Snapshot_take(void);
+
+/*
+ * Leak checks
+ *
+ * A conservative mark phase over the live traced blocks, copied and sorted by address so that every word of the
+ * roots can be looked up by binary search: the writable segments of the loaded objects, the stacks of the running
+ * threads which made traced calls and the registers of the calling thread. Words pointing inside a block reference
+ * it as well. Blocks left unreached are indirectly lost if referenced by another unreached block, definitely lost
+ * otherwise (a cycle has a definitely lost block, the first one by address).
+ * Shards stay locked while checking so that blocks cannot be released meanwhile, while stacks of other threads are
+ * copied through process_vm_readv as they may be unmapped at any time. Roots are listed before locking the shards,
+ * as dl_iterate_phdr takes the lock of the dynamic linker, which may be held by threads making traced calls.
+ */
+enum Watchdog_LeakState {
+    WATCHDOG_LEAK_UNREACHED,
+    WATCHDOG_LEAK_REACHABLE,
+    WATCHDOG_LEAK_DEFINITE,
+    WATCHDOG_LEAK_INDIRECT,
+};
+
+struct Watchdog_LeakBlock {
+    uintptr_t address;
+    size_t size;
+    const struct Watchdog_Site *site;
+    enum Watchdog_LeakState state;
+};
+
+struct Watchdog_LeakRange {
+    uintptr_t low;
+    uintptr_t high;
+};
+
+struct Watchdog_LeakCheck {
+    struct Watchdog_LeakBlock *blocks;  // sorted by address
+    size_t length;
+    uintptr_t low;                      // of the blocks
+    uintptr_t high;
+    size_t *pending;                    // indexes of the blocks to be scanned
+    size_t pendingLength;
+    struct Watchdog_LeakRange *ranges;  // writable segments of the loaded objects
+    size_t rangesLength;
+    size_t rangesCapacity;
+    size_t rootBytes;
+};
+
+static void Watchdog_Leaks_check(const jmp_buf *registers, uintptr_t stackLow)
+__attribute__((__noinline__, __nonnull__));
+
+#ifdef __linux__
+
+static int Watchdog_Leaks_addObject(struct dl_phdr_info *info, size_t size, void *self)
+__attribute__((__nonnull__));
+
+static void Watchdog_Leaks_collect(struct Watchdog_LeakCheck *self)
+__attribute__((__nonnull__));
+
+static void Watchdog_Leaks_scan(struct Watchdog_LeakCheck *self, uintptr_t from, uintptr_t to,
+                                enum Watchdog_LeakState state, const struct Watchdog_LeakBlock *root)
+__attribute__((__nonnull__(1)));
+
+static void Watchdog_Leaks_scanRemote(struct Watchdog_LeakCheck *self, uintptr_t low, uintptr_t high, char *buffer)
+__attribute__((__nonnull__));
+
+static void Watchdog_Leaks_drain(struct Watchdog_LeakCheck *self, enum Watchdog_LeakState state,
+                                 const struct Watchdog_LeakBlock *root)
+__attribute__((__nonnull__(1)));
+
+#endif
+
+static void Watchdog_Leaks_write(const struct Watchdog_LeakCheck *self, long long duration)
+__attribute__((__nonnull__));
+
+static int Watchdog_Leaks_compare(const void *a, const void *b)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Metrics
+ *
+ * Heap health for dashboards of long-running processes: a low-priority ticker writes the in-process counters as a
+ * Prometheus text exposition file, e.g. for the textfile collector of node_exporter, without any network code.
+ * The file is written aside and renamed over the previous one, so that readers never see a partial file.
+ * Rates are computed between consecutive files, the previous allocations of every site are kept for the purpose.
+ */
+#define WATCHDOG_METRICS_MAX_TOP_SITES  100
+
+struct Watchdog_Metrics {
+    char *path;
+    char *temporaryPath;
+    size_t topSites;
+    long long lastClock;
+    size_t lastAllocations;
+    size_t lastFrees;
+    size_t *lastSiteAllocations;    // indexed as gSites, the overflow site last
+};
+
+static void Watchdog_Metrics_write(void);
+
+static void Watchdog_Metrics_writeSites(FILE *stream, const char *name, const char *help,
+                                        const struct Watchdog_Site *const *sites, const double *values, size_t count)
+__attribute__((__nonnull__(1, 2, 3)));
+
+static void Watchdog_Metrics_putLabel(FILE *stream, const char *name, const char *value)
+__attribute__((__nonnull__));
+
+/*
+ * Guards
+ *
+ * Heap corruption checks, see Watchdog_enableGuards. Guarded blocks are allocated between redzones filled with a
+ * canary, verified when the blocks are freed: the redzone before a block preserves its alignment, the one after it
+ * extends the block to the next multiple of the former. Freed blocks are poisoned and parked in a FIFO quarantine,
+ * bounded in bytes, before being released: the poison is verified on the way out, so writes through dangling
+ * pointers are caught while the block is quarantined. The quarantine is a ring in order of free along with an
+ * open-addressing set of its addresses, twice as large, to tell double frees from frees of untraced blocks.
+ */
+#define WATCHDOG_GUARDS_REDZONE     16              // min bytes of the redzones, a multiple of the alignment of malloc
+#define WATCHDOG_GUARDS_CANARY      0xFA
+#define WATCHDOG_GUARDS_POISON      0xFD
+#define WATCHDOG_GUARDS_QUARANTINE  (16u << 20)     // default bytes of the quarantine, redzones included
+#define WATCHDOG_GUARDS_VARIABLE    "WATCHDOG_GUARDS"
+
+struct Watchdog_Quarantined {
+    uintptr_t address;
+    size_t size;
+    const struct Watchdog_Site *site;       // of the allocation
+    const struct Watchdog_Site *freeSite;
+    uint32_t redzone;
+    int8_t allocator;
+};
+
+struct Watchdog_Quarantine {
+    struct Watchdog_Quarantined *entries;   // ring, the oldest at head
+    uintptr_t *addresses;                   // set of the addresses of entries, of twice the capacity
+    size_t capacity;
+    size_t head;
+    size_t length;
+    size_t bytes;
+    size_t maxBytes;
+};
+
+struct Watchdog_Violation {
+    const char *kind;       // overflow, underflow, useAfterFree, doubleFree or invalidFree
+    uintptr_t address;
+    size_t size;
+    long long offset;       // of the first damaged byte from the address
+    const struct Watchdog_Site *site;   // of the offending call, the overflow site if unknown
+    const struct Watchdog_Site *allocationSite;
+    const struct Watchdog_Site *freeSite;
+};
+
+static void *Watchdog_Guards_allocate(const struct Watchdog_Allocator *allocator, size_t alignment, size_t size,
+                                      bool isZeroed, uint32_t *redzone)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static size_t Watchdog_Guards_getTail(uint32_t redzone, size_t size)
+__attribute__((__warn_unused_result__));
+
+static size_t Watchdog_Guards_find(const unsigned char *bytes, size_t size, unsigned char value)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static void Watchdog_Guards_check(const struct Watchdog_Block *block, const struct Watchdog_Site *freeSite)
+__attribute__((__nonnull__(1)));
+
+static void Watchdog_Guards_release(const struct Watchdog_Block *block, const struct Watchdog_Site *freeSite)
+__attribute__((__nonnull__));
+
+static void Watchdog_Guards_checkUntracked(uintptr_t address, const struct Watchdog_Site *site)
+__attribute__((__nonnull__));
+
+static void Watchdog_Guards_fail(const struct Watchdog_Violation *self)
+__attribute__((__noreturn__, __nonnull__));
+
+static void Watchdog_Quarantine_grow(struct Watchdog_Quarantine *self)
+__attribute__((__nonnull__));
+
+static void Watchdog_Quarantine_evict(struct Watchdog_Quarantine *self)
+__attribute__((__nonnull__));
+
+static void Watchdog_Quarantine_remove(struct Watchdog_Quarantine *self, uintptr_t address)
+__attribute__((__nonnull__));
+
+/*
+ * Governor
+ *
+ * A ticker which keeps the time spent reporting traced calls (encoding and writing events) within a fraction of
+ * the wall time, measured over a sliding window of WATCHDOG_GOVERNOR_WINDOW ticks.
+ * When over budget, the rate of reported blocks is halved down to 1 in WATCHDOG_GOVERNOR_MAX_RATE, then
+ * reporting stops altogether (aggregate only mode: site counters, snapshots and budgets are still exact);
+ * when under half the budget for a whole window, detail is restored a step at a time.
+ * Blocks are sampled at allocation: the calls on a sampled block are all reported, the ones on other blocks none,
+ * so that the events of the trace are consistent. Every change appends a governor record holding the rate,
+ * which applies to the blocks allocated afterwards and weights them in analysis.
+ */
+#define WATCHDOG_GOVERNOR_INTERVAL  100     // milliseconds
+#define WATCHDOG_GOVERNOR_WINDOW    10      // ticks
+#define WATCHDOG_GOVERNOR_MAX_RATE  1024    // must be a power of 2
+
+struct Watchdog_Governor {
+    double budget;
+    long long spent[WATCHDOG_GOVERNOR_WINDOW];
+    long long elapsed[WATCHDOG_GOVERNOR_WINDOW];
+    size_t ticks;           // since the last change of rate
+    long long lastSpent;
+    long long lastClock;
+};
+
+static void Watchdog_Governor_adjust(void);
+
+static void Watchdog_Governor_setRate(unsigned rate, double overhead);
+
+static bool Watchdog_Governor_isReported(struct Watchdog_Thread *thread)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Statistics
+ *
+ * The cost of tracing, see Watchdog_getStats. Counters of the reporting path are kept per thread and merged
+ * without locks when read, since thread descriptors are only ever prepended to the list; the counters of the
+ * buffer are updated while holding the stream. Reporting times are kept in a histogram with 4 buckets per power
+ * of 2, percentiles are the upper bounds of buckets so they exceed the actual ones by 25% at most.
+ * Stats records are appended along with samples and at exit.
+ */
+static size_t Watchdog_Stats_bucket(unsigned long long nanoseconds)
+__attribute__((__warn_unused_result__, __const__));
+
+static unsigned long long Watchdog_Stats_limit(size_t bucket)
+__attribute__((__warn_unused_result__, __const__));
+
+static void Watchdog_Stats_write(void);
+
+static long long Watchdog_now(void)
+__attribute__((__warn_unused_result__));
+
+/*
+ * Events
+ *
+ * Traced calls are described by events which are encoded as JSON lines, every other record is written as text.
+ * Events are formatted by hand, as printf would parse the format on every call: numbers are converted two digits
+ * at a time through a table and site names are copied along with their known lengths, the output is the same.
+ */
+#define WATCHDOG_EVENT_SIZE     1024    // of the buffer of an event, larger ones are allocated
+
+// the longest event but its strings: the text, 3 longs, 2 ints, 2 addresses, 4 64-bit integers and the terminator
+#define WATCHDOG_EVENT_TEXT(literal)    (sizeof(literal) - 1)
+#define WATCHDOG_EVENT_BOUND \
+        (WATCHDOG_EVENT_TEXT("{\"PID\": , \"parentPID\": , \"TID\": , \"thread\": \"\", \"call\": \"\", " \
+                             "\"file\": \"\", \"func\": \"\", \"line\": , \"address\": {\"from\": \"\", \"to\": \"\"}, " \
+                             "\"size\": , \"tag\": , \"timestamp\": , \"clock\": , \"sequence\": }\n") + \
+         WATCHDOG_EVENT_TEXT("aligned_alloc") + 3 * 20 + 2 * 11 + 2 * 18 + 4 * 20 + 1)
+#define WATCHDOG_FORMAT_LITERAL(cursor, literal) \
+        Watchdog_Format_text((cursor), (literal), WATCHDOG_EVENT_TEXT(literal))
+
+enum Watchdog_Call {
+    WATCHDOG_CALL_ALIGNED_ALLOC,
+    WATCHDOG_CALL_MALLOC,
+    WATCHDOG_CALL_CALLOC,
+    WATCHDOG_CALL_REALLOC,
+    WATCHDOG_CALL_FREE,
+};
+
+struct Watchdog_Event {
+    long PID;
+    long parentPID;
+    long TID;
+    const char *threadName;
+    const struct Watchdog_Site *site;
+    enum Watchdog_Call call;
+    uintptr_t relocated;
+    uintptr_t address;
+    size_t size;
+    uint32_t tag;                   // id, see Watchdog_Tags
+    long timestamp;
+    long long clock;                // CLOCK_MONOTONIC nanoseconds, comparable across processes of the same machine
+    unsigned long long sequence;    // per process, breaks ties between events with the same clock
+};
+
+static int Watchdog_Event_format(const struct Watchdog_Event *self, char *buffer, size_t size)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static char *Watchdog_Format_text(char *cursor, const char *text, size_t length)
+__attribute__((__warn_unused_result__, __nonnull__, __returns_nonnull__));
+
+static char *Watchdog_Format_unsigned(char *cursor, unsigned long long value)
+__attribute__((__warn_unused_result__, __nonnull__, __returns_nonnull__));
+
+static char *Watchdog_Format_signed(char *cursor, long long value)
+__attribute__((__warn_unused_result__, __nonnull__, __returns_nonnull__));
+
+static char *Watchdog_Format_address(char *cursor, uintptr_t address)
+__attribute__((__warn_unused_result__, __nonnull__, __returns_nonnull__));
+
+static void Watchdog_Event_stamp(struct Watchdog_Event *self)
+__attribute__((__nonnull__));
+
+static void Watchdog_Event_write(const struct Watchdog_Event *self)
+__attribute__((__nonnull__));
+
+static void Watchdog_emit(const struct Watchdog_Event *event)
+__attribute__((__nonnull__));
+
+static void Watchdog_write(const char *record, size_t length)
+__attribute__((__nonnull__));
+
+static void Watchdog_writef(const char *format, ...)
+__attribute__((__nonnull__, __format__(__printf__, 1, 2)));
+
+/*
+ * Chunks
+ *
+ * The trace is split into chunks of about WATCHDOG_CHUNK_SIZE bytes, each one followed by a chunk record holding
+ * its byte range, the number of events, the clock and address ranges and a bloom filter of its sites,
+ * so that readers can skip the chunks irrelevant to a time window, an address or a site.
+ */
+#define WATCHDOG_CHUNK_SIZE     (1u << 20)
+
+struct Watchdog_Chunk {
+    size_t offset;
+    size_t length;
+    size_t events;
+    long long clockMin;
+    long long clockMax;
+    uintptr_t addressMin;
+    uintptr_t addressMax;
+    uint64_t sites[4];      // 256 bits bloom filter, 2 bits per site
+};
+
+static void Watchdog_Chunk_add(const struct Watchdog_Event *event)
+__attribute__((__nonnull__));
+
+static void Watchdog_Chunk_close(void);
+
+/*
+ * Buffer
+ *
+ * Records are gathered in a buffer which is written to the trace once full, so that tracing costs a system call
+ * every WATCHDOG_BUFFER_SIZE bytes rather than one per record.
+ * The buffer is drained only through write(2), which is async-signal-safe, so that crashes can flush it too.
+ */
+#define WATCHDOG_BUFFER_SIZE    (1u << 16)
+
+struct Watchdog_BufferStats {   // see Watchdog_Stats
+    atomic_size_t written;
+    atomic_size_t flushes;
+    atomic_size_t highWater;
+    atomic_size_t dropped;
+};
+
+struct Watchdog_Buffer {
+    int fd;
+    bool isDirect;              // records are written through, late records at exit are not lost
+    size_t records;             // held by the buffer, accounted as dropped if they cannot be written
+    struct Watchdog_BufferStats *stats;
+    atomic_size_t length;       // stored after copying a record, so a crash never flushes a partial one
+    atomic_size_t flushed;      // bytes already written
+    char data[WATCHDOG_BUFFER_SIZE];
+};
+
+static void Watchdog_Buffer_append(struct Watchdog_Buffer *self, const char *data, size_t length)
+__attribute__((__nonnull__));
+
+static void Watchdog_Buffer_flush(struct Watchdog_Buffer *self)
+__attribute__((__nonnull__));
+
+static void Watchdog_Buffer_drain(struct Watchdog_Buffer *self)
+__attribute__((__nonnull__));
+
+static size_t Watchdog_Buffer_send(int fd, const char *data, size_t length)
+__attribute__((__nonnull__));
+
+/*
+ * Crashes
+ *
+ * On fatal signals and panics the pending records are flushed, followed by a crash record holding the cause and
+ * the return addresses of the crashing thread, then termination is handed over to the previous handlers.
+ * Only async-signal-safe functions are called, so records are formatted by hand.
+ */
+#define WATCHDOG_CRASH_FRAMES   32
+
+struct Watchdog_Crash_Line {
+    char data[1024];
+    size_t length;
+};
+
+static const int gCrashSignals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+
+#define WATCHDOG_CRASH_SIGNALS_COUNT    (sizeof(gCrashSignals) / sizeof(gCrashSignals[0]))
+
+static void Watchdog_Crash_install(void);
+
+static void Watchdog_Crash_onSignal(int signal, siginfo_t *info, void *context)
+__attribute__((__noinline__));
+
+static void Watchdog_Crash_onPanic(void)
+__attribute__((__noinline__));
+
+static void Watchdog_Crash_report(int signal, const void *address)
+__attribute__((__noinline__));
+
+static void Watchdog_Crash_put(struct Watchdog_Crash_Line *self, const char *string)
+__attribute__((__nonnull__));
+
+static void Watchdog_Crash_putInteger(struct Watchdog_Crash_Line *self, long long value)
+__attribute__((__nonnull__));
+
+static void Watchdog_Crash_putAddress(struct Watchdog_Crash_Line *self, uintptr_t value)
+__attribute__((__nonnull__));
+
+/*
+ * Collector
+ *
+ * Records are pushed into a multi-producer single-consumer ring living in shared memory, which is drained by a
+ * collector process that encodes them and writes the trace. Producers are the traced process and every process
+ * forked from it, so tracing costs only a few stores per event and records survive the crash of a producer.
+ * Strings are copied once into a shared area so that events can refer to them through offsets.
+ */
+#if WATCHDOG_COLLECTOR
+
+#define WATCHDOG_COLLECTOR_SLOTS            65536       // must be a power of 2
+#define WATCHDOG_COLLECTOR_STRINGS_SIZE     (1u << 20)
+#define WATCHDOG_COLLECTOR_PROCESSES        1024
+#define WATCHDOG_COLLECTOR_PAYLOAD_SIZE     112
+#define WATCHDOG_COLLECTOR_NAME             "watchdog-ring"
+
+enum Watchdog_SlotKind {
+    WATCHDOG_SLOT_EVENT,
+    WATCHDOG_SLOT_TEXT,
+    WATCHDOG_SLOT_TEXT_CONTINUATION,
+    WATCHDOG_SLOT_SKIPPED,
+};
+
+struct Watchdog_PackedEvent {
+    uint32_t file;
+    uint32_t func;
+    uint32_t threadName;
+    int32_t line;
+    int32_t PID;
+    int32_t parentPID;
+    int32_t TID;
+    uint32_t call;
+    uint32_t tag;
+    uint64_t relocated;
+    uint64_t address;
+    uint64_t size;
+    int64_t timestamp;
+    int64_t clock;
+    uint64_t sequence;
+};
+
+struct Watchdog_Slot {
+    atomic_size_t sequence;
+    uint32_t kind;
+    uint32_t length;    // length of the whole text record, meaningful only in its first slot
+    union {
+        struct Watchdog_PackedEvent event;
+        char text[WATCHDOG_COLLECTOR_PAYLOAD_SIZE];
+    };
+};
+
+struct Watchdog_Ring {
+    alignas(64) atomic_size_t tail;     // next position to be reserved by producers
+    alignas(64) atomic_size_t head;     // next position to be consumed by the collector
+    atomic_size_t dropped;
+    struct Watchdog_BufferStats bufferStats;    // of the collector, so that producers can read them
+    atomic_bool isCollectorDead;
+    int collectorId;
+    atomic_int producers[WATCHDOG_COLLECTOR_PROCESSES];
+    atomic_size_t stringsLength;
+    char strings[WATCHDOG_COLLECTOR_STRINGS_SIZE];
+    struct Watchdog_Slot slots[WATCHDOG_COLLECTOR_SLOTS];
+};
+
+static void Watchdog_Collector_start(void);
+
+static void Watchdog_Collector_run(void);
+
+static void Watchdog_Collector_attach(void);
+
+static void Watchdog_Collector_detach(void);
+
+static void Watchdog_Collector_emit(const struct Watchdog_Event *event)
+__attribute__((__nonnull__));
+
+static void Watchdog_Collector_write(const char *record, size_t length)
+__attribute__((__nonnull__));
+
+#endif
+
 /*
  * Global variables
  */
-static FILE *gStream = NULL;
+static FILE *gStream = NULL;                    // records go through gBuffer, only the lock and fd are used
+static struct Watchdog_Chunk gChunk = {0};     // guarded by the lock of gStream
+static struct Watchdog_BufferStats gBufferStats;
+static struct Watchdog_Buffer gBuffer = {.fd=-1, .stats=&gBufferStats};  // as above, except for crashes
+static atomic_bool gHasCrashed = false;
+static atomic_bool gHasAllocated = false;  // allocators cannot change anymore
+static struct Watchdog_Counters *gCounters = NULL;
+static struct Watchdog_CounterProcess *_Atomic gCounterProcess = NULL;  // NULL while not sharing
+static pthread_mutex_t gCountersMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t gCountersOnce = PTHREAD_ONCE_INIT;
+static int gCountersOwnerId = 0;
+static const struct Watchdog_Allocator gStandardAllocator;
+static struct Watchdog_Allocator gAllocators[WATCHDOG_MODULES_COUNT];
+static atomic_size_t gFootprint = 0;   // bytes allocated by watchdog for itself, besides static storage
+static struct sigaction gPreviousActions[WATCHDOG_CRASH_SIGNALS_COUNT];
+static Panic_Callback gPreviousPanicCallback = NULL;
+static Process_ExitCallback gPreviousExitCallback = NULL;
+static atomic_ullong gSequence = 0;
+#if WATCHDOG_COLLECTOR
+static struct Watchdog_Ring *gRing = NULL;
+static struct Process gCollector;
+static int gCollectorParentId = 0;
+#endif
+static pthread_once_t gInitializeOnce = PTHREAD_ONCE_INIT;
+
+static struct Watchdog_Site gSites[WATCHDOG_SITES_CAPACITY];
+static struct Watchdog_Site gOverflowSite = {.isUsed=true, .file="?", .func="?", .fileLength=1, .funcLength=1, .line=0, .module=0};
+static pthread_mutex_t gSitesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static _Thread_local struct Watchdog_Thread *tThread = NULL;
+static struct Watchdog_Thread *_Atomic gThreads = NULL;    // prepended while holding gThreadsMutex
+static pthread_mutex_t gThreadsMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t gThreadKey;
+
+static struct Watchdog_Tag gTags[WATCHDOG_TAGS_CAPACITY];
+static struct Watchdog_Tag gOverflowTag = {.isUsed=true, .id=0x3A0CB08Eu, .name="?", .escapedName="?"};   // FNV-1a of "?"
+static pthread_mutex_t gTagsMutex = PTHREAD_MUTEX_INITIALIZER;
+static _Thread_local uint16_t tTags[WATCHDOG_TAGS_DEPTH];
+static _Thread_local unsigned tTagsDepth = 0;
+
+static struct Watchdog_Shard gShards[WATCHDOG_SHARDS_COUNT];
+
+static struct Watchdog_CrossThreadFree *gCrossThreadFrees = NULL;
+static size_t gCrossThreadFreesCapacity = 0, gCrossThreadFreesLength = 0;
+static pthread_mutex_t gCrossThreadFreesMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct Watchdog_Inheritance gInheritances[WATCHDOG_FORKS_DEPTH];    // written by forked children only
+static size_t gInheritancesLength = 0;
+
+static atomic_ullong gObjectsLoads = 0;    // loads and unloads of objects when they have been written last
+static pthread_mutex_t gObjectsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static struct Watchdog_Ticker gSampler = {.mutex=PTHREAD_MUTEX_INITIALIZER, .task=Watchdog_Sampler_sample};
+static struct Watchdog_Ticker gSnapshotter = {.mutex=PTHREAD_MUTEX_INITIALIZER, .task=Watchdog_Snapshot_take};
+static atomic_ullong gSnapshots = 0;
+static atomic_ullong gLeakChecks = 0;
+static atomic_bool gIsCheckingLeaksAtExit = false;
+static struct Watchdog_Ticker gGovernorTicker = {.mutex=PTHREAD_MUTEX_INITIALIZER, .task=Watchdog_Governor_adjust};
+static struct Watchdog_Ticker gMetricsTicker = {.mutex=PTHREAD_MUTEX_INITIALIZER, .isLowPriority=true, .task=Watchdog_Metrics_write};
+static struct Watchdog_Metrics gMetrics;       // owned by the metrics ticker while running
+static atomic_size_t gPeakBytes = 0;           // of live traced bytes, as merged from threads and as measured
+static atomic_bool gHasGuards = false;         // set before the first traced allocation only
+static struct Watchdog_Quarantine gQuarantine = {0};
+static pthread_mutex_t gQuarantineMutex = PTHREAD_MUTEX_INITIALIZER;
+static struct Watchdog_Governor gGovernor;     // owned by the governor ticker while running
+static atomic_uint gReportingRate = 1;         // 1 every block is reported, N 1 in N, 0 none
+static atomic_bool gIsGoverned = false;
+
+static struct Watchdog_Budget gGlobalBudget, gSiteBudget, gModuleBudgets[WATCHDOG_MODULES_COUNT];
+static struct Watchdog_Usage gGlobalUsage, gModuleUsages[WATCHDOG_MODULES_COUNT];
+static _Atomic Watchdog_BudgetCallback gBudgetCallback = NULL;
 
 /*
  * Watchdog
  */
-static void Watchdog_report(const char *call, const char *file, const char *func, int line,
-                            const void *relocated, const void *address, size_t size);
+static void Watchdog_initialize(void);
+
+static void Watchdog_allocated(struct Watchdog_Thread *thread, struct Watchdog_Site *site,
+                               uintptr_t address, size_t size, int allocator, uint32_t redzone, bool isReported)
+__attribute__((__nonnull__));
+
+static void Watchdog_freed(struct Watchdog_Thread *thread, const struct Watchdog_Block *block)
+__attribute__((__nonnull__));
+
+static void Watchdog_report(struct Watchdog_Thread *thread, struct Watchdog_Site *site, enum Watchdog_Call call,
+                            uintptr_t relocated, uintptr_t address, size_t size, bool isReported)
+__attribute__((__nonnull__));
 
 #if WATCHDOG_HAS_C11_SUPPORT
 
-void *__Watchdog_aligned_alloc(const char *const file, const char *const func, const int line,
+void *__Watchdog_aligned_alloc(const char *const file, const char *const func, const int line, const int module,
                                const size_t alignment, const size_t size) {
     assert(NULL != file);
-    void *address = aligned_alloc(alignment, size);
-    Watchdog_report("aligned_alloc", file, func, line, NULL, address, size);
+    struct Watchdog_Thread *thread = Watchdog_getThread();
+    struct Watchdog_Site *site = Watchdog_getSite(file, func, line, module);
+    const struct Watchdog_Allocator *allocator = Watchdog_Allocator_get(module);
+    uint32_t redzone = 0;
+    void *address = atomic_load_explicit(&gHasGuards, memory_order_relaxed) ?
+                    Watchdog_Guards_allocate(allocator, alignment, size, false, &redzone) :
+                    Watchdog_Allocator_allocateAligned(allocator, alignment, size);
+    const bool isReported = Watchdog_Governor_isReported(thread);
+    Watchdog_allocated(thread, site, (uintptr_t) address, size, module, redzone, isReported);
+    Watchdog_report(thread, site, WATCHDOG_CALL_ALIGNED_ALLOC, 0, (uintptr_t) address, size, isReported);
     return address;
 }
 
 #endif
 
-void *__Watchdog_malloc(const char *const file, const char *const func, const int line, const size_t size) {
+void *__Watchdog_malloc(const char *const file, const char *const func, const int line, const int module,
+                        const size_t size) {
     assert(NULL != file);
-    void *address = malloc(size);
-    Watchdog_report("malloc", file, func, line, NULL, address, size);
+    struct Watchdog_Thread *thread = Watchdog_getThread();
+    struct Watchdog_Site *site = Watchdog_getSite(file, func, line, module);
+    const struct Watchdog_Allocator *allocator = Watchdog_Allocator_get(module);
+    uint32_t redzone = 0;
+    void *address = atomic_load_explicit(&gHasGuards, memory_order_relaxed) ?
+                    Watchdog_Guards_allocate(allocator, 0, size, false, &redzone) :
+                    Watchdog_Allocator_allocate(allocator, size);
+    const bool isReported = Watchdog_Governor_isReported(thread);
+    Watchdog_allocated(thread, site, (uintptr_t) address, size, module, redzone, isReported);
+    Watchdog_report(thread, site, WATCHDOG_CALL_MALLOC, 0, (uintptr_t) address, size, isReported);
     return address;
 }
 
-void *__Watchdog_calloc(const char *const file, const char *const func, const int line,
+void *__Watchdog_calloc(const char *const file, const char *const func, const int line, const int module,
                         const size_t numberOfMembers, const size_t memberSize) {
     assert(NULL != file);
-    void *address = calloc(numberOfMembers, memberSize);
-    Watchdog_report("calloc", file, func, line, NULL, address, numberOfMembers * memberSize);
+    struct Watchdog_Thread *thread = Watchdog_getThread();
+    struct Watchdog_Site *site = Watchdog_getSite(file, func, line, module);
+    const struct Watchdog_Allocator *allocator = Watchdog_Allocator_get(module);
+    uint32_t redzone = 0;
+    void *address = NULL;
+    if (!atomic_load_explicit(&gHasGuards, memory_order_relaxed)) {
+        address = Watchdog_Allocator_allocateZeroed(allocator, numberOfMembers, memberSize);
+    } else if (0 != memberSize && numberOfMembers > SIZE_MAX / memberSize) {
+        errno = ENOMEM;
+    } else {
+        address = Watchdog_Guards_allocate(allocator, 0, numberOfMembers * memberSize, true, &redzone);
+    }
+    const bool isReported = Watchdog_Governor_isReported(thread);
+    Watchdog_allocated(thread, site, (uintptr_t) address, numberOfMembers * memberSize, module, redzone, isReported);
+    Watchdog_report(thread, site, WATCHDOG_CALL_CALLOC, 0, (uintptr_t) address, numberOfMembers * memberSize,
+                    isReported);
     return address;
 }
 
-void *__Watchdog_realloc(const char *const file, const char *const func, const int line,
+void *__Watchdog_realloc(const char *const file, const char *const func, const int line, const int callingModule,
                          void *const memory, const size_t newSize) {
     assert(NULL != file);
-    void *address = realloc(memory, newSize);
-    Watchdog_report("realloc", file, func, line, memory, address, newSize);
+    // see __WATCHDOG_CALLING_MODULE
+    const int module = callingModule % WATCHDOG_MODULES_COUNT;
+    struct Watchdog_Thread *thread = Watchdog_getThread();
+    struct Watchdog_Block block;
+    const uintptr_t relocated = (uintptr_t) memory;
+    // the block must be forgotten before releasing it, otherwise another thread may get and track the same address
+    const bool isTracked = 0 != relocated && Watchdog_removeBlock(relocated, &block);
+    if (!isTracked && callingModule >= WATCHDOG_MODULES_COUNT) {
+        if (NULL != memory && atomic_load_explicit(&gHasGuards, memory_order_relaxed)) {
+            Watchdog_Guards_checkUntracked(relocated, Watchdog_getSite(file, func, line, module));
+        }
+        return realloc(memory, newSize);
+    }
+    struct Watchdog_Site *site = Watchdog_getSite(file, func, line, module);
+    // a moved block keeps being reported or not, so that its events stay consistent
+    const bool isReported = isTracked ? block.isReported : Watchdog_Governor_isReported(thread);
+    // untracked blocks come from the standard allocators and stay there, their size is unknown
+    const int allocator = (isTracked || NULL == memory) ? module : WATCHDOG_ALLOCATOR_STANDARD;
+    const bool isGuarded = atomic_load_explicit(&gHasGuards, memory_order_relaxed) && allocator == module;
+    uint32_t redzone = 0;
+    void *address = NULL;
+    if (!isGuarded) {
+        if (NULL != memory && !isTracked && atomic_load_explicit(&gHasGuards, memory_order_relaxed)) {
+            Watchdog_Guards_checkUntracked(relocated, site);
+        }
+        address = Watchdog_Allocator_move(Watchdog_Allocator_get(isTracked ? block.allocator : allocator),
+                                          Watchdog_Allocator_get(allocator), memory,
+                                          isTracked ? block.size : 0, newSize);
+    } else if (NULL == memory || 0 != newSize) {
+        // guarded blocks are always moved, their redzones follow the size; as realloc does, 0 bytes free the block
+        address = Watchdog_Guards_allocate(Watchdog_Allocator_get(allocator), 0, newSize, false, &redzone);
+    }
+    if (NULL != address || 0 == newSize) {
+        if (isTracked) {
+            if (isGuarded) {
+                if (NULL != address) {
+                    memcpy(address, memory, (block.size < newSize) ? block.size : newSize);
+                }
+                Watchdog_Guards_release(&block, site);
+            }
+            Watchdog_freed(thread, &block);
+        }
+        Watchdog_allocated(thread, site, (uintptr_t) address, newSize, allocator, redzone, isReported);
+    } else if (isTracked) {     // on failure the original block is left untouched
+        Watchdog_insertBlock(&block);
+    }
+    Watchdog_report(thread, site, WATCHDOG_CALL_REALLOC, relocated, (uintptr_t) address, newSize, isReported);
     return address;
 }
 
-void __Watchdog_free(const char *const file, const char *const func, const int line, void *const memory) {
+void __Watchdog_free(const char *const file, const char *const func, const int line, const int callingModule,
+                     void *const memory) {
     assert(NULL != file);
-    free(memory);
-    Watchdog_report("free", file, func, line, NULL, memory, 0);
+    if (NULL != memory) {
+        // see __WATCHDOG_CALLING_MODULE
+        const int module = callingModule % WATCHDOG_MODULES_COUNT;
+        struct Watchdog_Thread *thread = Watchdog_getThread();
+        struct Watchdog_Block block;
+        const bool isTracked = Watchdog_removeBlock((uintptr_t) memory, &block);
+        if (!isTracked && callingModule >= WATCHDOG_MODULES_COUNT) {
+            if (atomic_load_explicit(&gHasGuards, memory_order_relaxed)) {
+                Watchdog_Guards_checkUntracked((uintptr_t) memory, Watchdog_getSite(file, func, line, module));
+            }
+            free(memory);
+            return;
+        }
+        // frees are accounted to the site of the allocation, the site of the free is needed only for reporting
+        struct Watchdog_Site *site = Watchdog_getSite(file, func, line, module);
+        if (isTracked) {
+            Watchdog_freed(thread, &block);
+        } else if (atomic_load_explicit(&gHasGuards, memory_order_relaxed)) {
+            Watchdog_Guards_checkUntracked((uintptr_t) memory, site);
+        }
+        Watchdog_report(thread, site, WATCHDOG_CALL_FREE, 0, (uintptr_t) memory, 0,
+                        isTracked ? block.isReported : 1 == atomic_load_explicit(&gReportingRate, memory_order_relaxed));
+        if (isTracked && 0 != block.redzone) {
+            Watchdog_Guards_release(&block, site);
+        } else {
+            const int allocator = isTracked ? block.allocator : WATCHDOG_ALLOCATOR_STANDARD;
+            Watchdog_Allocator_release(Watchdog_Allocator_get(allocator), memory);
+        }
+    }
 }
 
 /*
+ * Runtime switch
  *
+ * See WATCHDOG_RUNTIME_SWITCH in watchdog.h, the flag is only ever set. Guarded calls do not reach the library
+ * while it is clear, so the environment is read and the signal is handled from the time the library is loaded.
  */
-static void Watchdog_onExit(void) {
-    if (NULL != gStream) {
-        fclose(gStream);
-    }
-}
+#define WATCHDOG_SWITCH_SIGNAL      SIGUSR2
+#define WATCHDOG_SWITCH_VARIABLE    "WATCHDOG_ENABLE"
 
-void Watchdog_report(const char *const call, const char *const file, const char *const func, const int line,
-                     const void *const relocated, const void *const address, const size_t size) {
-    assert(NULL != call);
-    assert(NULL != file);
+unsigned char __Watchdog_isEnabled = 0;
+
+#if WATCHDOG_RUNTIME_SWITCH
+
+static void Watchdog_Switch_onLoad(void)
+__attribute__((__constructor__));
+
+static void Watchdog_Switch_onSignal(int signal);
+
+#endif
+
+void Watchdog_enable(void) {
+    __atomic_store_n(&__Watchdog_isEnabled, 1, __ATOMIC_RELAXED);
+}
+
+#if WATCHDOG_RUNTIME_SWITCH
+
+void Watchdog_Switch_onLoad(void) {
+    const char *value = getenv(WATCHDOG_SWITCH_VARIABLE);
+    if (NULL != value && '\0' != value[0] && 0 != strcmp("0", value)) {
+        Watchdog_enable();
+    }
+
+    // the default action terminates the process, handlers installed by the program are left alone
+    struct sigaction action;
+    if (0 == sigaction(WATCHDOG_SWITCH_SIGNAL, NULL, &action) && SIG_DFL == action.sa_handler) {
+        memset(&action, 0, sizeof(action));
+        sigemptyset(&action.sa_mask);
+        action.sa_handler = Watchdog_Switch_onSignal;
+        action.sa_flags = SA_RESTART;
+        sigaction(WATCHDOG_SWITCH_SIGNAL, &action, NULL);
+    }
+}
+
+void Watchdog_Switch_onSignal(const int signal) {
+    (void) signal;
+    Watchdog_enable();
+}
+
+#endif
+
+/*
+ *
+ */
+static void Watchdog_onExit(void);
+
+static void Watchdog_onForkPrepare(void);
+
+static void Watchdog_onForkParent(void);
+
+static void Watchdog_onForkChild(void);
+
+static void Watchdog_onThreadExit(void *thread);
+
+static void Watchdog_onSpawnExit(void);
+
+static void Watchdog_openStream(void);
+
+void Watchdog_initialize(void) {
+#if WATCHDOG_COLLECTOR
+    // must happen before registering the fork handlers, the collector is not a producer
+    Watchdog_Collector_start();
+#else
+    Watchdog_openStream();
+#endif
+    for (size_t i = 0; i < WATCHDOG_SHARDS_COUNT; i++) {
+        pthread_mutex_init(&gShards[i].mutex, NULL);
+    }
+    Watchdog_Ticker_init(&gSampler);
+    Watchdog_Ticker_init(&gSnapshotter);
+    Watchdog_Ticker_init(&gGovernorTicker);
+    Watchdog_Ticker_init(&gMetricsTicker);
+    // before the first traced allocation, which follows the initialization
+    const char *guards = getenv(WATCHDOG_GUARDS_VARIABLE);
+    if (NULL != guards && '\0' != guards[0] && 0 != strcmp("0", guards) && !atomic_load(&gHasGuards)) {
+        Watchdog_enableGuards(WATCHDOG_GUARDS_QUARANTINE);
+    }
+    if (0 != pthread_key_create(&gThreadKey, Watchdog_onThreadExit)) {
+        Panic_terminate("Unable to create thread key");
+    }
+    pthread_atfork(Watchdog_onForkPrepare, Watchdog_onForkParent, Watchdog_onForkChild);
+    atexit(Watchdog_onExit);
+    gPreviousExitCallback = Process_registerExitCallback(Watchdog_onSpawnExit);
+    Watchdog_Crash_install();
+}
+
+void Watchdog_allocated(struct Watchdog_Thread *const thread, struct Watchdog_Site *const site,
+                        const uintptr_t address, const size_t size, const int allocator, const uint32_t redzone,
+                        const bool isReported) {
+    assert(NULL != thread);
+    assert(NULL != site);
+    if (!atomic_load_explicit(&gHasAllocated, memory_order_relaxed)) {
+        atomic_store_explicit(&gHasAllocated, true, memory_order_relaxed);
+    }
+    if (0 != address) {
+        const struct Watchdog_Block block = {
+                .address=address, .size=size, .site=site, .threadId=thread->id, .isReported=isReported,
+                .allocator=(int8_t) allocator, .tag=Watchdog_Tags_current(), .redzone=redzone
+        };
+        Watchdog_insertBlock(&block);
+        atomic_store_explicit(&thread->allocations,
+                              atomic_load_explicit(&thread->allocations, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+        atomic_store_explicit(&thread->allocatedBytes,
+                              atomic_load_explicit(&thread->allocatedBytes, memory_order_relaxed) + size,
+                              memory_order_relaxed);
+
+        const size_t siteBytes = atomic_fetch_add_explicit(&site->liveBytes, size, memory_order_relaxed) + size;
+        const size_t siteBlocks = atomic_fetch_add_explicit(&site->liveBlocks, 1, memory_order_relaxed) + 1;
+        atomic_fetch_add_explicit(&site->allocatedBytes, size, memory_order_relaxed);
+        atomic_fetch_add_explicit(&site->allocations, 1, memory_order_relaxed);
+        Watchdog_Budget_check(&gSiteBudget, &site->isOverBudget, (long long) siteBytes, (long long) siteBlocks,
+                              "site", site->module, site);
+        if (0 != block.tag) {
+            struct Watchdog_Tag *tag = Watchdog_Tags_get(block.tag);
+            atomic_fetch_add_explicit(&tag->liveBytes, size, memory_order_relaxed);
+            atomic_fetch_add_explicit(&tag->liveBlocks, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&tag->allocatedBytes, size, memory_order_relaxed);
+            atomic_fetch_add_explicit(&tag->allocations, 1, memory_order_relaxed);
+        }
+        struct Watchdog_CounterProcess *process = atomic_load_explicit(&gCounterProcess, memory_order_relaxed);
+        if (NULL != process) {
+            Watchdog_Counters_add(process, site, (long long) size, 1);
+        }
+
+        thread->pendingBytes += (long long) size;
+        thread->pendingBlocks += 1;
+        thread->pendingModuleBytes[site->module] += (long long) size;
+        thread->pendingModuleBlocks[site->module] += 1;
+        if (thread->pendingBytes >= WATCHDOG_PENDING_BYTES || thread->pendingBlocks >= WATCHDOG_PENDING_BLOCKS) {
+            Watchdog_Thread_flush(thread);
+        }
+    }
+}
+
+void Watchdog_freed(struct Watchdog_Thread *const thread, const struct Watchdog_Block *const block) {
+    assert(NULL != thread);
+    assert(NULL != block);
+    atomic_store_explicit(&thread->frees,
+                          atomic_load_explicit(&thread->frees, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&thread->freedBytes,
+                          atomic_load_explicit(&thread->freedBytes, memory_order_relaxed) + block->size,
+                          memory_order_relaxed);
+    if (block->threadId != thread->id) {
+        const long owner = Watchdog_getOwner(block);
+        if (owner != thread->id) {
+            Watchdog_recordCrossThreadFree(block, owner, thread->id);
+        }
+    }
+
+    struct Watchdog_Site *site = block->site;
+    const size_t siteBytes = atomic_fetch_sub_explicit(&site->liveBytes, block->size, memory_order_relaxed);
+    const size_t siteBlocks = atomic_fetch_sub_explicit(&site->liveBlocks, 1, memory_order_relaxed);
+    Watchdog_Budget_check(&gSiteBudget, &site->isOverBudget,
+                          (long long) (siteBytes - block->size), (long long) (siteBlocks - 1),
+                          "site", site->module, site);
+    if (0 != block->tag) {
+        struct Watchdog_Tag *tag = Watchdog_Tags_get(block->tag);
+        atomic_fetch_sub_explicit(&tag->liveBytes, block->size, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&tag->liveBlocks, 1, memory_order_relaxed);
+    }
+    struct Watchdog_CounterProcess *process = atomic_load_explicit(&gCounterProcess, memory_order_relaxed);
+    if (NULL != process) {
+        Watchdog_Counters_add(process, site, -(long long) block->size, -1);
+    }
+
+    thread->pendingBytes -= (long long) block->size;
+    thread->pendingBlocks -= 1;
+    thread->pendingModuleBytes[site->module] -= (long long) block->size;
+    thread->pendingModuleBlocks[site->module] -= 1;
+    if (thread->pendingBytes <= -WATCHDOG_PENDING_BYTES || thread->pendingBlocks <= -WATCHDOG_PENDING_BLOCKS) {
+        Watchdog_Thread_flush(thread);
+    }
+}
+
+void Watchdog_report(struct Watchdog_Thread *const thread, struct Watchdog_Site *const site,
+                     const enum Watchdog_Call call,
+                     const uintptr_t relocated, const uintptr_t address, const size_t size, const bool isReported) {
+    assert(NULL != thread);
+    assert(NULL != site);
+    if (!isReported) {
+        Watchdog_count(&thread->sampledOut, 1);
+        return;
+    }
+
+    const long long start = Watchdog_now();
+    if (0 == thread->objectsCountdown--) {
+        thread->objectsCountdown = WATCHDOG_OBJECTS_PERIOD;
+        Watchdog_Objects_check();
+    }
+
+    const uint16_t index = Watchdog_Tags_current();
+    uint32_t tag = 0;
+    if (0 != index) {
+        struct Watchdog_Tag *entry = Watchdog_Tags_get(index);
+        Watchdog_Tags_write(entry);
+        tag = entry->id;
+    }
+
+    const struct Watchdog_Event event = {
+            .PID=Process_getCurrentId(), .parentPID=Process_getParentId(), .TID=thread->id,
+            .threadName=thread->name, .site=site, .call=call,
+            .relocated=relocated, .address=address, .size=size, .tag=tag, .timestamp=time(NULL)
+    };
+    Watchdog_emit(&event);
+
+    const long long elapsed = Watchdog_now() - start;
+    Watchdog_count(&thread->reported, 1);
+    Watchdog_count(&thread->reportingTime, (size_t) elapsed);
+    Watchdog_count(&thread->reportingTimes[Watchdog_Stats_bucket((unsigned long long) elapsed)], 1);
+}
+
+void Watchdog_onExit(void) {
+    const long PID = Process_getCurrentId(), parentPID = Process_getParentId();
+
+    if (Watchdog_Ticker_stop(&gSampler)) {
+        Watchdog_Sampler_sample();
+    }
+    if (Watchdog_Ticker_stop(&gSnapshotter)) {
+        Watchdog_Snapshot_take();
+    }
+    Watchdog_Ticker_stop(&gGovernorTicker);
+    Watchdog_Ticker_stop(&gMetricsTicker);
+    if (atomic_load_explicit(&gIsCheckingLeaksAtExit, memory_order_relaxed)) {
+        Watchdog_checkLeaks();
+    }
+    Watchdog_checkGuards();
+
+    pthread_mutex_lock(&gThreadsMutex);
+    for (const struct Watchdog_Thread *thread = gThreads; NULL != thread; thread = thread->next) {
+        Watchdog_writef(
+                "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"thread\", \"TID\": %ld, \"name\": \"%s\", \"allocations\": %zu, \"allocatedBytes\": %zu, \"frees\": %zu, \"freedBytes\": %zu}\n",
+                PID, parentPID, thread->id, thread->name,
+                atomic_load_explicit(&thread->allocations, memory_order_relaxed),
+                atomic_load_explicit(&thread->allocatedBytes, memory_order_relaxed),
+                atomic_load_explicit(&thread->frees, memory_order_relaxed),
+                atomic_load_explicit(&thread->freedBytes, memory_order_relaxed));
+    }
+    pthread_mutex_unlock(&gThreadsMutex);
+
+    pthread_mutex_lock(&gCrossThreadFreesMutex);
+    for (size_t i = 0; i < gCrossThreadFreesCapacity; i++) {
+        const struct Watchdog_CrossThreadFree *entry = &gCrossThreadFrees[i];
+        if (NULL != entry->site) {
+            Watchdog_writef(
+                    "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"crossThreadFree\", \"file\": \"%s\", \"func\": \"%s\", \"line\": %d, \"allocatedBy\": %ld, \"freedBy\": %ld, \"frees\": %zu, \"freedBytes\": %zu}\n",
+                    PID, parentPID, entry->site->file, entry->site->func, entry->site->line,
+                    entry->allocatedBy, entry->freedBy, entry->frees, entry->freedBytes);
+        }
+    }
+    pthread_mutex_unlock(&gCrossThreadFreesMutex);
+    Watchdog_Stats_write();
+    Watchdog_Counters_release();
+
+    // the stream is left open on purpose: late calls from other threads or exit handlers may still be traced
+#if WATCHDOG_COLLECTOR
+    Watchdog_Collector_detach();
+    if (Process_getCurrentId() == gCollectorParentId) {
+        // wait for the collector to drain the ring, so the trace is complete when the program terminates
+        struct Process_ExitInfo info;
+        if (Ok == Process_wait(&gCollector, &info)) {
+            Process_teardown(&gCollector);
+        }
+    }
+#else
+    flockfile(gStream);
+    Watchdog_Chunk_close();
+    Watchdog_Buffer_flush(&gBuffer);
+    gBuffer.isDirect = true;
+    funlockfile(gStream);
+#endif
+}
+
+void Watchdog_flush(void) {
+#if !WATCHDOG_COLLECTOR
+    if (NULL != gStream) {
+        flockfile(gStream);
+        Watchdog_Chunk_close();
+        Watchdog_Buffer_flush(&gBuffer);
+        funlockfile(gStream);
+    }
+#endif
+}
+
+void Watchdog_onSpawnExit(void) {
+    Watchdog_flush();
+    if (NULL != gPreviousExitCallback) {
+        gPreviousExitCallback();
+    }
+}
+
+void Watchdog_openStream(void) {
+    char fileName[65] = "";
+    // the process id keeps apart the shards of processes initializing in the same second, see watchdog-merge
+    snprintf(fileName, 64, ".watchdog-%d-%lu-%d.jsonl", WATCHDOG_VERSION_HEX, time(NULL), Process_getCurrentId());
+    gStream = fopen(fileName, "w");
+    if (NULL == gStream) {
+        Panic_terminate("Unable to open file: %s", fileName);
+    }
+    gBuffer.fd = fileno(gStream);
+}
+
+void Watchdog_onThreadExit(void *const thread) {
+    assert(NULL != thread);
+    Watchdog_Thread_flush(thread);
+    // the stack may be unmapped from now on
+    atomic_store_explicit(&((struct Watchdog_Thread *) thread)->isRunning, false, memory_order_relaxed);
+}
+
+void Watchdog_onForkPrepare(void) {
+    if (NULL != tThread) {
+        Watchdog_Thread_flush(tThread);
+    }
+    pthread_mutex_lock(&gObjectsMutex);
+    pthread_mutex_lock(&gCountersMutex);
+    pthread_mutex_lock(&gSitesMutex);
+    pthread_mutex_lock(&gTagsMutex);
+    pthread_mutex_lock(&gThreadsMutex);
+    pthread_mutex_lock(&gCrossThreadFreesMutex);
+    pthread_mutex_lock(&gQuarantineMutex);
+    for (size_t i = 0; i < WATCHDOG_SHARDS_COUNT; i++) {
+        pthread_mutex_lock(&gShards[i].mutex);
+    }
+    if (NULL != gStream) {
+        flockfile(gStream);
+    }
+}
+
+void Watchdog_onForkParent(void) {
+    if (NULL != gStream) {
+        funlockfile(gStream);
+    }
+    for (size_t i = 0; i < WATCHDOG_SHARDS_COUNT; i++) {
+        pthread_mutex_unlock(&gShards[i].mutex);
+    }
+    pthread_mutex_unlock(&gQuarantineMutex);
+    pthread_mutex_unlock(&gCrossThreadFreesMutex);
+    pthread_mutex_unlock(&gThreadsMutex);
+    pthread_mutex_unlock(&gTagsMutex);
+    pthread_mutex_unlock(&gSitesMutex);
+    pthread_mutex_unlock(&gCountersMutex);
+    pthread_mutex_unlock(&gObjectsMutex);
+}
+
+void Watchdog_onForkChild(void) {
+    // only the forking thread survives: statistics collected so far belong to the parent process
+    if (NULL != tThread && gInheritancesLength < WATCHDOG_FORKS_DEPTH) {
+#ifdef __linux__
+        const long childId = syscall(SYS_gettid);
+#else
+        const long childId = (long) pthread_self();
+#endif
+        gInheritances[gInheritancesLength++] = (struct Watchdog_Inheritance) {
+                .parentId=tThread->id, .childId=childId
+        };
+    }
+    tThread = NULL;
+    gThreads = NULL;
+    gObjectsLoads = 0;     // the child writes its objects at its first traced call
+    for (size_t i = 0; i < WATCHDOG_TAGS_CAPACITY; i++) {
+        gTags[i].isWritten = false;     // and its tags before their first events, as records carry the PID
+    }
+    gOverflowTag.isWritten = false;
+    gSampler.isRunning = false;
+    gSnapshotter.isRunning = false;
+    gGovernorTicker.isRunning = false;
+    gMetricsTicker.isRunning = false;
+    gIsGoverned = false;
+    gReportingRate = 1;    // the governor must be started again, meanwhile the child reports every call
+    if (NULL != gCrossThreadFrees) {
+        memset(gCrossThreadFrees, 0, gCrossThreadFreesCapacity * sizeof(gCrossThreadFrees[0]));
+        gCrossThreadFreesLength = 0;
+    }
+#if WATCHDOG_COLLECTOR
+    Watchdog_Collector_attach();
+    Watchdog_onForkParent();
+#else
+    Watchdog_onForkParent();
+    // chunks describe the bytes of a single writer: the child switches to a trace of its own
+    if (NULL != gStream) {
+        // pending records belong to the parent, which is going to write them
+        fclose(gStream);
+        gChunk = (struct Watchdog_Chunk) {0};
+        atomic_store_explicit(&gBuffer.length, 0, memory_order_relaxed);
+        atomic_store_explicit(&gBuffer.flushed, 0, memory_order_relaxed);
+        gBuffer.records = 0;
+        gBufferStats = (struct Watchdog_BufferStats) {0};
+        Watchdog_openStream();
+    }
+#endif
+    if (NULL != atomic_load_explicit(&gCounterProcess, memory_order_relaxed)) {
+        // entries of sites belong to the slot of the parent, the child takes a slot of its own if any is left
+        atomic_store_explicit(&gCounterProcess, Watchdog_Counters_register(true), memory_order_relaxed);
+    }
+}
+
+/*
+ * Sites
+ */
+static size_t Watchdog_hash(uintptr_t value)
+__attribute__((__warn_unused_result__));
+
+struct Watchdog_Site *Watchdog_getSite(const char *const file, const char *const func, const int line,
+                                       const int module) {
+    assert(NULL != file);
+    assert(NULL != func);
+    assert(0 <= module && module < WATCHDOG_MODULES_COUNT);
+    const size_t mask = WATCHDOG_SITES_CAPACITY - 1;
+    size_t i = Watchdog_hash((uintptr_t) file ^ ((uintptr_t) func << 1) ^ ((uintptr_t) line << 2)) & mask;
+
+    for (size_t probes = 0; probes < WATCHDOG_SITES_CAPACITY; probes++, i = (i + 1) & mask) {
+        struct Watchdog_Site *site = &gSites[i];
+        if (!atomic_load_explicit(&site->isUsed, memory_order_acquire)) {
+            pthread_mutex_lock(&gSitesMutex);
+            if (!atomic_load_explicit(&site->isUsed, memory_order_relaxed)) {
+                site->file = file;
+                site->func = func;
+                site->fileLength = strlen(file);
+                site->funcLength = strlen(func);
+                site->line = line;
+                site->module = module;
+                site->hash = Watchdog_Site_hash(file, line);
+                atomic_store_explicit(&site->isUsed, true, memory_order_release);
+                pthread_mutex_unlock(&gSitesMutex);
+                return site;
+            }
+            pthread_mutex_unlock(&gSitesMutex);
+        }
+        if (site->line == line && site->file == file && site->func == func) {
+            return site;
+        }
+    }
+
+    return &gOverflowSite;
+}
+
+uint64_t Watchdog_Site_hash(const char *const file, const int line) {
+    assert(NULL != file);
+    char digits[16];
+    uint64_t hash = UINT64_C(14695981039346656037);
+    const int length = snprintf(digits, sizeof(digits), ":%d", line);
+    for (const char *c = file; '\0' != *c; c++) {
+        hash = (hash ^ (unsigned char) *c) * UINT64_C(1099511628211);
+    }
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) digits[i]) * UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+size_t Watchdog_hash(const uintptr_t value) {
+    // Fibonacci hashing, the lower bits of addresses are mostly zero due to alignment
+    return (size_t) (((uint64_t) value * UINT64_C(0x9E3779B97F4A7C15)) >> 20);
+}
+
+/*
+ * Threads
+ */
+static void Watchdog_escape(char *destination, size_t size, const char *source)
+__attribute__((__nonnull__));
+
+struct Watchdog_Thread *Watchdog_getThread(void) {
+    pthread_once(&gInitializeOnce, Watchdog_initialize);
+    if (NULL == tThread) {
+        struct Watchdog_Thread *thread = calloc(1, sizeof(*thread));
+        if (NULL == thread) {
+            Panic_terminate("Out of memory");
+        }
+        atomic_fetch_add_explicit(&gFootprint, sizeof(*thread), memory_order_relaxed);
+
+#ifdef __linux__
+        char name[WATCHDOG_THREAD_NAME_SIZE] = "";
+        thread->id = syscall(SYS_gettid);
+        if (0 == pthread_getname_np(pthread_self(), name, sizeof(name))) {
+            Watchdog_escape(thread->name, sizeof(thread->name), name);
+        }
+        pthread_attr_t attributes;
+        if (0 == pthread_getattr_np(pthread_self(), &attributes)) {
+            void *stack = NULL;
+            size_t stackSize = 0;
+            if (0 == pthread_attr_getstack(&attributes, &stack, &stackSize)) {
+                thread->stackLow = (uintptr_t) stack;
+                thread->stackHigh = (uintptr_t) stack + stackSize;
+            }
+            pthread_attr_destroy(&attributes);
+        }
+#else
+        thread->id = (long) pthread_self();
+#endif
+
+        atomic_store_explicit(&thread->isRunning, true, memory_order_relaxed);
+        pthread_mutex_lock(&gThreadsMutex);
+        thread->next = gThreads;
+        gThreads = thread;
+        pthread_mutex_unlock(&gThreadsMutex);
+        pthread_setspecific(gThreadKey, thread);
+        tThread = thread;
+    }
+    return tThread;
+}
+
+void Watchdog_count(atomic_size_t *const counter, const size_t amount) {
+    assert(NULL != counter);
+    // written by the owner only, a plain store spares the locked instruction of atomic_fetch_add
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount,
+                          memory_order_relaxed);
+}
+
+void Watchdog_escape(char *destination, const size_t size, const char *source) {
+    assert(NULL != destination);
+    assert(NULL != source);
+    assert(size > 0);
+    size_t i = 0;
+    for (; '\0' != *source; source++) {
+        const unsigned char c = (unsigned char) *source;
+        char escaped[7] = "";
+        if ('"' == c || '\\' == c) {
+            escaped[0] = '\\';
+            escaped[1] = (char) c;
+        } else if (c < 0x20) {
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        } else {
+            escaped[0] = (char) c;
+        }
+        const size_t length = strlen(escaped);
+        if (i + length >= size) {
+            break;
+        }
+        memcpy(destination + i, escaped, length);
+        i += length;
+    }
+    destination[i] = '\0';
+}
+
+/*
+ * Tags
+ */
+void Watchdog_pushTag(const char *const tag) {
+    assert(NULL != tag);
+    if (tTagsDepth < WATCHDOG_TAGS_DEPTH) {
+        tTags[tTagsDepth] = Watchdog_Tags_intern(tag);
+    }
+    tTagsDepth += 1;
+}
+
+void Watchdog_popTag(void) {
+    if (0 == tTagsDepth) {
+        Panic_terminate("Unbalanced call to Watchdog_popTag");
+    }
+    tTagsDepth -= 1;
+}
+
+uint16_t Watchdog_Tags_intern(const char *const tag) {
+    assert(NULL != tag);
+    const size_t mask = WATCHDOG_TAGS_CAPACITY - 1;
+    char name[WATCHDOG_TAG_NAME_SIZE];
+    const size_t length = strnlen(tag, sizeof(name) - 1);
+    memcpy(name, tag, length);
+    name[length] = '\0';
+
+    uint32_t id = UINT32_C(2166136261);
+    for (size_t i = 0; i < length; i++) {
+        id = (id ^ (unsigned char) name[i]) * UINT32_C(16777619);
+    }
+    id = (0 == id) ? 1 : id;    // 0 means untagged
+
+    size_t i = id & mask;
+    for (size_t probes = 0; probes < WATCHDOG_TAGS_CAPACITY; probes++, i = (i + 1) & mask) {
+        struct Watchdog_Tag *entry = &gTags[i];
+        if (!atomic_load_explicit(&entry->isUsed, memory_order_acquire)) {
+            pthread_mutex_lock(&gTagsMutex);
+            if (!atomic_load_explicit(&entry->isUsed, memory_order_relaxed)) {
+                entry->id = id;
+                memcpy(entry->name, name, length + 1);
+                Watchdog_escape(entry->escapedName, sizeof(entry->escapedName), name);
+                atomic_store_explicit(&entry->isUsed, true, memory_order_release);
+                pthread_mutex_unlock(&gTagsMutex);
+                return (uint16_t) (i + 1);
+            }
+            pthread_mutex_unlock(&gTagsMutex);
+        }
+        if (entry->id == id && 0 == strcmp(entry->name, name)) {
+            return (uint16_t) (i + 1);
+        }
+    }
+
+    return WATCHDOG_TAGS_CAPACITY + 1;
+}
+
+struct Watchdog_Tag *Watchdog_Tags_get(const uint16_t index) {
+    assert(0 != index);
+    return (index <= WATCHDOG_TAGS_CAPACITY) ? &gTags[index - 1] : &gOverflowTag;
+}
+
+uint16_t Watchdog_Tags_current(void) {
+    const unsigned depth = tTagsDepth;
+    return (0 == depth) ? 0 : tTags[((depth < WATCHDOG_TAGS_DEPTH) ? depth : WATCHDOG_TAGS_DEPTH) - 1];
+}
+
+void Watchdog_Tags_write(struct Watchdog_Tag *const self) {
+    assert(NULL != self);
+    if (atomic_load_explicit(&self->isWritten, memory_order_acquire)) {
+        return;
+    }
+    // the flag is published once the record is written, so that no thread emits the id of the tag before its name
+    pthread_mutex_lock(&gTagsMutex);
+    if (!atomic_load_explicit(&self->isWritten, memory_order_relaxed)) {
+        Watchdog_writef("{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"tag\", \"tag\": %" PRIu32 ", \"name\": \"%s\"}\n",
+                        (long) Process_getCurrentId(), (long) Process_getParentId(), self->id, self->escapedName);
+        atomic_store_explicit(&self->isWritten, true, memory_order_release);
+    }
+    pthread_mutex_unlock(&gTagsMutex);
+}
+
+/*
+ * Objects
+ */
+#ifdef __linux__
+
+static int Watchdog_Objects_count(struct dl_phdr_info *info, size_t size, void *loads)
+__attribute__((__nonnull__));
+
+static int Watchdog_Objects_write(struct dl_phdr_info *info, size_t size, void *count)
+__attribute__((__nonnull__));
+
+void Watchdog_Objects_check(void) {
+    unsigned long long loads = 0;
+    dl_iterate_phdr(Watchdog_Objects_count, &loads);
+    if (loads == atomic_load_explicit(&gObjectsLoads, memory_order_relaxed)) {
+        return;
+    }
+    pthread_mutex_lock(&gObjectsMutex);
+    if (loads != atomic_load_explicit(&gObjectsLoads, memory_order_relaxed)) {
+        size_t count = 0;
+        dl_iterate_phdr(Watchdog_Objects_write, &count);
+        Watchdog_writef("{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"objects\", \"count\": %zu}\n",
+                        (long) Process_getCurrentId(), (long) Process_getParentId(), count);
+        // objects loaded in the meanwhile are written at the next check
+        atomic_store_explicit(&gObjectsLoads, loads, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&gObjectsMutex);
+}
+
+int Watchdog_Objects_count(struct dl_phdr_info *const info, const size_t size, void *const loads) {
+    assert(NULL != info);
+    assert(NULL != loads);
+    (void) size;
+    *(unsigned long long *) loads = info->dlpi_adds + info->dlpi_subs;
+    return 1;   // counters are the same for every object
+}
+
+int Watchdog_Objects_write(struct dl_phdr_info *const info, const size_t size, void *const count) {
+    assert(NULL != info);
+    assert(NULL != count);
+    (void) size;
+    static char escapedPath[4096 * 6];    // written under gObjectsMutex, too large for the stacks of threads
+    char path[4096] = "", buildId[2 * 64 + 1] = "";
+    uintptr_t start = UINTPTR_MAX, end = 0;
+
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *header = &info->dlpi_phdr[i];
+        if (PT_LOAD == header->p_type) {
+            start = (header->p_vaddr < start) ? header->p_vaddr : start;
+            end = (header->p_vaddr + header->p_memsz > end) ? header->p_vaddr + header->p_memsz : end;
+        } else if (PT_NOTE == header->p_type && '\0' == buildId[0]) {
+            // notes are aligned to 4 bytes, or to 8 bytes in segments aligned so
+            const size_t alignment = (8 == header->p_align) ? 8 : 4;
+            const char *note = (const char *) (info->dlpi_addr + header->p_vaddr);
+            const char *const notesEnd = note + header->p_memsz;
+            while (note + sizeof(ElfW(Nhdr)) <= notesEnd) {
+                const ElfW(Nhdr) *const entry = (const ElfW(Nhdr) *) note;
+                const char *const name = note + sizeof(*entry);
+                const unsigned char *const description = (const unsigned char *) name +
+                                                         ((entry->n_namesz + alignment - 1) & ~(alignment - 1));
+                if (NT_GNU_BUILD_ID == entry->n_type && 4 == entry->n_namesz && 0 == memcmp("GNU", name, 4)) {
+                    for (size_t j = 0; j < entry->n_descsz && j < 64; j++) {
+                        snprintf(buildId + 2 * j, 3, "%02x", description[j]);
+                    }
+                    break;
+                }
+                note = (const char *) description + ((entry->n_descsz + alignment - 1) & ~(alignment - 1));
+            }
+        }
+    }
+    if (0 == end) {
+        return 0;
+    }
+
+    // the executable comes first, without a name
+    if ('\0' != info->dlpi_name[0]) {
+        snprintf(path, sizeof(path), "%s", info->dlpi_name);
+    } else if (0 == *(size_t *) count) {
+        const ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+        path[(length > 0) ? length : 0] = '\0';
+    }
+    Watchdog_escape(escapedPath, sizeof(escapedPath), path);
+    Watchdog_writef("{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"object\", \"path\": \"%s\", \"base\": \"0x%" PRIxPTR "\", \"start\": \"0x%" PRIxPTR "\", \"end\": \"0x%" PRIxPTR "\", \"buildId\": \"%s\"}\n",
+                    (long) Process_getCurrentId(), (long) Process_getParentId(), escapedPath,
+                    (uintptr_t) info->dlpi_addr, (uintptr_t) info->dlpi_addr + start, (uintptr_t) info->dlpi_addr + end,
+                    buildId);
+    *(size_t *) count += 1;
+    return 0;
+}
+
+#else
+
+void Watchdog_Objects_check(void) {
+    // objects are not listed on this platform, addresses are left to the symbolizer alone
+}
+
+#endif
+
+/*
+ * Live blocks
+ */
+static struct Watchdog_Shard *Watchdog_getShard(uintptr_t address)
+__attribute__((__warn_unused_result__, __returns_nonnull__));
+
+static void Watchdog_Shard_grow(struct Watchdog_Shard *self)
+__attribute__((__nonnull__));
+
+static void Watchdog_Shard_put(struct Watchdog_Shard *self, const struct Watchdog_Block *block)
+__attribute__((__nonnull__));
+
+void Watchdog_insertBlock(const struct Watchdog_Block *const block) {
+    assert(NULL != block);
+    assert(0 != block->address);
+    struct Watchdog_Shard *shard = Watchdog_getShard(block->address);
+    pthread_mutex_lock(&shard->mutex);
+    if (2 * (shard->length + 1) > shard->capacity) {
+        Watchdog_Shard_grow(shard);
+    }
+    Watchdog_Shard_put(shard, block);
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+bool Watchdog_removeBlock(const uintptr_t address, struct Watchdog_Block *const out) {
+    assert(0 != address);
+    assert(NULL != out);
+    bool isFound = false;
+    struct Watchdog_Shard *shard = Watchdog_getShard(address);
+    pthread_mutex_lock(&shard->mutex);
+    if (shard->length > 0) {
+        const size_t mask = shard->capacity - 1;
+        size_t i = Watchdog_hash(address) & mask;
+        for (; 0 != shard->blocks[i].address; i = (i + 1) & mask) {
+            if (shard->blocks[i].address == address) {
+                *out = shard->blocks[i];
+                isFound = true;
+                break;
+            }
+        }
+        if (isFound) {
+            shard->bytes -= out->size;
+            // backward shift deletion: move back the following entries that are not in their home slot
+            size_t hole = i;
+            for (size_t j = (i + 1) & mask; 0 != shard->blocks[j].address; j = (j + 1) & mask) {
+                const size_t home = Watchdog_hash(shard->blocks[j].address) & mask;
+                if (((j - home) & mask) >= ((j - hole) & mask)) {
+                    shard->blocks[hole] = shard->blocks[j];
+                    hole = j;
+                }
+            }
+            shard->blocks[hole].address = 0;
+            shard->length -= 1;
+        }
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return isFound;
+}
+
+struct Watchdog_Shard *Watchdog_getShard(const uintptr_t address) {
+    // use bits above the ones selecting the slot inside the shard
+    return &gShards[(Watchdog_hash(address) >> 32) & (WATCHDOG_SHARDS_COUNT - 1)];
+}
+
+void Watchdog_Shard_grow(struct Watchdog_Shard *const self) {
+    assert(NULL != self);
+    struct Watchdog_Block *blocks = self->blocks;
+    const size_t capacity = self->capacity;
+
+    self->capacity = (0 == capacity) ? 64 : 2 * capacity;
+    self->blocks = calloc(self->capacity, sizeof(self->blocks[0]));
+    if (NULL == self->blocks) {
+        Panic_terminate("Out of memory");
+    }
+    atomic_fetch_add_explicit(&gFootprint, (self->capacity - capacity) * sizeof(self->blocks[0]), memory_order_relaxed);
+    self->length = 0;
+    self->bytes = 0;
+
+    for (size_t i = 0; i < capacity; i++) {
+        if (0 != blocks[i].address) {
+            Watchdog_Shard_put(self, &blocks[i]);
+        }
+    }
+    free(blocks);
+}
+
+void Watchdog_Shard_put(struct Watchdog_Shard *const self, const struct Watchdog_Block *const block) {
+    assert(NULL != self);
+    assert(NULL != block);
+    const size_t mask = self->capacity - 1;
+    size_t i = Watchdog_hash(block->address) & mask;
+    for (; 0 != self->blocks[i].address; i = (i + 1) & mask) {
+        if (self->blocks[i].address == block->address) {
+            // the address has been reused by a block allocated outside watchdog
+            self->bytes = self->bytes - self->blocks[i].size + block->size;
+            self->blocks[i] = *block;
+            return;
+        }
+    }
+    self->blocks[i] = *block;
+    self->length += 1;
+    self->bytes += block->size;
+}
+
+void Watchdog_getLiveTotals(size_t *const bytes, size_t *const blocks) {
+    assert(NULL != bytes);
+    assert(NULL != blocks);
+    *bytes = 0;
+    *blocks = 0;
+    for (size_t i = 0; i < WATCHDOG_SHARDS_COUNT; i++) {
+        pthread_mutex_lock(&gShards[i].mutex);
+        *bytes += gShards[i].bytes;
+        *blocks += gShards[i].length;
+        pthread_mutex_unlock(&gShards[i].mutex);
+    }
+}
+
+/*
+ * Allocators
+ */
+static void *Watchdog_Arena_allocate(void *self, size_t size);
+
+static void *Watchdog_Arena_allocateZeroed(void *self, size_t numberOfMembers, size_t memberSize);
+
+static void *Watchdog_Arena_reallocate(void *self, void *memory, size_t newSize);
+
+static void *Watchdog_Arena_allocateAligned(void *self, size_t alignment, size_t size);
+
+static void Watchdog_Arena_release(void *self, void *memory);
+
+static bool Watchdog_Arena_contains(const struct Watchdog_Arena *self, const void *memory)
+__attribute__((__warn_unused_result__, __nonnull__(1)));
+
+static void *Watchdog_Slab_allocate(void *self, size_t size);
+
+static void *Watchdog_Slab_allocateZeroed(void *self, size_t numberOfMembers, size_t memberSize);
+
+static void *Watchdog_Slab_reallocate(void *self, void *memory, size_t newSize);
+
+static void *Watchdog_Slab_allocateAligned(void *self, size_t alignment, size_t size);
+
+static void Watchdog_Slab_release(void *self, void *memory);
+
+static uint32_t Watchdog_Slab_getClass(size_t size)
+__attribute__((__warn_unused_result__, __const__));
+
+static size_t Watchdog_Slab_getClassSize(uint32_t sizeClass)
+__attribute__((__warn_unused_result__, __const__));
+
+void Watchdog_setAllocator(const struct Watchdog_Allocator *const allocator) {
+    for (int module = 0; module < WATCHDOG_MODULES_COUNT; module++) {
+        Watchdog_setModuleAllocator(module, allocator);
+    }
+}
+
+void Watchdog_setModuleAllocator(const int module, const struct Watchdog_Allocator *const allocator) {
+    assert(0 <= module && module < WATCHDOG_MODULES_COUNT);
+    if (atomic_load(&gHasAllocated)) {
+        Panic_terminate("Allocators must be set before the first traced allocation");
+    }
+    if (NULL != allocator && (NULL == allocator->allocate || NULL == allocator->allocateZeroed ||
+                              NULL == allocator->reallocate || NULL == allocator->allocateAligned ||
+                              NULL == allocator->release)) {
+        Panic_terminate("Allocators must implement every function");
+    }
+    gAllocators[module] = (NULL == allocator) ? gStandardAllocator : *allocator;
+}
+
+const struct Watchdog_Allocator *Watchdog_Allocator_get(const int module) {
+    return (WATCHDOG_ALLOCATOR_STANDARD == module) ? &gStandardAllocator : &gAllocators[module];
+}
+
+bool Watchdog_Allocator_isSame(const struct Watchdog_Allocator *const self,
+                               const struct Watchdog_Allocator *const other) {
+    assert(NULL != self);
+    assert(NULL != other);
+    return 0 == memcmp(self, other, sizeof(*self));
+}
+
+void *Watchdog_Allocator_allocate(const struct Watchdog_Allocator *const self, const size_t size) {
+    assert(NULL != self);
+    return (NULL == self->allocate) ? malloc(size) : self->allocate(self->context, size);
+}
+
+void *Watchdog_Allocator_allocateZeroed(const struct Watchdog_Allocator *const self,
+                                        const size_t numberOfMembers, const size_t memberSize) {
+    assert(NULL != self);
+    return (NULL == self->allocateZeroed) ? calloc(numberOfMembers, memberSize) :
+           self->allocateZeroed(self->context, numberOfMembers, memberSize);
+}
+
+void *Watchdog_Allocator_allocateAligned(const struct Watchdog_Allocator *const self,
+                                         const size_t alignment, const size_t size) {
+    assert(NULL != self);
+    return (NULL == self->allocateAligned) ? aligned_alloc(alignment, size) :
+           self->allocateAligned(self->context, alignment, size);
+}
+
+void *Watchdog_Allocator_move(const struct Watchdog_Allocator *const from, const struct Watchdog_Allocator *const to,
+                              void *const memory, const size_t size, const size_t newSize) {
+    assert(NULL != from);
+    assert(NULL != to);
+    if (NULL == memory || Watchdog_Allocator_isSame(from, to)) {
+        return (NULL == to->reallocate) ? realloc(memory, newSize) : to->reallocate(to->context, memory, newSize);
+    }
+    // across allocators the block is copied, on failure the original one is left untouched as realloc does
+    void *address = Watchdog_Allocator_allocate(to, newSize);
+    if (NULL != address || 0 == newSize) {
+        if (NULL != address) {
+            memcpy(address, memory, (size < newSize) ? size : newSize);
+        }
+        Watchdog_Allocator_release(from, memory);
+    }
+    return address;
+}
+
+void Watchdog_Allocator_release(const struct Watchdog_Allocator *const self, void *const memory) {
+    assert(NULL != self);
+    if (NULL == self->release) {
+        free(memory);
+    } else {
+        self->release(self->context, memory);
+    }
+}
+
+struct Watchdog_Allocator Watchdog_newArenaAllocator(const size_t capacity) {
+    struct Watchdog_Arena *self = calloc(1, sizeof(*self));
+    if (NULL == self) {
+        Panic_terminate("Out of memory");
+    }
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+    flags |= MAP_NORESERVE;     // pages are committed as they are touched
+#endif
+    void *region = mmap(NULL, capacity, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (MAP_FAILED == region) {
+        Panic_terminate("Unable to reserve %zu bytes for the arena", capacity);
+    }
+    self->begin = region;
+    self->end = self->begin + capacity;
+    atomic_init(&self->top, (uintptr_t) self->begin);
+    return (struct Watchdog_Allocator) {
+            .context=self, .allocate=Watchdog_Arena_allocate, .allocateZeroed=Watchdog_Arena_allocateZeroed,
+            .reallocate=Watchdog_Arena_reallocate, .allocateAligned=Watchdog_Arena_allocateAligned,
+            .release=Watchdog_Arena_release
+    };
+}
+
+void *Watchdog_Arena_allocate(void *const self, const size_t size) {
+    return Watchdog_Arena_allocateAligned(self, WATCHDOG_ALLOCATOR_ALIGNMENT, size);
+}
+
+void *Watchdog_Arena_allocateZeroed(void *const self, const size_t numberOfMembers, const size_t memberSize) {
+    size_t size;
+    if (__builtin_mul_overflow(numberOfMembers, memberSize, &size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    // the region is never reused, so it holds zeroes until allocated
+    void *address = Watchdog_Arena_allocate(self, size);
+    if (NULL != address && !Watchdog_Arena_contains(self, address)) {
+        memset(address, 0, size);
+    }
+    return address;
+}
+
+void *Watchdog_Arena_reallocate(void *const self, void *const memory, const size_t newSize) {
+    struct Watchdog_Arena *arena = self;
+    assert(NULL != arena);
+    if (NULL == memory) {
+        return Watchdog_Arena_allocate(self, newSize);
+    }
+    if (!Watchdog_Arena_contains(arena, memory)) {
+        return realloc(memory, newSize);
+    }
+
+    size_t *size = (size_t *) ((char *) memory - WATCHDOG_ALLOCATOR_ALIGNMENT);
+    const uintptr_t end = (uintptr_t) memory + ((*size + WATCHDOG_ALLOCATOR_ALIGNMENT - 1) &
+                                                ~(size_t) (WATCHDOG_ALLOCATOR_ALIGNMENT - 1));
+    if (newSize <= *size) {
+        *size = newSize;
+        return memory;
+    }
+    if (newSize <= (size_t) (arena->end - (char *) memory)) {
+        // the last block grows in place
+        const uintptr_t newEnd = (uintptr_t) memory + ((newSize + WATCHDOG_ALLOCATOR_ALIGNMENT - 1) &
+                                                       ~(size_t) (WATCHDOG_ALLOCATOR_ALIGNMENT - 1));
+        uintptr_t top = end;
+        if (newEnd <= (uintptr_t) arena->end && atomic_compare_exchange_strong(&arena->top, &top, newEnd)) {
+            *size = newSize;
+            return memory;
+        }
+    }
+    void *address = Watchdog_Arena_allocate(self, newSize);
+    if (NULL != address) {
+        memcpy(address, memory, *size);
+    }
+    return address;
+}
+
+void *Watchdog_Arena_allocateAligned(void *const self, size_t alignment, const size_t size) {
+    struct Watchdog_Arena *arena = self;
+    assert(NULL != arena);
+    alignment = (alignment < WATCHDOG_ALLOCATOR_ALIGNMENT) ? WATCHDOG_ALLOCATOR_ALIGNMENT : alignment;
+    if (0 != (alignment & (alignment - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    const size_t capacity = (size_t) (arena->end - arena->begin);
+    uintptr_t top = atomic_load_explicit(&arena->top, memory_order_relaxed);
+    while (size <= capacity && alignment <= capacity) {
+        const uintptr_t start = (top + WATCHDOG_ALLOCATOR_ALIGNMENT + alignment - 1) & ~(uintptr_t) (alignment - 1);
+        const size_t rounded = (size + WATCHDOG_ALLOCATOR_ALIGNMENT - 1) &
+                               ~(size_t) (WATCHDOG_ALLOCATOR_ALIGNMENT - 1);
+        if (start > (uintptr_t) arena->end || rounded > (uintptr_t) arena->end - start) {
+            break;
+        }
+        if (atomic_compare_exchange_weak_explicit(&arena->top, &top, start + rounded,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            *(size_t *) (start - WATCHDOG_ALLOCATOR_ALIGNMENT) = size;
+            return (void *) start;
+        }
+    }
+    // the region is exhausted, sizes are rounded up to the alignment as strict C11 requires
+    if (size > SIZE_MAX - alignment) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1));
+}
+
+void Watchdog_Arena_release(void *const self, void *const memory) {
+    assert(NULL != self);
+    if (!Watchdog_Arena_contains(self, memory)) {
+        free(memory);
+    }
+}
+
+bool Watchdog_Arena_contains(const struct Watchdog_Arena *const self, const void *const memory) {
+    assert(NULL != self);
+    return (const char *) memory >= self->begin && (const char *) memory < self->end;
+}
+
+struct Watchdog_Allocator Watchdog_newSlabAllocator(void) {
+    struct Watchdog_Slab *self = calloc(1, sizeof(*self));
+    if (NULL == self) {
+        Panic_terminate("Out of memory");
+    }
+    for (size_t i = 0; i < WATCHDOG_SLAB_CLASSES_COUNT; i++) {
+        pthread_mutex_init(&self->classes[i].mutex, NULL);
+    }
+    return (struct Watchdog_Allocator) {
+            .context=self, .allocate=Watchdog_Slab_allocate, .allocateZeroed=Watchdog_Slab_allocateZeroed,
+            .reallocate=Watchdog_Slab_reallocate, .allocateAligned=Watchdog_Slab_allocateAligned,
+            .release=Watchdog_Slab_release
+    };
+}
+
+void *Watchdog_Slab_allocate(void *const self, const size_t size) {
+    struct Watchdog_Slab *slab = self;
+    assert(NULL != slab);
+    struct Watchdog_SlabHeader *header;
+    const uint32_t sizeClass = Watchdog_Slab_getClass(size);
+
+    if (WATCHDOG_SLAB_LARGE == sizeClass) {
+        if (size > SIZE_MAX - sizeof(*header)) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        header = malloc(sizeof(*header) + size);
+        if (NULL == header) {
+            return NULL;
+        }
+        *header = (struct Watchdog_SlabHeader) {.size=size, .sizeClass=sizeClass, .offset=0};
+        return header + 1;
+    }
+
+    struct Watchdog_SlabClass *slabClass = &slab->classes[sizeClass];
+    const size_t chunk = sizeof(*header) + Watchdog_Slab_getClassSize(sizeClass);
+    pthread_mutex_lock(&slabClass->mutex);
+    if (NULL != slabClass->freeList) {
+        header = (struct Watchdog_SlabHeader *) slabClass->freeList - 1;
+        slabClass->freeList = *(void **) slabClass->freeList;
+    } else {
+        if (NULL == slabClass->next || (size_t) (slabClass->limit - slabClass->next) < chunk) {
+            // the tail of the previous slab, smaller than a chunk, is lost
+            slabClass->next = malloc(WATCHDOG_SLAB_SIZE);
+            if (NULL == slabClass->next) {
+                pthread_mutex_unlock(&slabClass->mutex);
+                return NULL;
+            }
+            slabClass->limit = slabClass->next + WATCHDOG_SLAB_SIZE;
+        }
+        header = (struct Watchdog_SlabHeader *) slabClass->next;
+        slabClass->next += chunk;
+    }
+    pthread_mutex_unlock(&slabClass->mutex);
+    *header = (struct Watchdog_SlabHeader) {.size=size, .sizeClass=sizeClass, .offset=0};
+    return header + 1;
+}
+
+void *Watchdog_Slab_allocateZeroed(void *const self, const size_t numberOfMembers, const size_t memberSize) {
+    size_t size;
+    if (__builtin_mul_overflow(numberOfMembers, memberSize, &size)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    void *address = Watchdog_Slab_allocate(self, size);
+    if (NULL != address) {
+        memset(address, 0, size);
+    }
+    return address;
+}
+
+void *Watchdog_Slab_reallocate(void *const self, void *const memory, const size_t newSize) {
+    assert(NULL != self);
+    if (NULL == memory) {
+        return Watchdog_Slab_allocate(self, newSize);
+    }
+    struct Watchdog_SlabHeader *header = (struct Watchdog_SlabHeader *) memory - 1;
+    if (WATCHDOG_SLAB_LARGE != header->sizeClass && Watchdog_Slab_getClass(newSize) == header->sizeClass) {
+        header->size = newSize;
+        return memory;
+    }
+    void *address = Watchdog_Slab_allocate(self, newSize);
+    if (NULL != address) {
+        memcpy(address, memory, (header->size < newSize) ? header->size : newSize);
+        Watchdog_Slab_release(self, memory);
+    }
+    return address;
+}
+
+void *Watchdog_Slab_allocateAligned(void *const self, const size_t alignment, const size_t size) {
+    assert(NULL != self);
+    if (alignment <= WATCHDOG_ALLOCATOR_ALIGNMENT) {
+        return Watchdog_Slab_allocate(self, size);
+    }
+    if (0 != (alignment & (alignment - 1)) || alignment > UINT32_MAX) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (size > SIZE_MAX - 2 * alignment) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    // the block starts an alignment past the underlying one, so that the header fits right before it
+    char *base = aligned_alloc(alignment, alignment + ((size + alignment - 1) & ~(alignment - 1)));
+    if (NULL == base) {
+        return NULL;
+    }
+    struct Watchdog_SlabHeader *header = (struct Watchdog_SlabHeader *) (base + alignment) - 1;
+    *header = (struct Watchdog_SlabHeader) {
+            .size=size, .sizeClass=WATCHDOG_SLAB_LARGE, .offset=(uint32_t) (alignment - sizeof(*header))
+    };
+    return base + alignment;
+}
+
+void Watchdog_Slab_release(void *const self, void *const memory) {
+    struct Watchdog_Slab *slab = self;
+    assert(NULL != slab);
+    if (NULL == memory) {
+        return;
+    }
+    struct Watchdog_SlabHeader *header = (struct Watchdog_SlabHeader *) memory - 1;
+    if (WATCHDOG_SLAB_LARGE == header->sizeClass) {
+        free((char *) header - header->offset);
+        return;
+    }
+    struct Watchdog_SlabClass *slabClass = &slab->classes[header->sizeClass];
+    pthread_mutex_lock(&slabClass->mutex);
+    *(void **) memory = slabClass->freeList;
+    slabClass->freeList = memory;
+    pthread_mutex_unlock(&slabClass->mutex);
+}
+
+uint32_t Watchdog_Slab_getClass(const size_t size) {
+    if (size <= 128) {
+        return (0 == size) ? 0 : (uint32_t) ((size + 15) / 16 - 1);
+    }
+    if (size > WATCHDOG_SLAB_MAX_SIZE) {
+        return WATCHDOG_SLAB_LARGE;
+    }
+    // 4 classes per power of 2: (2^e, 2^e + 2^(e-2)], ... (2^e + 3 * 2^(e-2), 2^(e+1)]
+    const unsigned exponent = 63u - (unsigned) __builtin_clzll((unsigned long long) size - 1);
+    const size_t step = (size_t) 1 << (exponent - 2);
+    return (uint32_t) (8 + 4 * (exponent - 7) + (size - ((size_t) 1 << exponent) + step - 1) / step - 1);
+}
+
+size_t Watchdog_Slab_getClassSize(const uint32_t sizeClass) {
+    if (sizeClass < 8) {
+        return 16 * ((size_t) sizeClass + 1);
+    }
+    const unsigned exponent = 7 + (sizeClass - 8) / 4;
+    return ((size_t) 1 << exponent) + ((sizeClass - 8) % 4 + 1) * ((size_t) 1 << (exponent - 2));
+}
+
+/*
+ * Shared counters
+ */
+void Watchdog_shareCounters(void) {
+    pthread_once(&gInitializeOnce, Watchdog_initialize);
+    pthread_once(&gCountersOnce, Watchdog_Counters_create);
+}
+
+void Watchdog_Counters_create(void) {
+    char name[32] = "";
+    const int PID = Process_getCurrentId();
+    snprintf(name, sizeof(name), WATCHDOG_COUNTERS_NAME_FORMAT, PID);
+    shm_unlink(name);   // left by a dead process with the same id
+
+    void *memory = MAP_FAILED;
+    const int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd >= 0) {
+        if (0 == ftruncate(fd, sizeof(*gCounters))) {
+            memory = mmap(NULL, sizeof(*gCounters), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+    }
+    if (MAP_FAILED == memory) {
+        shm_unlink(name);
+        Panic_terminate("Unable to share counters: %s", name);
+    }
+
+    gCounters = memory;
+    gCounters->rootPID = PID;
+    gCountersOwnerId = PID;
+    atomic_store_explicit(&gCounterProcess, Watchdog_Counters_register(false), memory_order_relaxed);
+    atomic_store_explicit(&gCounters->magic, WATCHDOG_COUNTERS_MAGIC, memory_order_release);
+}
+
+struct Watchdog_CounterProcess *Watchdog_Counters_register(const bool isChild) {
+    struct Watchdog_CounterProcess *process = NULL;
+    const int PID = Process_getCurrentId();
+
+    // free slots first, then the ones of dead processes
+    for (size_t i = 0; i < WATCHDOG_COUNTERS_PROCESSES && NULL == process; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&gCounters->processes[i].PID, &expected, PID)) {
+            process = &gCounters->processes[i];
+        }
+    }
+    for (size_t i = 0; i < WATCHDOG_COUNTERS_PROCESSES && NULL == process; i++) {
+        int expected = atomic_load(&gCounters->processes[i].PID);
+        if (0 != expected && 0 != kill(expected, 0) && ESRCH == errno &&
+            atomic_compare_exchange_strong(&gCounters->processes[i].PID, &expected, PID)) {
+            process = &gCounters->processes[i];
+        }
+    }
+    for (size_t i = 0; i < WATCHDOG_SITES_CAPACITY; i++) {
+        atomic_store_explicit(&gSites[i].counter, NULL, memory_order_relaxed);
+    }
+    if (NULL == process) {
+        return NULL;
+    }
+
+    process->parentPID = Process_getParentId();
+    Watchdog_Counters_initSite(&process->sites[0], "(other sites)", "", 0, 0);
+    atomic_store_explicit(&process->sitesLength, 1, memory_order_release);
+
+    // a child inherits the live blocks of its parent, but not its history
+    for (size_t i = 0; i < WATCHDOG_SITES_CAPACITY; i++) {
+        struct Watchdog_Site *site = &gSites[i];
+        const long long liveBlocks = (long long) atomic_load_explicit(&site->liveBlocks, memory_order_relaxed);
+        if (atomic_load_explicit(&site->isUsed, memory_order_acquire) && 0 != liveBlocks) {
+            struct Watchdog_CounterSite *counter = Watchdog_Counters_getSite(process, site);
+            atomic_fetch_add_explicit(&counter->liveBytes,
+                                      (long long) atomic_load_explicit(&site->liveBytes, memory_order_relaxed),
+                                      memory_order_relaxed);
+            atomic_fetch_add_explicit(&counter->liveBlocks, liveBlocks, memory_order_relaxed);
+            if (!isChild) {
+                atomic_fetch_add_explicit(&counter->allocatedBytes,
+                                          atomic_load_explicit(&site->allocatedBytes, memory_order_relaxed),
+                                          memory_order_relaxed);
+                atomic_fetch_add_explicit(&counter->allocations,
+                                          atomic_load_explicit(&site->allocations, memory_order_relaxed),
+                                          memory_order_relaxed);
+            }
+        }
+    }
+    return process;
+}
+
+struct Watchdog_CounterSite *Watchdog_Counters_getSite(struct Watchdog_CounterProcess *const process,
+                                                        struct Watchdog_Site *const site) {
+    assert(NULL != process);
+    assert(NULL != site);
+    pthread_mutex_lock(&gCountersMutex);
+    struct Watchdog_CounterSite *counter = atomic_load_explicit(&site->counter, memory_order_relaxed);
+    if (NULL == counter) {
+        const size_t length = atomic_load_explicit(&process->sitesLength, memory_order_relaxed);
+        if (length < WATCHDOG_COUNTERS_SITES) {
+            counter = &process->sites[length];
+            Watchdog_Counters_initSite(counter, site->file, site->func, site->line, site->module);
+            atomic_store_explicit(&process->sitesLength, length + 1, memory_order_release);
+        } else {
+            counter = &process->sites[0];
+        }
+        atomic_store_explicit(&site->counter, counter, memory_order_release);
+    }
+    pthread_mutex_unlock(&gCountersMutex);
+    return counter;
+}
+
+void Watchdog_Counters_add(struct Watchdog_CounterProcess *const process, struct Watchdog_Site *const site,
+                           const long long bytes, const long long blocks) {
+    assert(NULL != process);
+    assert(NULL != site);
+    struct Watchdog_CounterSite *counter = atomic_load_explicit(&site->counter, memory_order_acquire);
+    if (NULL == counter) {
+        counter = Watchdog_Counters_getSite(process, site);
+    }
+    atomic_fetch_add_explicit(&counter->liveBytes, bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&counter->liveBlocks, blocks, memory_order_relaxed);
+    if (blocks > 0) {
+        atomic_fetch_add_explicit(&counter->allocatedBytes, (unsigned long long) bytes, memory_order_relaxed);
+        atomic_fetch_add_explicit(&counter->allocations, 1, memory_order_relaxed);
+    }
+}
+
+void Watchdog_Counters_release(void) {
+    struct Watchdog_CounterProcess *process = atomic_exchange(&gCounterProcess, NULL);
+    if (NULL != process) {
+        atomic_store(&process->PID, 0);
+    }
+    if (Process_getCurrentId() == gCountersOwnerId) {
+        char name[32] = "";
+        snprintf(name, sizeof(name), WATCHDOG_COUNTERS_NAME_FORMAT, gCountersOwnerId);
+        shm_unlink(name);   // processes still running keep their mapping
+    }
+}
+
+void Watchdog_Counters_initSite(struct Watchdog_CounterSite *const self, const char *const file,
+                                const char *const func, const int line, const int module) {
+    assert(NULL != self);
+    assert(NULL != file);
     assert(NULL != func);
-    assert(NULL != address);
+    // long paths keep their tail, which tells most about the file
+    const size_t length = strlen(file);
+    const size_t offset = (length < sizeof(self->file)) ? 0 : length - (sizeof(self->file) - 1);
+    snprintf(self->file, sizeof(self->file), "%s", file + offset);
+    snprintf(self->func, sizeof(self->func), "%s", func);
+    self->line = line;
+    self->module = module;
+    atomic_store_explicit(&self->liveBytes, 0, memory_order_relaxed);
+    atomic_store_explicit(&self->liveBlocks, 0, memory_order_relaxed);
+    atomic_store_explicit(&self->allocatedBytes, 0, memory_order_relaxed);
+    atomic_store_explicit(&self->allocations, 0, memory_order_relaxed);
+}
+
+/*
+ * Cross-thread frees
+ */
+static size_t Watchdog_CrossThreadFree_hash(const struct Watchdog_Site *site, long allocatedBy, long freedBy)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+void Watchdog_recordCrossThreadFree(const struct Watchdog_Block *const block, const long allocatedBy,
+                                    const long freedBy) {
+    assert(NULL != block);
+    pthread_mutex_lock(&gCrossThreadFreesMutex);
+
+    if (2 * (gCrossThreadFreesLength + 1) > gCrossThreadFreesCapacity) {
+        struct Watchdog_CrossThreadFree *entries = gCrossThreadFrees;
+        const size_t capacity = gCrossThreadFreesCapacity;
+        gCrossThreadFreesCapacity = (0 == capacity) ? 64 : 2 * capacity;
+        gCrossThreadFrees = calloc(gCrossThreadFreesCapacity, sizeof(gCrossThreadFrees[0]));
+        if (NULL == gCrossThreadFrees) {
+            Panic_terminate("Out of memory");
+        }
+        atomic_fetch_add_explicit(&gFootprint, (gCrossThreadFreesCapacity - capacity) * sizeof(gCrossThreadFrees[0]),
+                                  memory_order_relaxed);
+        for (size_t i = 0; i < capacity; i++) {
+            if (NULL != entries[i].site) {
+                const size_t mask = gCrossThreadFreesCapacity - 1;
+                size_t j = Watchdog_CrossThreadFree_hash(entries[i].site, entries[i].allocatedBy,
+                                                         entries[i].freedBy) & mask;
+                while (NULL != gCrossThreadFrees[j].site) {
+                    j = (j + 1) & mask;
+                }
+                gCrossThreadFrees[j] = entries[i];
+            }
+        }
+        free(entries);
+    }
+
+    const size_t mask = gCrossThreadFreesCapacity - 1;
+    size_t i = Watchdog_CrossThreadFree_hash(block->site, allocatedBy, freedBy) & mask;
+    struct Watchdog_CrossThreadFree *entry = &gCrossThreadFrees[i];
+    while (NULL != entry->site &&
+           !(entry->site == block->site && entry->allocatedBy == allocatedBy && entry->freedBy == freedBy)) {
+        i = (i + 1) & mask;
+        entry = &gCrossThreadFrees[i];
+    }
+    if (NULL == entry->site) {
+        entry->site = block->site;
+        entry->allocatedBy = allocatedBy;
+        entry->freedBy = freedBy;
+        gCrossThreadFreesLength += 1;
+    }
+    entry->frees += 1;
+    entry->freedBytes += block->size;
+
+    pthread_mutex_unlock(&gCrossThreadFreesMutex);
+}
+
+long Watchdog_getOwner(const struct Watchdog_Block *const block) {
+    assert(NULL != block);
+    long owner = block->threadId;
+    for (size_t i = 0; i < gInheritancesLength; i++) {
+        if (gInheritances[i].parentId == owner) {
+            owner = gInheritances[i].childId;
+        }
+    }
+    return owner;
+}
+
+size_t Watchdog_CrossThreadFree_hash(const struct Watchdog_Site *const site, const long allocatedBy,
+                                     const long freedBy) {
+    assert(NULL != site);
+    return Watchdog_hash((uintptr_t) site ^ ((uintptr_t) allocatedBy << 24) ^ (uintptr_t) freedBy);
+}
+
+/*
+ * Tickers
+ */
+void Watchdog_Ticker_init(struct Watchdog_Ticker *const self) {
+    assert(NULL != self);
+    pthread_condattr_t attributes;
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&self->condition, &attributes);
+    pthread_condattr_destroy(&attributes);
+}
+
+void Watchdog_Ticker_start(struct Watchdog_Ticker *const self, const unsigned milliseconds) {
+    assert(NULL != self);
+    assert(milliseconds > 0);
+    Watchdog_Ticker_stop(self);
+    pthread_mutex_lock(&self->mutex);
+    self->interval = milliseconds;
+    self->isRunning = true;
+    if (0 != pthread_create(&self->thread, NULL, Watchdog_Ticker_run, self)) {
+        Panic_terminate("Unable to start a ticker thread");
+    }
+    pthread_mutex_unlock(&self->mutex);
+}
+
+bool Watchdog_Ticker_stop(struct Watchdog_Ticker *const self) {
+    assert(NULL != self);
+    pthread_mutex_lock(&self->mutex);
+    const bool wasRunning = self->isRunning;
+    self->isRunning = false;
+    pthread_cond_signal(&self->condition);
+    pthread_mutex_unlock(&self->mutex);
+    if (wasRunning) {
+        pthread_join(self->thread, NULL);
+    }
+    return wasRunning;
+}
+
+void *Watchdog_Ticker_run(void *const arg) {
+    assert(NULL != arg);
+    struct Watchdog_Ticker *const self = arg;
+    struct timespec deadline;
+#ifdef __linux__
+    if (self->isLowPriority) {
+        // on Linux the nice value is per thread
+        setpriority(PRIO_PROCESS, (id_t) syscall(SYS_gettid), 19);
+    }
+#endif
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    pthread_mutex_lock(&self->mutex);
+    while (self->isRunning) {
+        pthread_mutex_unlock(&self->mutex);
+        self->task();
+        pthread_mutex_lock(&self->mutex);
+
+        // keep a fixed rate regardless of the time spent in the task
+        deadline.tv_sec += self->interval / 1000;
+        deadline.tv_nsec += (long) (self->interval % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (self->isRunning && 0 == pthread_cond_timedwait(&self->condition, &self->mutex, &deadline)) {}
+    }
+    pthread_mutex_unlock(&self->mutex);
+    return NULL;
+}
+
+/*
+ * Sampler
+ */
+void Watchdog_startSampler(const unsigned milliseconds) {
+    assert(milliseconds > 0);
+    pthread_once(&gInitializeOnce, Watchdog_initialize);
+    Watchdog_Ticker_start(&gSampler, milliseconds);
+}
+
+void Watchdog_stopSampler(void) {
+    Watchdog_Ticker_stop(&gSampler);
+}
+
+void Watchdog_sample(void) {
+    pthread_once(&gInitializeOnce, Watchdog_initialize);
+    Watchdog_Sampler_sample();
+}
+
+void Watchdog_Sampler_sample(void) {
+    size_t liveBytes, liveBlocks;
+    unsigned long virtualPages = 0, residentPages = 0, sharedPages = 0;
+    const long PID = Process_getCurrentId(), parentPID = Process_getParentId(), timestamp = time(NULL);
+    const unsigned long pageSize = (unsigned long) sysconf(_SC_PAGESIZE);
+
+#ifdef __linux__
+    char buffer[128] = "";
+    const int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        const ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+        if (length > 0) {
+            buffer[length] = '\0';
+            sscanf(buffer, "%lu %lu %lu", &virtualPages, &residentPages, &sharedPages);
+        }
+        close(fd);
+    }
+#endif
+
+    Watchdog_getLiveTotals(&liveBytes, &liveBlocks);
+
+#if WATCHDOG_HAS_MALLINFO2
+    const struct mallinfo2 info = mallinfo2();
+    Watchdog_writef(
+            "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"sample\", \"virtualBytes\": %lu, \"residentBytes\": %lu, \"sharedBytes\": %lu, \"arenaBytes\": %zu, \"mappedBytes\": %zu, \"inUseBytes\": %zu, \"freeBytes\": %zu, \"releasableBytes\": %zu, \"liveBytes\": %zu, \"liveBlocks\": %zu, \"timestamp\": %lu}\n",
+            PID, parentPID, virtualPages * pageSize, residentPages * pageSize, sharedPages * pageSize,
+            info.arena, info.hblkhd, info.uordblks + info.hblkhd, info.fordblks, info.keepcost,
+            liveBytes, liveBlocks, timestamp);
+#else
+    Watchdog_writef(
+            "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"sample\", \"virtualBytes\": %lu, \"residentBytes\": %lu, \"sharedBytes\": %lu, \"liveBytes\": %zu, \"liveBlocks\": %zu, \"timestamp\": %lu}\n",
+            PID, parentPID, virtualPages * pageSize, residentPages * pageSize, sharedPages * pageSize,
+            liveBytes, liveBlocks, timestamp);
+#endif
+    Watchdog_Stats_write();
+}
+
+/*
+ * Snapshots
+ */
+void Watchdog_startSnapshots(const unsigned milliseconds) {
+    assert(milliseconds > 0);
+    pthread_once(&gInitializeOnce, Watchdog_initialize);
+    Watchdog_Ticker_start(&gSnapshotter, milliseconds);
+}
+
+void Watchdog_stopSnapshots(void) {
+    Watchdog_Ticker_stop(&gSnapshotter);
+}
+
+void Watchdog_snapshot(void) {
+    pthread_once(&gInitializeOnce, Watchdog_initialize);
+    Watchdog_Snapshot_take();
+}
+
+void Watchdog_Snapshot_take(void) {
+    const long PID = Process_getCurrentId(), parentPID = Process_getParentId(), timestamp = time(NULL);
+    const unsigned long long id = atomic_fetch_add(&gSnapshots, 1);
+    size_t sites = 0, tags = 0, liveBytes = 0, liveBlocks = 0, length = 0;
+    char batch[16384], record[1024];
+
+    // site records are batched, so that a snapshot costs a few writes only
+    for (size_t i = 0; i <= WATCHDOG_SITES_CAPACITY; i++) {
+        const struct Watchdog_Site *site = (i < WATCHDOG_SITES_CAPACITY) ? &gSites[i] : &gOverflowSite;
+        if (!atomic_load_explicit(&site->isUsed, memory_order_acquire)) {
+            continue;
+        }
+        const size_t bytes = atomic_load_explicit(&site->liveBytes, memory_order_relaxed);
+        const size_t blocks = atomic_load_explicit(&site->liveBlocks, memory_order_relaxed);
+        const size_t allocatedBytes = atomic_load_explicit(&site->allocatedBytes, memory_order_relaxed);
+        const size_t allocations = atomic_load_explicit(&site->allocations, memory_order_relaxed);
+        if (0 == allocations) {
+            continue;
+        }
+        const int written = snprintf(
+                record, sizeof(record),
+                "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"snapshotSite\", \"snapshot\": %llu, \"file\": \"%s\", \"func\": \"%s\", \"line\": %d, \"liveBytes\": %zu, \"liveBlocks\": %zu, \"allocatedBytes\": %zu, \"allocations\": %zu}\n",
+                PID, parentPID, id, site->file, site->func, site->line, bytes, blocks,
+                allocatedBytes, allocations);
+        if (written < 0) {
+            continue;
+        }
+        if (length > 0 && ((size_t) written >= sizeof(batch) - length || (size_t) written >= sizeof(record))) {
+            Watchdog_write(batch, length);
+            length = 0;
+        }
+        if ((size_t) written < sizeof(record)) {
+            memcpy(batch + length, record, (size_t) written);
+            length += (size_t) written;
+        } else {
+            // truncated, sites with huge names are written on their own
+            Watchdog_writef(
+                    "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"snapshotSite\", \"snapshot\": %llu, \"file\": \"%s\", \"func\": \"%s\", \"line\": %d, \"liveBytes\": %zu, \"liveBlocks\": %zu, \"allocatedBytes\": %zu, \"allocations\": %zu}\n",
+                    PID, parentPID, id, site->file, site->func, site->line, bytes, blocks,
+                    allocatedBytes, allocations);
+        }
+        sites += 1;
+        liveBytes += bytes;
+        liveBlocks += blocks;
+    }
+    // every block has a single tag, so the tagged totals never exceed the ones of sites
+    for (size_t i = 0; i <= WATCHDOG_TAGS_CAPACITY; i++) {
+        const struct Watchdog_Tag *tag = (i < WATCHDOG_TAGS_CAPACITY) ? &gTags[i] : &gOverflowTag;
+        if (!atomic_load_explicit(&tag->isUsed, memory_order_acquire) ||
+            0 == atomic_load_explicit(&tag->allocations, memory_order_relaxed)) {
+            continue;
+        }
+        const int written = snprintf(
+                record, sizeof(record),
+                "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"snapshotTag\", \"snapshot\": %llu, \"tag\": %" PRIu32 ", \"name\": \"%s\", \"liveBytes\": %zu, \"liveBlocks\": %zu, \"allocatedBytes\": %zu, \"allocations\": %zu}\n",
+                PID, parentPID, id, tag->id, tag->escapedName,
+                atomic_load_explicit(&tag->liveBytes, memory_order_relaxed),
+                atomic_load_explicit(&tag->liveBlocks, memory_order_relaxed),
+                atomic_load_explicit(&tag->allocatedBytes, memory_order_relaxed),
+                atomic_load_explicit(&tag->allocations, memory_order_relaxed));
+        if (written < 0 || (size_t) written >= sizeof(record)) {
+            continue;   // names are bounded, records always fit
+        }
+        if ((size_t) written >= sizeof(batch) - length) {
+            Watchdog_write(batch, length);
+            length = 0;
+        }
+        memcpy(batch + length, record, (size_t) written);
+        length += (size_t) written;
+        tags += 1;
+    }
+    if (length > 0) {
+        Watchdog_write(batch, length);
+    }
+    Watchdog_writef(
+            "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"snapshot\", \"snapshot\": %llu, \"sites\": %zu, \"tags\": %zu, \"liveBytes\": %zu, \"liveBlocks\": %zu, \"timestamp\": %lu}\n",
+            PID, parentPID, id, sites, tags, liveBytes, liveBlocks, timestamp);
+}
+
+/*
+ * Leak checks
+ */
+#define WATCHDOG_LEAKS_CHUNK_SIZE   (1u << 16)  // of the copies of the stacks of other threads
+
+void Watchdog_checkLeaks(void) {
+    pthread_once(&gInitializeOnce, Watchdog_initialize);
+    // callee-saved registers of the callers may hold the only references to blocks, while the stack is scanned from
+    // the frame of the caller on, as slots of this frame may hold stale values
+    jmp_buf registers;
+    setjmp(registers);
+    Watchdog_Leaks_check((const jmp_buf *) &registers, (uintptr_t) __builtin_frame_address(0));
+}
+
+void Watchdog_checkLeaksAtExit(void) {
+    pthread_once(&gInitializeOnce, Watchdog_initialize);
+    atomic_store_explicit(&gIsCheckingLeaksAtExit, true, memory_order_relaxed);
+}
+
+#ifdef __linux__
+
+void Watchdog_Leaks_check(const jmp_buf *const registers, const uintptr_t stackLow) {
+    assert(NULL != registers);
+    struct Watchdog_LeakCheck check = {0};
+    struct Watchdog_LeakRange *stacks = NULL;
+    size_t stacksLength = 0;
+    const long long start = Watchdog_now();
+    struct Watchdog_Thread *current = Watchdog_getThread();
+
+    dl_iterate_phdr(Watchdog_Leaks_addObject, &check);
+    pthread_mutex_lock(&gThreadsMutex);
+    for (const struct Watchdog_Thread *thread = gThreads; NULL != thread; thread = thread->next) {
+        stacksLength += 1;
+    }
+    stacks = malloc((stacksLength + 1) * sizeof(stacks[0]));
+    char *buffer = malloc(WATCHDOG_LEAKS_CHUNK_SIZE);
+    if (NULL == stacks || NULL == buffer) {
+        Panic_terminate("Out of memory");
+    }
+    stacksLength = 0;
+    for (const struct Watchdog_Thread *thread = gThreads; NULL != thread; thread = thread->next) {
+        if (thread != current && atomic_load_explicit(&thread->isRunning, memory_order_relaxed) &&
+            thread->stackLow < thread->stackHigh) {
+            stacks[stacksLength++] = (struct Watchdog_LeakRange) {.low=thread->stackLow, .high=thread->stackHigh};
+        }
+    }
+    pthread_mutex_unlock(&gThreadsMutex);
+
+    for (size_t i = 0; i < WATCHDOG_SHARDS_COUNT; i++) {
+        pthread_mutex_lock(&gShards[i].mutex);
+    }
+    Watchdog_Leaks_collect(&check);
+
+    // reachable blocks first, starting from the roots
+    for (size_t i = 0; i < check.rangesLength; i++) {
+        Watchdog_Leaks_scan(&check, check.ranges[i].low, check.ranges[i].high, WATCHDOG_LEAK_REACHABLE, NULL);
+    }
+    const uintptr_t currentHigh = (current->stackLow < stackLow && stackLow < current->stackHigh) ?
+                                  current->stackHigh : stackLow;
+    Watchdog_Leaks_scan(&check, (uintptr_t) registers, (uintptr_t) (registers + 1), WATCHDOG_LEAK_REACHABLE, NULL);
+    Watchdog_Leaks_scan(&check, stackLow, currentHigh, WATCHDOG_LEAK_REACHABLE, NULL);
+    for (size_t i = 0; i < stacksLength; i++) {
+        Watchdog_Leaks_scanRemote(&check, stacks[i].low, stacks[i].high, buffer);
+    }
+    Watchdog_Leaks_drain(&check, WATCHDOG_LEAK_REACHABLE, NULL);
+
+    // then the unreached ones, marking those they reference as indirectly lost
+    for (size_t i = 0; i < check.length; i++) {
+        struct Watchdog_LeakBlock *block = &check.blocks[i];
+        if (WATCHDOG_LEAK_UNREACHED == block->state) {
+            block->state = WATCHDOG_LEAK_DEFINITE;
+            Watchdog_Leaks_scan(&check, block->address, block->address + block->size, WATCHDOG_LEAK_INDIRECT, block);
+            Watchdog_Leaks_drain(&check, WATCHDOG_LEAK_INDIRECT, block);
+        }
+    }
+    for (size_t i = WATCHDOG_SHARDS_COUNT; i > 0; i--) {
+        pthread_mutex_unlock(&gShards[i - 1].mutex);
+    }
+
+    Watchdog_Leaks_write(&check, Watchdog_now() - start);
+    free(check.blocks);
+    free(check.pending);
+    free(check.ranges);
+    free(stacks);
+    free(buffer);
+}
+
+int Watchdog_Leaks_addObject(struct dl_phdr_info *const info, const size_t size, void *const self) {
+    assert(NULL != info);
+    assert(NULL != self);
+    (void) size;
+    struct Watchdog_LeakCheck *check = self;
+    // the addresses of the blocks of the current chunk are not references
+    const uintptr_t chunkLow = (uintptr_t) &gChunk, chunkHigh = (uintptr_t) (&gChunk + 1);
+
+    for (size_t i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *header = &info->dlpi_phdr[i];
+        if (PT_LOAD != header->p_type || 0 == (header->p_flags & PF_W)) {
+            continue;
+        }
+        const uintptr_t low = info->dlpi_addr + header->p_vaddr, high = low + header->p_memsz;
+        const struct Watchdog_LeakRange parts[2] = {
+                {.low=low, .high=(low < chunkLow && chunkLow < high) ? chunkLow : high},
+                {.low=(low < chunkLow && chunkLow < high) ? chunkHigh : high, .high=high},
+        };
+        for (size_t j = 0; j < 2; j++) {
+            if (parts[j].low >= parts[j].high) {
+                continue;
+            }
+            if (check->rangesLength == check->rangesCapacity) {
+                const size_t capacity = (0 == check->rangesCapacity) ? 16 : 2 * check->rangesCapacity;
+                struct Watchdog_LeakRange *ranges = realloc(check->ranges, capacity * sizeof(ranges[0]));
+                if (NULL == ranges) {
+                    Panic_terminate("Out of memory");
+                }
+                check->ranges = ranges;
+                check->rangesCapacity = capacity;
+            }
+            check->ranges[check->rangesLength++] = parts[j];
+        }
+    }
+    return 0;
+}
+
+void Watchdog_Leaks_collect(struct Watchdog_LeakCheck *const self) {
+    assert(NULL != self);
+    size_t length = 0;
+    for (size_t i = 0; i < WATCHDOG_SHARDS_COUNT; i++) {
+        length += gShards[i].length;
+    }
+    self->blocks = malloc((length + 1) * sizeof(self->blocks[0]));
+    self->pending = malloc((length + 1) * sizeof(self->pending[0]));
+    if (NULL == self->blocks || NULL == self->pending) {
+        Panic_terminate("Out of memory");
+    }
+
+    for (size_t i = 0; i < WATCHDOG_SHARDS_COUNT; i++) {
+        const struct Watchdog_Shard *shard = &gShards[i];
+        for (size_t j = 0; j < shard->capacity && 0 < shard->length; j++) {
+            const struct Watchdog_Block *block = &shard->blocks[j];
+            if (0 != block->address) {
+                self->blocks[self->length++] = (struct Watchdog_LeakBlock) {
+                        .address=block->address, .size=block->size, .site=block->site,
+                        .state=WATCHDOG_LEAK_UNREACHED
+                };
+            }
+        }
+    }
+    qsort(self->blocks, self->length, sizeof(self->blocks[0]), Watchdog_Leaks_compare);
+    if (self->length > 0) {
+        const struct Watchdog_LeakBlock *last = &self->blocks[self->length - 1];
+        self->low = self->blocks[0].address;
+        self->high = last->address + ((0 < last->size) ? last->size : 1);
+    }
+}
+
+void Watchdog_Leaks_scan(struct Watchdog_LeakCheck *const self, uintptr_t from, const uintptr_t to,
+                         const enum Watchdog_LeakState state, const struct Watchdog_LeakBlock *const root) {
+    assert(NULL != self);
+    from = (from + sizeof(uintptr_t) - 1) & ~(uintptr_t) (sizeof(uintptr_t) - 1);
+    if (NULL == root) {
+        self->rootBytes += (to > from) ? to - from : 0;
+    }
+    for (; from + sizeof(uintptr_t) <= to; from += sizeof(uintptr_t)) {
+        const uintptr_t value = *(const uintptr_t *) from;
+        if (value < self->low || value >= self->high) {
+            continue;
+        }
+        // the last block starting at or before the value
+        size_t lower = 0, upper = self->length;
+        while (lower < upper) {
+            const size_t middle = lower + (upper - lower) / 2;
+            if (self->blocks[middle].address <= value) {
+                lower = middle + 1;
+            } else {
+                upper = middle;
+            }
+        }
+        if (0 == lower) {
+            continue;
+        }
+        struct Watchdog_LeakBlock *block = &self->blocks[lower - 1];
+        if (value != block->address && value - block->address >= block->size) {
+            continue;
+        }
+        if (WATCHDOG_LEAK_UNREACHED == block->state) {
+            block->state = state;
+            self->pending[self->pendingLength++] = (size_t) (block - self->blocks);
+        } else if (WATCHDOG_LEAK_DEFINITE == block->state && block != root) {
+            block->state = WATCHDOG_LEAK_INDIRECT;  // already scanned
+        }
+    }
+}
+
+void Watchdog_Leaks_scanRemote(struct Watchdog_LeakCheck *const self, const uintptr_t low, const uintptr_t high,
+                               char *const buffer) {
+    assert(NULL != self);
+    assert(NULL != buffer);
+    // stacks grow down, the bottom of the stack of the main thread may not be mapped yet
+    for (uintptr_t to = high; to > low;) {
+        const uintptr_t from = (to - low > WATCHDOG_LEAKS_CHUNK_SIZE) ? to - WATCHDOG_LEAKS_CHUNK_SIZE : low;
+        const struct iovec local = {.iov_base=buffer, .iov_len=to - from};
+        const struct iovec remote = {.iov_base=(void *) from, .iov_len=to - from};
+        if (process_vm_readv(Process_getCurrentId(), &local, 1, &remote, 1, 0) != (ssize_t) (to - from)) {
+            break;
+        }
+        Watchdog_Leaks_scan(self, (uintptr_t) buffer, (uintptr_t) buffer + (to - from), WATCHDOG_LEAK_REACHABLE,
+                            NULL);
+        to = from;
+    }
+}
+
+void Watchdog_Leaks_drain(struct Watchdog_LeakCheck *const self, const enum Watchdog_LeakState state,
+                          const struct Watchdog_LeakBlock *const root) {
+    assert(NULL != self);
+    while (self->pendingLength > 0) {
+        const struct Watchdog_LeakBlock *block = &self->blocks[self->pending[--self->pendingLength]];
+        Watchdog_Leaks_scan(self, block->address, block->address + block->size, state, (NULL == root) ? block : root);
+    }
+}
+
+#else
+
+void Watchdog_Leaks_check(const jmp_buf *const registers, const uintptr_t stackLow) {
+    (void) registers;
+    (void) stackLow;
+    Panic_terminate("Leak checks are supported only on Linux");
+}
+
+#endif
+
+void Watchdog_Leaks_write(const struct Watchdog_LeakCheck *const self, const long long duration) {
+    assert(NULL != self);
+    struct Watchdog_LeakSite {
+        size_t bytes[4];    // by state
+        size_t blocks[4];
+    } *sites = calloc(WATCHDOG_SITES_CAPACITY + 1, sizeof(*sites));
+    struct Watchdog_LeakSite totals = {{0}, {0}};
+    if (NULL == sites) {
+        Panic_terminate("Out of memory");
+    }
+
+    for (size_t i = 0; i < self->length; i++) {
+        const struct Watchdog_LeakBlock *block = &self->blocks[i];
+        const size_t index = (&gOverflowSite == block->site) ? WATCHDOG_SITES_CAPACITY :
+                             (size_t) (block->site - gSites);
+        sites[index].bytes[block->state] += block->size;
+        sites[index].blocks[block->state] += 1;
+        totals.bytes[block->state] += block->size;
+        totals.blocks[block->state] += 1;
+    }
+
+    const long PID = Process_getCurrentId(), parentPID = Process_getParentId();
+    const unsigned long long id = atomic_fetch_add(&gLeakChecks, 1);
+    for (size_t i = 0; i <= WATCHDOG_SITES_CAPACITY; i++) {
+        const struct Watchdog_Site *site = (i < WATCHDOG_SITES_CAPACITY) ? &gSites[i] : &gOverflowSite;
+        const struct Watchdog_LeakSite *entry = &sites[i];
+        if (0 == entry->blocks[WATCHDOG_LEAK_REACHABLE] + entry->blocks[WATCHDOG_LEAK_DEFINITE] +
+                 entry->blocks[WATCHDOG_LEAK_INDIRECT]) {
+            continue;
+        }
+        Watchdog_writef(
+                "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"leakSite\", \"check\": %llu, \"file\": \"%s\", \"func\": \"%s\", \"line\": %d, \"definitelyLostBytes\": %zu, \"definitelyLostBlocks\": %zu, \"indirectlyLostBytes\": %zu, \"indirectlyLostBlocks\": %zu, \"stillReachableBytes\": %zu, \"stillReachableBlocks\": %zu}\n",
+                PID, parentPID, id, site->file, site->func, site->line,
+                entry->bytes[WATCHDOG_LEAK_DEFINITE], entry->blocks[WATCHDOG_LEAK_DEFINITE],
+                entry->bytes[WATCHDOG_LEAK_INDIRECT], entry->blocks[WATCHDOG_LEAK_INDIRECT],
+                entry->bytes[WATCHDOG_LEAK_REACHABLE], entry->blocks[WATCHDOG_LEAK_REACHABLE]);
+    }
+    Watchdog_writef(
+            "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"leakCheck\", \"check\": %llu, \"blocks\": %zu, \"definitelyLostBytes\": %zu, \"definitelyLostBlocks\": %zu, \"indirectlyLostBytes\": %zu, \"indirectlyLostBlocks\": %zu, \"stillReachableBytes\": %zu, \"stillReachableBlocks\": %zu, \"rootBytes\": %zu, \"duration\": %lld, \"timestamp\": %lu}\n",
+            PID, parentPID, id, self->length,
+            totals.bytes[WATCHDOG_LEAK_DEFINITE], totals.blocks[WATCHDOG_LEAK_DEFINITE],
+            totals.bytes[WATCHDOG_LEAK_INDIRECT], totals.blocks[WATCHDOG_LEAK_INDIRECT],
+            totals.bytes[WATCHDOG_LEAK_REACHABLE], totals.blocks[WATCHDOG_LEAK_REACHABLE],
+            self->rootBytes, duration, time(NULL));
+    free(sites);
+}
+
+int Watchdog_Leaks_compare(const void *const a, const void *const b) {
+    assert(NULL != a);
+    assert(NULL != b);
+    const uintptr_t x = ((const struct Watchdog_LeakBlock *) a)->address;
+    const uintptr_t y = ((const struct Watchdog_LeakBlock *) b)->address;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Metrics
+ */
+void Watchdog_startMetrics(const char *const path, const unsigned milliseconds, const unsigned topSites) {
+    assert(NULL != path);
+    assert(milliseconds > 0);
+    pthread_once(&gInitializeOnce, Watchdog_initialize);
+    Watchdog_Ticker_stop(&gMetricsTicker);
+
+    const size_t length = strlen(path);
+    char *paths = realloc(gMetrics.path, 2 * length + sizeof(".tmp") + 1);
+    size_t *lastSiteAllocations = (NULL != gMetrics.lastSiteAllocations) ? gMetrics.lastSiteAllocations :
+                                  malloc((WATCHDOG_SITES_CAPACITY + 1) * sizeof(lastSiteAllocations[0]));
+    if (NULL == paths || NULL == lastSiteAllocations) {
+        Panic_terminate("Out of memory");
+    }
+    if (NULL == gMetrics.lastSiteAllocations) {
+        atomic_fetch_add_explicit(&gFootprint, (WATCHDOG_SITES_CAPACITY + 1) * sizeof(lastSiteAllocations[0]),
+                                  memory_order_relaxed);
+    }
+    // the temporary file lives aside, in the same directory, as rename does not cross file systems
+    memcpy(paths, path, length + 1);
+    memcpy(paths + length + 1, path, length);
+    memcpy(paths + 2 * length + 1, ".tmp", sizeof(".tmp"));
+
+    // rates are computed from now on
+    gMetrics = (struct Watchdog_Metrics) {
+            .path=paths, .temporaryPath=paths + length + 1,
+            .topSites=(topSites < WATCHDOG_METRICS_MAX_TOP_SITES) ? topSites : WATCHDOG_METRICS_MAX_TOP_SITES,
+            .lastClock=Watchdog_now(), .lastSiteAllocations=lastSiteAllocations
+    };
+    for (const struct Watchdog_Thread *thread = atomic_load_explicit(&gThreads, memory_order_acquire);
+         NULL != thread; thread = thread->next) {
+        gMetrics.lastAllocations += atomic_load_explicit(&thread->allocations, memory_order_relaxed);
+        gMetrics.lastFrees += atomic_load_explicit(&thread->frees, memory_order_relaxed);
+    }
+    for (size_t i = 0; i <= WATCHDOG_SITES_CAPACITY; i++) {
+        const struct Watchdog_Site *site = (i < WATCHDOG_SITES_CAPACITY) ? &gSites[i] : &gOverflowSite;
+        lastSiteAllocations[i] = atomic_load_explicit(&site->allocations, memory_order_relaxed);
+    }
+    Watchdog_Ticker_start(&gMetricsTicker, milliseconds);
+}
+
+void Watchdog_stopMetrics(void) {
+    Watchdog_Ticker_stop(&gMetricsTicker);
+}
+
+void Watchdog_Metrics_write(void) {
+    struct Watchdog_Metrics *const self = &gMetrics;
+    const struct Watchdog_Site *liveSites[WATCHDOG_METRICS_MAX_TOP_SITES], *rateSites[WATCHDOG_METRICS_MAX_TOP_SITES];
+    double liveValues[WATCHDOG_METRICS_MAX_TOP_SITES], rateValues[WATCHDOG_METRICS_MAX_TOP_SITES];
+    size_t liveBytes, liveBlocks, allocations = 0, allocatedBytes = 0, frees = 0, freedBytes = 0, rateCount = 0;
+
+    const long long now = Watchdog_now();
+    const double seconds = (double) (now - self->lastClock) / 1e9;
+    Watchdog_getLiveTotals(&liveBytes, &liveBlocks);
+    for (const struct Watchdog_Thread *thread = atomic_load_explicit(&gThreads, memory_order_acquire);
+         NULL != thread; thread = thread->next) {
+        allocations += atomic_load_explicit(&thread->allocations, memory_order_relaxed);
+        allocatedBytes += atomic_load_explicit(&thread->allocatedBytes, memory_order_relaxed);
+        frees += atomic_load_explicit(&thread->frees, memory_order_relaxed);
+        freedBytes += atomic_load_explicit(&thread->freedBytes, memory_order_relaxed);
+    }
+    size_t peak = atomic_load_explicit(&gPeakBytes, memory_order_relaxed);
+    while (liveBytes > peak &&
+           !atomic_compare_exchange_weak_explicit(&gPeakBytes, &peak, liveBytes,
+                                                  memory_order_relaxed, memory_order_relaxed)) {}
+
+    const size_t liveCount = Watchdog_collectTopSites(liveSites, self->topSites, -1);
+    for (size_t i = 0; i < liveCount; i++) {
+        liveValues[i] = (double) atomic_load_explicit(&liveSites[i]->liveBytes, memory_order_relaxed);
+    }
+    // insertion sort on a tiny array, sites are ranked by allocations since the previous file
+    for (size_t i = 0; i <= WATCHDOG_SITES_CAPACITY; i++) {
+        const struct Watchdog_Site *site = (i < WATCHDOG_SITES_CAPACITY) ? &gSites[i] : &gOverflowSite;
+        const size_t siteAllocations = atomic_load_explicit(&site->allocations, memory_order_relaxed);
+        const double rate = (seconds > 0) ? (double) (siteAllocations - self->lastSiteAllocations[i]) / seconds : 0;
+        self->lastSiteAllocations[i] = siteAllocations;
+        if (rate <= 0) {
+            continue;
+        }
+        size_t j = (rateCount < self->topSites) ? rateCount++ : self->topSites;
+        while (j > 0 && rateValues[j - 1] < rate) {
+            if (j < self->topSites) {
+                rateSites[j] = rateSites[j - 1];
+                rateValues[j] = rateValues[j - 1];
+            }
+            j--;
+        }
+        if (j < self->topSites) {
+            rateSites[j] = site;
+            rateValues[j] = rate;
+        }
+    }
+
+    // on failure the previous file is left in place, the next interval tries again
+    FILE *stream = fopen(self->temporaryPath, "w");
+    if (NULL == stream) {
+        return;
+    }
+    fprintf(stream,
+            "# HELP watchdog_live_bytes Bytes held by live traced blocks.\n"
+            "# TYPE watchdog_live_bytes gauge\n"
+            "watchdog_live_bytes %zu\n"
+            "# HELP watchdog_live_blocks Live traced blocks.\n"
+            "# TYPE watchdog_live_blocks gauge\n"
+            "watchdog_live_blocks %zu\n"
+            "# HELP watchdog_peak_live_bytes Highest bytes held by live traced blocks, up to the batching of thread counters.\n"
+            "# TYPE watchdog_peak_live_bytes gauge\n"
+            "watchdog_peak_live_bytes %zu\n"
+            "# HELP watchdog_allocations_total Traced allocations.\n"
+            "# TYPE watchdog_allocations_total counter\n"
+            "watchdog_allocations_total %zu\n"
+            "# HELP watchdog_allocated_bytes_total Bytes of traced allocations.\n"
+            "# TYPE watchdog_allocated_bytes_total counter\n"
+            "watchdog_allocated_bytes_total %zu\n"
+            "# HELP watchdog_frees_total Traced frees of traced blocks.\n"
+            "# TYPE watchdog_frees_total counter\n"
+            "watchdog_frees_total %zu\n"
+            "# HELP watchdog_freed_bytes_total Bytes of traced frees of traced blocks.\n"
+            "# TYPE watchdog_freed_bytes_total counter\n"
+            "watchdog_freed_bytes_total %zu\n"
+            "# HELP watchdog_allocation_rate Traced allocations per second since the previous update.\n"
+            "# TYPE watchdog_allocation_rate gauge\n"
+            "watchdog_allocation_rate %.3f\n"
+            "# HELP watchdog_free_rate Traced frees per second since the previous update.\n"
+            "# TYPE watchdog_free_rate gauge\n"
+            "watchdog_free_rate %.3f\n",
+            liveBytes, liveBlocks, atomic_load_explicit(&gPeakBytes, memory_order_relaxed),
+            allocations, allocatedBytes, frees, freedBytes,
+            (seconds > 0) ? (double) (allocations - self->lastAllocations) / seconds : 0.0,
+            (seconds > 0) ? (double) (frees - self->lastFrees) / seconds : 0.0);
+    Watchdog_Metrics_writeSites(stream, "watchdog_site_live_bytes",
+                                "Bytes held by live traced blocks of the sites holding most of them.",
+                                liveSites, liveValues, liveCount);
+    Watchdog_Metrics_writeSites(stream, "watchdog_site_allocation_rate",
+                                "Traced allocations per second since the previous update of the busiest sites.",
+                                rateSites, rateValues, rateCount);
+    self->lastClock = now;
+    self->lastAllocations = allocations;
+    self->lastFrees = frees;
+
+    if (0 != fclose(stream) || 0 != rename(self->temporaryPath, self->path)) {
+        unlink(self->temporaryPath);
+    }
+}
+
+void Watchdog_Metrics_writeSites(FILE *const stream, const char *const name, const char *const help,
+                                 const struct Watchdog_Site *const *const sites, const double *const values,
+                                 const size_t count) {
+    assert(NULL != stream);
+    assert(NULL != name);
+    assert(NULL != help);
+    fprintf(stream, "# HELP %s %s\n# TYPE %s gauge\n", name, help, name);
+    for (size_t i = 0; i < count; i++) {
+        char line[16];
+        snprintf(line, sizeof(line), "%d", sites[i]->line);
+        fprintf(stream, "%s{", name);
+        Watchdog_Metrics_putLabel(stream, "file", sites[i]->file);
+        fputc(',', stream);
+        Watchdog_Metrics_putLabel(stream, "func", sites[i]->func);
+        fputc(',', stream);
+        Watchdog_Metrics_putLabel(stream, "line", line);
+        fprintf(stream, "} %.15g\n", values[i]);
+    }
+}
+
+void Watchdog_Metrics_putLabel(FILE *const stream, const char *const name, const char *value) {
+    assert(NULL != stream);
+    assert(NULL != name);
+    assert(NULL != value);
+    fprintf(stream, "%s=\"", name);
+    for (; '\0' != *value; value++) {
+        if ('\\' == *value || '"' == *value) {
+            fputc('\\', stream);
+            fputc(*value, stream);
+        } else if ('\n' == *value) {
+            fputs("\\n", stream);
+        } else {
+            fputc(*value, stream);
+        }
+    }
+    fputc('"', stream);
+}
+
+/*
+ * Guards
+ */
+void Watchdog_enableGuards(const size_t quarantineBytes) {
+    if (atomic_load(&gHasAllocated)) {
+        Panic_terminate("Guards must be enabled before the first traced allocation");
+    }
+    pthread_mutex_lock(&gQuarantineMutex);
+    gQuarantine.maxBytes = quarantineBytes;
+    pthread_mutex_unlock(&gQuarantineMutex);
+    atomic_store(&gHasGuards, true);
+}
+
+void Watchdog_checkGuards(void) {
+    if (!atomic_load_explicit(&gHasGuards, memory_order_relaxed)) {
+        return;
+    }
+    size_t blocks = 0;
+    for (size_t i = 0; i < WATCHDOG_SHARDS_COUNT; i++) {
+        struct Watchdog_Shard *shard = &gShards[i];
+        pthread_mutex_lock(&shard->mutex);
+        for (size_t j = 0; j < shard->capacity; j++) {
+            if (0 != shard->blocks[j].address && 0 != shard->blocks[j].redzone) {
+                Watchdog_Guards_check(&shard->blocks[j], NULL);
+                blocks += 1;
+            }
+        }
+        pthread_mutex_unlock(&shard->mutex);
+    }
+
+    pthread_mutex_lock(&gQuarantineMutex);
+    const struct Watchdog_Quarantine *self = &gQuarantine;
+    for (size_t i = 0; i < self->length; i++) {
+        const struct Watchdog_Quarantined *entry = &self->entries[(self->head + i) & (self->capacity - 1)];
+        const size_t offset = Watchdog_Guards_find((const unsigned char *) entry->address, entry->size,
+                                                   WATCHDOG_GUARDS_POISON);
+        if (offset < entry->size) {
+            const struct Watchdog_Violation violation = {
+                    .kind="useAfterFree", .address=entry->address, .size=entry->size, .offset=(long long) offset,
+                    .site=&gOverflowSite, .allocationSite=entry->site, .freeSite=entry->freeSite
+            };
+            Watchdog_Guards_fail(&violation);
+        }
+    }
+    const size_t quarantinedBlocks = self->length, quarantinedBytes = self->bytes;
+    pthread_mutex_unlock(&gQuarantineMutex);
+
+    Watchdog_writef(
+            "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"guardCheck\", \"blocks\": %zu, \"quarantinedBlocks\": %zu, \"quarantinedBytes\": %zu}\n",
+            (long) Process_getCurrentId(), (long) Process_getParentId(), blocks, quarantinedBlocks, quarantinedBytes);
+}
+
+void *Watchdog_Guards_allocate(const struct Watchdog_Allocator *const self, const size_t alignment, const size_t size,
+                               const bool isZeroed, uint32_t *const redzone) {
+    assert(NULL != self);
+    assert(NULL != redzone);
+    const size_t front = (alignment > WATCHDOG_GUARDS_REDZONE) ? alignment : WATCHDOG_GUARDS_REDZONE;
+    if (front > UINT32_MAX || size > SIZE_MAX - 3 * front) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    const size_t tail = Watchdog_Guards_getTail((uint32_t) front, size);
+    const size_t total = front + size + tail;
+    unsigned char *base = (0 != alignment) ? Watchdog_Allocator_allocateAligned(self, alignment, total) :
+                          isZeroed ? Watchdog_Allocator_allocateZeroed(self, 1, total) :
+                          Watchdog_Allocator_allocate(self, total);
+    if (NULL == base) {
+        return NULL;
+    }
+    memset(base, WATCHDOG_GUARDS_CANARY, front);
+    memset(base + front + size, WATCHDOG_GUARDS_CANARY, tail);
+    *redzone = (uint32_t) front;
+    return base + front;
+}
+
+size_t Watchdog_Guards_getTail(const uint32_t redzone, const size_t size) {
+    const size_t end = redzone + size + WATCHDOG_GUARDS_REDZONE;
+    return (end + redzone - 1) / redzone * redzone - redzone - size;
+}
+
+size_t Watchdog_Guards_find(const unsigned char *const bytes, const size_t size, const unsigned char value) {
+    assert(NULL != bytes);
+    // a word at a time, blocks are as large as the quarantine allows
+    uint64_t pattern;
+    memset(&pattern, value, sizeof(pattern));
+    size_t i = 0;
+    for (; i + sizeof(pattern) <= size; i += sizeof(pattern)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        if (word != pattern) {
+            break;
+        }
+    }
+    for (; i < size && bytes[i] == value; i++);
+    return i;
+}
+
+void Watchdog_Guards_check(const struct Watchdog_Block *const block, const struct Watchdog_Site *const freeSite) {
+    assert(NULL != block);
+    const unsigned char *address = (const unsigned char *) block->address;
+    struct Watchdog_Violation violation = {
+            .address=block->address, .size=block->size, .site=(NULL == freeSite) ? &gOverflowSite : freeSite,
+            .allocationSite=block->site, .freeSite=(NULL == freeSite) ? &gOverflowSite : freeSite
+    };
+    // the damaged bytes closest to the block are reported, as the most likely to be hit first
+    for (size_t i = 1; i <= block->redzone; i++) {
+        if (WATCHDOG_GUARDS_CANARY != address[-(ptrdiff_t) i]) {
+            violation.kind = "underflow";
+            violation.offset = -(long long) i;
+            Watchdog_Guards_fail(&violation);
+        }
+    }
+    const size_t tail = Watchdog_Guards_getTail(block->redzone, block->size);
+    const size_t offset = Watchdog_Guards_find(address + block->size, tail, WATCHDOG_GUARDS_CANARY);
+    if (offset < tail) {
+        violation.kind = "overflow";
+        violation.offset = (long long) (block->size + offset);
+        Watchdog_Guards_fail(&violation);
+    }
+}
+
+void Watchdog_Guards_release(const struct Watchdog_Block *const block, const struct Watchdog_Site *const freeSite) {
+    assert(NULL != block);
+    assert(NULL != freeSite);
+    Watchdog_Guards_check(block, freeSite);
+    memset((void *) block->address, WATCHDOG_GUARDS_POISON, block->size);
+
+    pthread_mutex_lock(&gQuarantineMutex);
+    struct Watchdog_Quarantine *self = &gQuarantine;
+    if (self->length == self->capacity) {
+        Watchdog_Quarantine_grow(self);
+    }
+    self->entries[(self->head + self->length) & (self->capacity - 1)] = (struct Watchdog_Quarantined) {
+            .address=block->address, .size=block->size, .site=block->site, .freeSite=freeSite,
+            .redzone=block->redzone, .allocator=block->allocator
+    };
+    self->length += 1;
+    self->bytes += block->redzone + block->size + Watchdog_Guards_getTail(block->redzone, block->size);
+    const size_t mask = 2 * self->capacity - 1;
+    size_t i = Watchdog_hash(block->address) & mask;
+    for (; 0 != self->addresses[i]; i = (i + 1) & mask);
+    self->addresses[i] = block->address;
+    while (self->bytes > self->maxBytes) {
+        Watchdog_Quarantine_evict(self);
+    }
+    pthread_mutex_unlock(&gQuarantineMutex);
+}
+
+void Watchdog_Guards_checkUntracked(const uintptr_t address, const struct Watchdog_Site *const site) {
+    assert(NULL != site);
+    struct Watchdog_Violation violation = {
+            .kind="invalidFree", .address=address, .site=site, .allocationSite=&gOverflowSite,
+            .freeSite=&gOverflowSite
+    };
+    // no allocator returns addresses less aligned than malloc does, e.g. they point inside blocks
+    if (0 != address % _Alignof(max_align_t)) {
+        Watchdog_Guards_fail(&violation);
+    }
+
+    pthread_mutex_lock(&gQuarantineMutex);
+    const struct Watchdog_Quarantine *self = &gQuarantine;
+    bool isQuarantined = false;
+    if (self->length > 0) {
+        const size_t mask = 2 * self->capacity - 1;
+        for (size_t i = Watchdog_hash(address) & mask; 0 != self->addresses[i]; i = (i + 1) & mask) {
+            if (self->addresses[i] == address) {
+                isQuarantined = true;
+                break;
+            }
+        }
+    }
+    if (isQuarantined) {
+        for (size_t i = 0; i < self->length; i++) {
+            const struct Watchdog_Quarantined *entry = &self->entries[(self->head + i) & (self->capacity - 1)];
+            if (entry->address == address) {
+                violation.kind = "doubleFree";
+                violation.size = entry->size;
+                violation.allocationSite = entry->site;
+                violation.freeSite = entry->freeSite;
+                Watchdog_Guards_fail(&violation);
+            }
+        }
+    }
+    // otherwise the block has been allocated by untraced code
+    pthread_mutex_unlock(&gQuarantineMutex);
+}
+
+void Watchdog_Guards_fail(const struct Watchdog_Violation *const self) {
+    assert(NULL != self);
+    Watchdog_writef(
+            "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"corruption\", \"kind\": \"%s\", \"address\": \"%p\", \"size\": %zu, \"offset\": %lld, \"file\": \"%s\", \"func\": \"%s\", \"line\": %d, \"allocationFile\": \"%s\", \"allocationFunc\": \"%s\", \"allocationLine\": %d, \"freeFile\": \"%s\", \"freeFunc\": \"%s\", \"freeLine\": %d}\n",
+            (long) Process_getCurrentId(), (long) Process_getParentId(), self->kind, (void *) self->address, self->size,
+            self->offset, self->site->file, self->site->func, self->site->line,
+            self->allocationSite->file, self->allocationSite->func, self->allocationSite->line,
+            self->freeSite->file, self->freeSite->func, self->freeSite->line);
+    Panic_terminate("Heap corruption: %s at offset %lld of the block at %p of %zu bytes, allocated at %s:%d, "
+                    "freed at %s:%d, by the call at %s:%d", self->kind, self->offset, (void *) self->address,
+                    self->size, self->allocationSite->file, self->allocationSite->line,
+                    self->freeSite->file, self->freeSite->line, self->site->file, self->site->line);
+}
+
+void Watchdog_Quarantine_grow(struct Watchdog_Quarantine *const self) {
+    assert(NULL != self);
+    struct Watchdog_Quarantined *entries = self->entries;
+    const size_t capacity = self->capacity;
+
+    self->capacity = (0 == capacity) ? 256 : 2 * capacity;
+    self->entries = malloc(self->capacity * sizeof(self->entries[0]));
+    free(self->addresses);
+    self->addresses = calloc(2 * self->capacity, sizeof(self->addresses[0]));
+    if (NULL == self->entries || NULL == self->addresses) {
+        Panic_terminate("Out of memory");
+    }
+    atomic_fetch_add_explicit(&gFootprint, (self->capacity - capacity) *
+                                           (sizeof(self->entries[0]) + 2 * sizeof(self->addresses[0])),
+                              memory_order_relaxed);
+
+    const size_t mask = 2 * self->capacity - 1;
+    for (size_t i = 0; i < self->length; i++) {
+        self->entries[i] = entries[(self->head + i) & (capacity - 1)];
+        size_t j = Watchdog_hash(self->entries[i].address) & mask;
+        for (; 0 != self->addresses[j]; j = (j + 1) & mask);
+        self->addresses[j] = self->entries[i].address;
+    }
+    self->head = 0;
+    free(entries);
+}
+
+void Watchdog_Quarantine_evict(struct Watchdog_Quarantine *const self) {
+    assert(NULL != self);
+    assert(self->length > 0);
+    const struct Watchdog_Quarantined entry = self->entries[self->head];
+    self->head = (self->head + 1) & (self->capacity - 1);
+    self->length -= 1;
+    self->bytes -= entry.redzone + entry.size + Watchdog_Guards_getTail(entry.redzone, entry.size);
+    Watchdog_Quarantine_remove(self, entry.address);
+
+    const size_t offset = Watchdog_Guards_find((const unsigned char *) entry.address, entry.size,
+                                               WATCHDOG_GUARDS_POISON);
+    if (offset < entry.size) {
+        const struct Watchdog_Violation violation = {
+                .kind="useAfterFree", .address=entry.address, .size=entry.size, .offset=(long long) offset,
+                .site=&gOverflowSite, .allocationSite=entry.site, .freeSite=entry.freeSite
+        };
+        Watchdog_Guards_fail(&violation);
+    }
+    Watchdog_Allocator_release(Watchdog_Allocator_get(entry.allocator), (void *) (entry.address - entry.redzone));
+}
+
+void Watchdog_Quarantine_remove(struct Watchdog_Quarantine *const self, const uintptr_t address) {
+    assert(NULL != self);
+    const size_t mask = 2 * self->capacity - 1;
+    size_t i = Watchdog_hash(address) & mask;
+    for (; self->addresses[i] != address; i = (i + 1) & mask) {
+        assert(0 != self->addresses[i]);
+    }
+    // backward shift deletion, as for live blocks
+    size_t hole = i;
+    for (size_t j = (i + 1) & mask; 0 != self->addresses[j]; j = (j + 1) & mask) {
+        const size_t home = Watchdog_hash(self->addresses[j]) & mask;
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            self->addresses[hole] = self->addresses[j];
+            hole = j;
+        }
+    }
+    self->addresses[hole] = 0;
+}
+
+/*
+ * Governor
+ */
+void Watchdog_setOverheadBudget(const double fraction) {
+    pthread_once(&gInitializeOnce, Watchdog_initialize);
+    Watchdog_Ticker_stop(&gGovernorTicker);
+    atomic_store_explicit(&gIsGoverned, false, memory_order_relaxed);
+    if (fraction <= 0) {
+        if (1 != atomic_load_explicit(&gReportingRate, memory_order_relaxed)) {
+            Watchdog_Governor_setRate(1, 0);
+        }
+        return;
+    }
+
+    // the window starts over, time spent so far is not accounted
+    gGovernor = (struct Watchdog_Governor) {
+            .budget=fraction, .ticks=0, .lastSpent=(long long) Watchdog_getStats().reportingTime,
+            .lastClock=Watchdog_now()
+    };
+    atomic_store_explicit(&gIsGoverned, true, memory_order_relaxed);
+    Watchdog_Ticker_start(&gGovernorTicker, WATCHDOG_GOVERNOR_INTERVAL);
+}
+
+void Watchdog_Governor_adjust(void) {
+    struct Watchdog_Governor *const self = &gGovernor;
+    const long long now = Watchdog_now();
+    const long long spent = (long long) Watchdog_getStats().reportingTime;
+    long long windowSpent = 0, windowElapsed = 0;
+
+    self->spent[self->ticks % WATCHDOG_GOVERNOR_WINDOW] = spent - self->lastSpent;
+    self->elapsed[self->ticks % WATCHDOG_GOVERNOR_WINDOW] = now - self->lastClock;
+    self->lastSpent = spent;
+    self->lastClock = now;
+    self->ticks += 1;
+
+    const size_t length = (self->ticks < WATCHDOG_GOVERNOR_WINDOW) ? self->ticks : WATCHDOG_GOVERNOR_WINDOW;
+    for (size_t i = 0; i < length; i++) {
+        windowSpent += self->spent[i];
+        windowElapsed += self->elapsed[i];
+    }
+    if (windowElapsed <= 0) {
+        return;
+    }
 
-    if (NULL == gStream) {
-        char fileName[65] = "";
-        snprintf(fileName, 64, ".watchdog-%d-%lu.jsonl", WATCHDOG_VERSION_HEX, time(NULL));
-        gStream = fopen(fileName, "w");
-        if (NULL == gStream) {
-            Panic_terminate("Unable to open file: %s", fileName);
+    // reacts to excess at once, restores detail only after a whole window well within budget
+    const double overhead = (double) windowSpent / (double) windowElapsed;
+    const unsigned rate = atomic_load_explicit(&gReportingRate, memory_order_relaxed);
+    if (overhead > self->budget && 0 != rate) {
+        Watchdog_Governor_setRate((rate < WATCHDOG_GOVERNOR_MAX_RATE) ? 2 * rate : 0, overhead);
+        self->ticks = 0;
+    } else if (2 * overhead < self->budget && WATCHDOG_GOVERNOR_WINDOW == length && 1 != rate) {
+        Watchdog_Governor_setRate((0 == rate) ? WATCHDOG_GOVERNOR_MAX_RATE : rate / 2, overhead);
+        self->ticks = 0;
+    }
+}
+
+void Watchdog_Governor_setRate(const unsigned rate, const double overhead) {
+    atomic_store_explicit(&gReportingRate, rate, memory_order_relaxed);
+    Watchdog_writef(
+            "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"governor\", \"mode\": \"%s\", \"rate\": %u, \"overhead\": %.6f, \"budget\": %.6f, \"timestamp\": %lu}\n",
+            (long) Process_getCurrentId(), (long) Process_getParentId(),
+            (1 == rate) ? "full" : (0 == rate) ? "aggregate" : "sampled", rate, overhead,
+            atomic_load_explicit(&gIsGoverned, memory_order_relaxed) ? gGovernor.budget : 0, time(NULL));
+}
+
+bool Watchdog_Governor_isReported(struct Watchdog_Thread *const thread) {
+    assert(NULL != thread);
+    const unsigned rate = atomic_load_explicit(&gReportingRate, memory_order_relaxed);
+    if (rate <= 1) {
+        return 1 == rate;
+    }
+    if (0 == thread->reportCountdown || thread->reportCountdown >= rate) {
+        thread->reportCountdown = rate - 1;
+        return true;
+    }
+    thread->reportCountdown -= 1;
+    return false;
+}
+
+/*
+ * Statistics
+ */
+struct Watchdog_Stats Watchdog_getStats(void) {
+    struct Watchdog_Stats stats = {0};
+    size_t histogram[WATCHDOG_STATS_BUCKETS] = {0};
+
+    for (const struct Watchdog_Thread *thread = atomic_load_explicit(&gThreads, memory_order_acquire);
+         NULL != thread; thread = thread->next) {
+        stats.reportedCalls += atomic_load_explicit(&thread->reported, memory_order_relaxed);
+        stats.sampledOutCalls += atomic_load_explicit(&thread->sampledOut, memory_order_relaxed);
+        stats.reportingTime += atomic_load_explicit(&thread->reportingTime, memory_order_relaxed);
+        for (size_t i = 0; i < WATCHDOG_STATS_BUCKETS; i++) {
+            histogram[i] += atomic_load_explicit(&thread->reportingTimes[i], memory_order_relaxed);
+        }
+    }
+
+    size_t calls = 0;
+    for (size_t i = 0; i < WATCHDOG_STATS_BUCKETS; i++) {
+        calls += histogram[i];
+    }
+    const size_t rank = calls - calls / 100;
+    for (size_t i = 0, seen = 0; i < WATCHDOG_STATS_BUCKETS && 0 < rank; i++) {
+        seen += histogram[i];
+        if (seen >= rank) {
+            stats.reportingTimeP99 = Watchdog_Stats_limit(i);
+            break;
+        }
+    }
+
+    const struct Watchdog_BufferStats *buffer = gBuffer.stats;
+    stats.footprint = atomic_load_explicit(&gFootprint, memory_order_relaxed) +
+                      sizeof(gSites) + sizeof(gShards) + sizeof(gBuffer);
+#if WATCHDOG_COLLECTOR
+    if (NULL != gRing) {
+        buffer = &gRing->bufferStats;
+        stats.droppedRecords += atomic_load_explicit(&gRing->dropped, memory_order_relaxed);
+        stats.footprint += sizeof(*gRing);
+    }
+#endif
+    stats.droppedRecords += atomic_load_explicit(&buffer->dropped, memory_order_relaxed);
+    stats.writtenBytes = atomic_load_explicit(&buffer->written, memory_order_relaxed);
+    stats.flushes = atomic_load_explicit(&buffer->flushes, memory_order_relaxed);
+    stats.bufferHighWater = atomic_load_explicit(&buffer->highWater, memory_order_relaxed);
+    return stats;
+}
+
+size_t Watchdog_Stats_bucket(const unsigned long long nanoseconds) {
+    if (nanoseconds < 4) {
+        return (size_t) nanoseconds;
+    }
+    const unsigned exponent = 63u - (unsigned) __builtin_clzll(nanoseconds);
+    return 4 * (exponent - 1) + ((nanoseconds >> (exponent - 2)) & 3u);
+}
+
+unsigned long long Watchdog_Stats_limit(const size_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    const unsigned exponent = (unsigned) (bucket / 4 + 1);
+    return ((4ull + bucket % 4) << (exponent - 2)) + (1ull << (exponent - 2)) - 1;
+}
+
+void Watchdog_Stats_write(void) {
+    const struct Watchdog_Stats stats = Watchdog_getStats();
+    Watchdog_writef(
+            "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"stats\", \"reportedCalls\": %zu, \"sampledOutCalls\": %zu, \"droppedRecords\": %zu, \"writtenBytes\": %zu, \"flushes\": %zu, \"bufferHighWater\": %zu, \"reportingTime\": %llu, \"reportingTimeP99\": %llu, \"footprint\": %zu, \"timestamp\": %lu}\n",
+            (long) Process_getCurrentId(), (long) Process_getParentId(), stats.reportedCalls, stats.sampledOutCalls,
+            stats.droppedRecords, stats.writtenBytes, stats.flushes, stats.bufferHighWater, stats.reportingTime,
+            stats.reportingTimeP99, stats.footprint, time(NULL));
+}
+
+long long Watchdog_now(void) {
+    struct timespec clock;
+    clock_gettime(CLOCK_MONOTONIC, &clock);
+    return clock.tv_sec * 1000000000LL + clock.tv_nsec;
+}
+
+/*
+ * Budgets
+ */
+Watchdog_BudgetCallback Watchdog_registerBudgetCallback(const Watchdog_BudgetCallback callback) {
+    return atomic_exchange(&gBudgetCallback, callback);
+}
+
+void Watchdog_setGlobalBudget(const size_t maxBytes, const size_t maxBlocks) {
+    atomic_store(&gGlobalBudget.maxBytes, maxBytes);
+    atomic_store(&gGlobalBudget.maxBlocks, maxBlocks);
+    atomic_store(&gGlobalBudget.isExceeded, false);
+}
+
+void Watchdog_setModuleBudget(const int module, const size_t maxBytes, const size_t maxBlocks) {
+    assert(0 <= module && module < WATCHDOG_MODULES_COUNT);
+    atomic_store(&gModuleBudgets[module].maxBytes, maxBytes);
+    atomic_store(&gModuleBudgets[module].maxBlocks, maxBlocks);
+    atomic_store(&gModuleBudgets[module].isExceeded, false);
+}
+
+void Watchdog_setSiteBudget(const size_t maxBytes, const size_t maxBlocks) {
+    atomic_store(&gSiteBudget.maxBytes, maxBytes);
+    atomic_store(&gSiteBudget.maxBlocks, maxBlocks);
+    for (size_t i = 0; i < WATCHDOG_SITES_CAPACITY; i++) {
+        atomic_store_explicit(&gSites[i].isOverBudget, false, memory_order_relaxed);
+    }
+}
+
+void Watchdog_Thread_flush(struct Watchdog_Thread *const self) {
+    assert(NULL != self);
+    const long long bytes = atomic_fetch_add_explicit(&gGlobalUsage.bytes, self->pendingBytes,
+                                                      memory_order_relaxed) + self->pendingBytes;
+    const long long blocks = atomic_fetch_add_explicit(&gGlobalUsage.blocks, self->pendingBlocks,
+                                                       memory_order_relaxed) + self->pendingBlocks;
+    self->pendingBytes = 0;
+    self->pendingBlocks = 0;
+    Watchdog_Budget_check(&gGlobalBudget, &gGlobalBudget.isExceeded, bytes, blocks, "global", -1, NULL);
+    size_t peak = atomic_load_explicit(&gPeakBytes, memory_order_relaxed);
+    while (bytes > (long long) peak &&
+           !atomic_compare_exchange_weak_explicit(&gPeakBytes, &peak, (size_t) bytes,
+                                                  memory_order_relaxed, memory_order_relaxed)) {}
+
+    for (int module = 0; module < WATCHDOG_MODULES_COUNT; module++) {
+        if (0 != self->pendingModuleBytes[module] || 0 != self->pendingModuleBlocks[module]) {
+            struct Watchdog_Usage *usage = &gModuleUsages[module];
+            const long long moduleBytes = atomic_fetch_add_explicit(&usage->bytes, self->pendingModuleBytes[module],
+                                                                    memory_order_relaxed) +
+                                          self->pendingModuleBytes[module];
+            const long long moduleBlocks = atomic_fetch_add_explicit(&usage->blocks, self->pendingModuleBlocks[module],
+                                                                     memory_order_relaxed) +
+                                           self->pendingModuleBlocks[module];
+            self->pendingModuleBytes[module] = 0;
+            self->pendingModuleBlocks[module] = 0;
+            Watchdog_Budget_check(&gModuleBudgets[module], &gModuleBudgets[module].isExceeded,
+                                  moduleBytes, moduleBlocks, "module", module, NULL);
         }
-        atexit(Watchdog_onExit);
+    }
+}
+
+void Watchdog_Budget_check(const struct Watchdog_Budget *const self, atomic_bool *const isExceeded,
+                           const long long bytes, const long long blocks,
+                           const char *const scope, const int module, const struct Watchdog_Site *const site) {
+    assert(NULL != self);
+    assert(NULL != isExceeded);
+    assert(NULL != scope);
+    const size_t maxBytes = atomic_load_explicit(&self->maxBytes, memory_order_relaxed);
+    const size_t maxBlocks = atomic_load_explicit(&self->maxBlocks, memory_order_relaxed);
+    const bool isOver = (0 != maxBytes && bytes > (long long) maxBytes) ||
+                        (0 != maxBlocks && blocks > (long long) maxBlocks);
+
+    if (isOver == atomic_load_explicit(isExceeded, memory_order_relaxed)) {
+        return;     // nothing changed
+    }
+    if (isOver == atomic_exchange(isExceeded, isOver) || !isOver) {
+        return;     // either another thread is handling the same transition or the budget has been re-armed
     }
 
+    char message[2048] = "";
+    int length = 0;
     const long PID = Process_getCurrentId(), parentPID = Process_getParentId(), timestamp = time(NULL);
-    if (NULL != relocated) {
-        fprintf(gStream,
-                "{\"PID\": %ld, \"parentPID\": %ld, \"call\": \"%s\", \"file\": \"%s\", \"func\": \"%s\", \"line\": %d, \"address\": {\"from\": \"%p\", \"to\": \"%p\"}, \"size\": %zu, \"timestamp\": %lu}\n",
-                PID, parentPID, call, file, func, line, relocated, address, size, timestamp);
+
+    if (NULL != site) {
+        length = snprintf(message, sizeof(message),
+                          "Heap budget exceeded at site %s:%d (%s): %lld bytes in %lld blocks, limits: %zu bytes %zu blocks",
+                          site->file, site->line, site->func, bytes, blocks, maxBytes, maxBlocks);
+        Watchdog_writef(
+                "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"budgetExceeded\", \"scope\": \"%s\", \"file\": \"%s\", \"func\": \"%s\", \"line\": %d, \"liveBytes\": %lld, \"liveBlocks\": %lld, \"maxBytes\": %zu, \"maxBlocks\": %zu, \"timestamp\": %lu}\n",
+                PID, parentPID, scope, site->file, site->func, site->line, bytes, blocks, maxBytes, maxBlocks,
+                timestamp);
+    } else if (module < 0) {
+        length = snprintf(message, sizeof(message),
+                          "Heap budget exceeded: %lld bytes in %lld blocks, limits: %zu bytes %zu blocks",
+                          bytes, blocks, maxBytes, maxBlocks);
+        Watchdog_writef(
+                "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"budgetExceeded\", \"scope\": \"%s\", \"liveBytes\": %lld, \"liveBlocks\": %lld, \"maxBytes\": %zu, \"maxBlocks\": %zu, \"timestamp\": %lu}\n",
+                PID, parentPID, scope, bytes, blocks, maxBytes, maxBlocks, timestamp);
+    } else {
+        length = snprintf(message, sizeof(message),
+                          "Heap budget exceeded by module %d: %lld bytes in %lld blocks, limits: %zu bytes %zu blocks",
+                          module, bytes, blocks, maxBytes, maxBlocks);
+        Watchdog_writef(
+                "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"budgetExceeded\", \"scope\": \"%s\", \"module\": %d, \"liveBytes\": %lld, \"liveBlocks\": %lld, \"maxBytes\": %zu, \"maxBlocks\": %zu, \"timestamp\": %lu}\n",
+                PID, parentPID, scope, module, bytes, blocks, maxBytes, maxBlocks, timestamp);
+    }
+
+    const struct Watchdog_Site *sites[WATCHDOG_TOP_SITES_COUNT];
+    const size_t count = Watchdog_collectTopSites(sites, WATCHDOG_TOP_SITES_COUNT, (NULL == site) ? module : -1);
+    for (size_t i = 0; i < count && length >= 0 && (size_t) length < sizeof(message); i++) {
+        length += snprintf(message + length, sizeof(message) - length, "\n  %zu) %s:%d (%s): %zu bytes in %zu blocks",
+                           i + 1, sites[i]->file, sites[i]->line, sites[i]->func,
+                           atomic_load_explicit(&sites[i]->liveBytes, memory_order_relaxed),
+                           atomic_load_explicit(&sites[i]->liveBlocks, memory_order_relaxed));
+    }
+
+    const Watchdog_BudgetCallback callback = atomic_load(&gBudgetCallback);
+    if (NULL != callback) {
+        callback(message);
+    } else {
+        errno = 0;
+        Panic_terminate("%s", message);
+    }
+}
+
+size_t Watchdog_collectTopSites(const struct Watchdog_Site **const sites, const size_t size, const int module) {
+    assert(NULL != sites);
+    size_t count = 0;
+    for (size_t i = 0; i < WATCHDOG_SITES_CAPACITY; i++) {
+        const struct Watchdog_Site *site = &gSites[i];
+        if (!atomic_load_explicit(&site->isUsed, memory_order_acquire) || (module >= 0 && site->module != module)) {
+            continue;
+        }
+        const size_t bytes = atomic_load_explicit(&site->liveBytes, memory_order_relaxed);
+        if (0 == bytes) {
+            continue;
+        }
+        // insertion sort on a tiny array, sites are ranked by live bytes
+        size_t j = (count < size) ? count++ : size;
+        while (j > 0 && atomic_load_explicit(&sites[j - 1]->liveBytes, memory_order_relaxed) < bytes) {
+            if (j < size) {
+                sites[j] = sites[j - 1];
+            }
+            j--;
+        }
+        if (j < size) {
+            sites[j] = site;
+        }
+    }
+    return count;
+}
+
+/*
+ * Events
+ */
+static const char *const gCallNames[] = {
+        [WATCHDOG_CALL_ALIGNED_ALLOC]="aligned_alloc",
+        [WATCHDOG_CALL_MALLOC]="malloc",
+        [WATCHDOG_CALL_CALLOC]="calloc",
+        [WATCHDOG_CALL_REALLOC]="realloc",
+        [WATCHDOG_CALL_FREE]="free",
+};
+
+static const char gDigitPairs[201] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+
+int Watchdog_Event_format(const struct Watchdog_Event *const self, char *const buffer, const size_t size) {
+    assert(NULL != self);
+    assert(NULL != buffer);
+    const struct Watchdog_Site *site = self->site;
+    const char *call = gCallNames[self->call];
+#if WATCHDOG_THREAD_NAMES
+    const size_t threadLength = strlen(self->threadName);
+#else
+    const size_t threadLength = 0;
+#endif
+
+    // an upper bound is returned when the record may not fit, as callers retry with a large enough buffer
+    const size_t bound = WATCHDOG_EVENT_BOUND + threadLength + site->fileLength + site->funcLength;
+    if (bound > size) {
+        return (int) bound;
+    }
+
+    char *cursor = WATCHDOG_FORMAT_LITERAL(buffer, "{\"PID\": ");
+    cursor = Watchdog_Format_signed(cursor, self->PID);
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, ", \"parentPID\": ");
+    cursor = Watchdog_Format_signed(cursor, self->parentPID);
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, ", \"TID\": ");
+    cursor = Watchdog_Format_signed(cursor, self->TID);
+#if WATCHDOG_THREAD_NAMES
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, ", \"thread\": \"");
+    cursor = Watchdog_Format_text(cursor, self->threadName, threadLength);
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, "\"");
+#endif
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, ", \"call\": \"");
+    cursor = Watchdog_Format_text(cursor, call, strlen(call));
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, "\", \"file\": \"");
+    cursor = Watchdog_Format_text(cursor, site->file, site->fileLength);
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, "\", \"func\": \"");
+    cursor = Watchdog_Format_text(cursor, site->func, site->funcLength);
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, "\", \"line\": ");
+    cursor = Watchdog_Format_signed(cursor, site->line);
+    if (0 != self->relocated) {
+        cursor = WATCHDOG_FORMAT_LITERAL(cursor, ", \"address\": {\"from\": \"");
+        cursor = Watchdog_Format_address(cursor, self->relocated);
+        cursor = WATCHDOG_FORMAT_LITERAL(cursor, "\", \"to\": \"");
+        cursor = Watchdog_Format_address(cursor, self->address);
+        cursor = WATCHDOG_FORMAT_LITERAL(cursor, "\"}, \"size\": ");
+    } else {
+        cursor = WATCHDOG_FORMAT_LITERAL(cursor, ", \"address\": \"");
+        cursor = Watchdog_Format_address(cursor, self->address);
+        cursor = WATCHDOG_FORMAT_LITERAL(cursor, "\", \"size\": ");
+    }
+    cursor = Watchdog_Format_unsigned(cursor, self->size);
+    if (0 != self->tag) {
+        cursor = WATCHDOG_FORMAT_LITERAL(cursor, ", \"tag\": ");
+        cursor = Watchdog_Format_unsigned(cursor, self->tag);
+    }
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, ", \"timestamp\": ");
+    cursor = Watchdog_Format_unsigned(cursor, (unsigned long) self->timestamp);
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, ", \"clock\": ");
+    cursor = Watchdog_Format_signed(cursor, self->clock);
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, ", \"sequence\": ");
+    cursor = Watchdog_Format_unsigned(cursor, self->sequence);
+    cursor = WATCHDOG_FORMAT_LITERAL(cursor, "}\n");
+    *cursor = '\0';
+    return (int) (cursor - buffer);
+}
+
+char *Watchdog_Format_text(char *const cursor, const char *const text, const size_t length) {
+    assert(NULL != cursor);
+    assert(NULL != text);
+    memcpy(cursor, text, length);
+    return cursor + length;
+}
+
+char *Watchdog_Format_unsigned(char *const cursor, unsigned long long value) {
+    assert(NULL != cursor);
+    char digits[20];
+    size_t i = sizeof(digits);
+    for (; value >= 100; value /= 100) {
+        const size_t pair = 2 * (size_t) (value % 100);
+        digits[--i] = gDigitPairs[pair + 1];
+        digits[--i] = gDigitPairs[pair];
+    }
+    if (value >= 10) {
+        digits[--i] = gDigitPairs[2 * value + 1];
+        digits[--i] = gDigitPairs[2 * value];
+    } else {
+        digits[--i] = (char) ('0' + value);
+    }
+    return Watchdog_Format_text(cursor, digits + i, sizeof(digits) - i);
+}
+
+char *Watchdog_Format_signed(char *cursor, const long long value) {
+    assert(NULL != cursor);
+    if (value < 0) {
+        *cursor++ = '-';
+        return Watchdog_Format_unsigned(cursor, 0 - (unsigned long long) value);
+    }
+    return Watchdog_Format_unsigned(cursor, (unsigned long long) value);
+}
+
+char *Watchdog_Format_address(char *cursor, uintptr_t address) {
+    assert(NULL != cursor);
+    static const char hexDigits[16] = "0123456789abcdef";
+    if (0 == address) {
+        return Watchdog_Format_text(cursor, "(nil)", 5);    // as %p does
+    }
+    // clzll counts the leading zeros of 64 bits, whatever the width of uintptr_t
+    const size_t length = (64 - (size_t) __builtin_clzll((unsigned long long) address) + 3) / 4;
+    *cursor++ = '0';
+    *cursor++ = 'x';
+    for (size_t i = length; i > 0; i--, address >>= 4) {
+        cursor[i - 1] = hexDigits[address & 0xF];
+    }
+    return cursor + length;
+}
+
+void Watchdog_Event_stamp(struct Watchdog_Event *const self) {
+    assert(NULL != self);
+    struct timespec clock;
+    clock_gettime(CLOCK_MONOTONIC, &clock);
+    self->clock = clock.tv_sec * 1000000000LL + clock.tv_nsec;
+    self->sequence = atomic_fetch_add_explicit(&gSequence, 1, memory_order_relaxed);
+}
+
+void Watchdog_emit(const struct Watchdog_Event *const event) {
+    assert(NULL != event);
+#if WATCHDOG_COLLECTOR
+    if (NULL != gRing) {
+        Watchdog_Collector_emit(event);
+        return;
+    }
+#endif
+    // events are stamped while holding the stream, so that the trace is ordered by clock and sequence
+    struct Watchdog_Event stamped = *event;
+    flockfile(gStream);
+    Watchdog_Event_stamp(&stamped);
+    Watchdog_Event_write(&stamped);
+    funlockfile(gStream);
+}
+
+void Watchdog_Event_write(const struct Watchdog_Event *const self) {
+    assert(NULL != self);
+    char buffer[WATCHDOG_EVENT_SIZE];
+    const int length = Watchdog_Event_format(self, buffer, sizeof(buffer));
+    if (length < 0) {
+        return;
+    }
+
+    // callers hold the stream, or are the only writer as the collector is
+    Watchdog_Chunk_add(self);
+    if ((size_t) length < sizeof(buffer)) {
+        Watchdog_write(buffer, (size_t) length);
+    } else {
+        char *large = malloc((size_t) length + 1);
+        if (NULL == large) {
+            Panic_terminate("Out of memory");
+        }
+        Watchdog_write(large, (size_t) Watchdog_Event_format(self, large, (size_t) length + 1));
+        free(large);
+    }
+}
+
+void Watchdog_write(const char *const record, const size_t length) {
+    assert(NULL != record);
+#if WATCHDOG_COLLECTOR
+    if (NULL != gRing) {
+        Watchdog_Collector_write(record, length);
+        return;
+    }
+#endif
+    flockfile(gStream);
+    Watchdog_Buffer_append(&gBuffer, record, length);
+    gChunk.length += length;
+    if (gChunk.length >= WATCHDOG_CHUNK_SIZE) {
+        Watchdog_Chunk_close();
+    }
+    funlockfile(gStream);
+}
+
+void Watchdog_writef(const char *const format, ...) {
+    assert(NULL != format);
+    char buffer[1024];
+    va_list args;
+
+    va_start(args, format);
+    const int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+
+    if ((size_t) length < sizeof(buffer)) {
+        Watchdog_write(buffer, (size_t) length);
+    } else {
+        char *large = malloc((size_t) length + 1);
+        if (NULL == large) {
+            Panic_terminate("Out of memory");
+        }
+        va_start(args, format);
+        vsnprintf(large, (size_t) length + 1, format, args);
+        va_end(args);
+        Watchdog_write(large, (size_t) length);
+        free(large);
+    }
+}
+
+/*
+ * Chunks
+ */
+void Watchdog_Chunk_add(const struct Watchdog_Event *const event) {
+    assert(NULL != event);
+    const uintptr_t low = (0 != event->relocated && event->relocated < event->address) ?
+                          event->relocated : event->address;
+    const uintptr_t high = (event->relocated > event->address) ? event->relocated : event->address;
+    const uint64_t hash = event->site->hash;
+
+    if (0 == gChunk.events++) {
+        gChunk.clockMin = gChunk.clockMax = event->clock;
+        gChunk.addressMin = low;
+        gChunk.addressMax = high;
     } else {
-        fprintf(gStream,
-                "{\"PID\": %ld, \"parentPID\": %ld, \"call\": \"%s\", \"file\": \"%s\", \"func\": \"%s\", \"line\": %d, \"address\": \"%p\", \"size\": %zu, \"timestamp\": %lu}\n",
-                PID, parentPID, call, file, func, line, address, size, timestamp);
+        gChunk.clockMin = (event->clock < gChunk.clockMin) ? event->clock : gChunk.clockMin;
+        gChunk.clockMax = (event->clock > gChunk.clockMax) ? event->clock : gChunk.clockMax;
+        gChunk.addressMin = (low < gChunk.addressMin) ? low : gChunk.addressMin;
+        gChunk.addressMax = (high > gChunk.addressMax) ? high : gChunk.addressMax;
+    }
+    gChunk.sites[(hash & 0xFF) >> 6] |= UINT64_C(1) << (hash & 63);
+    gChunk.sites[((hash >> 8) & 0xFF) >> 6] |= UINT64_C(1) << ((hash >> 8) & 63);
+}
+
+void Watchdog_Chunk_close(void) {
+    if (0 == gChunk.length) {
+        return;
+    }
+    // the chunk record is not part of any chunk, the next one starts right after it
+    char record[512];
+    const int length = snprintf(
+            record, sizeof(record),
+            "{\"PID\": %ld, \"parentPID\": %ld, \"record\": \"chunk\", \"offset\": %zu, \"length\": %zu, \"events\": %zu, \"clockMin\": %lld, \"clockMax\": %lld, \"addressMin\": \"%p\", \"addressMax\": \"%p\", \"sites\": \"%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "\"}\n",
+            (long) Process_getCurrentId(), (long) Process_getParentId(), gChunk.offset, gChunk.length, gChunk.events,
+            gChunk.clockMin, gChunk.clockMax, (void *) gChunk.addressMin, (void *) gChunk.addressMax,
+            gChunk.sites[0], gChunk.sites[1], gChunk.sites[2], gChunk.sites[3]);
+    if (length > 0 && (size_t) length < sizeof(record)) {
+        Watchdog_Buffer_append(&gBuffer, record, (size_t) length);
+    }
+    const size_t offset = gChunk.offset + gChunk.length +
+                          (size_t) ((length > 0 && (size_t) length < sizeof(record)) ? length : 0);
+    gChunk = (struct Watchdog_Chunk) {.offset=offset};
+}
+
+/*
+ * Buffer
+ */
+void Watchdog_Buffer_append(struct Watchdog_Buffer *const self, const char *const data, const size_t length) {
+    assert(NULL != self);
+    assert(NULL != data);
+    size_t used = atomic_load_explicit(&self->length, memory_order_relaxed);
+    if (used + length > WATCHDOG_BUFFER_SIZE) {
+        Watchdog_Buffer_flush(self);
+        used = 0;
+    }
+    if (length > WATCHDOG_BUFFER_SIZE) {
+        const size_t sent = Watchdog_Buffer_send(self->fd, data, length);
+        Watchdog_count(&self->stats->written, sent);
+        Watchdog_count((sent < length) ? &self->stats->dropped : &self->stats->flushes, 1);
+        return;
+    }
+    memcpy(self->data + used, data, length);
+    atomic_store_explicit(&self->length, used + length, memory_order_release);
+    self->records += 1;
+    if (used + length > atomic_load_explicit(&self->stats->highWater, memory_order_relaxed)) {
+        atomic_store_explicit(&self->stats->highWater, used + length, memory_order_relaxed);
+    }
+    if (self->isDirect) {
+        Watchdog_Buffer_flush(self);
+    }
+}
+
+void Watchdog_Buffer_flush(struct Watchdog_Buffer *const self) {
+    assert(NULL != self);
+    const size_t length = atomic_load_explicit(&self->length, memory_order_relaxed);
+    const size_t flushed = atomic_load_explicit(&self->flushed, memory_order_relaxed);
+    Watchdog_Buffer_drain(self);
+    if (flushed < length) {
+        const size_t sent = atomic_load_explicit(&self->flushed, memory_order_relaxed) - flushed;
+        Watchdog_count(&self->stats->written, sent);
+        Watchdog_count(&self->stats->flushes, 1);
+        if (flushed + sent < length) {
+            Watchdog_count(&self->stats->dropped, self->records);
+        }
+    }
+    self->records = 0;
+    // in this order, a crash in between flushes nothing twice
+    atomic_store_explicit(&self->length, 0, memory_order_release);
+    atomic_store_explicit(&self->flushed, 0, memory_order_release);
+}
+
+void Watchdog_Buffer_drain(struct Watchdog_Buffer *const self) {
+    assert(NULL != self);
+    const size_t length = atomic_load_explicit(&self->length, memory_order_acquire);
+    const size_t flushed = atomic_load_explicit(&self->flushed, memory_order_acquire);
+    if (flushed < length) {
+        const size_t sent = Watchdog_Buffer_send(self->fd, self->data + flushed, length - flushed);
+        atomic_store_explicit(&self->flushed, flushed + sent, memory_order_release);
+    }
+}
+
+size_t Watchdog_Buffer_send(const int fd, const char *const data, const size_t length) {
+    assert(NULL != data);
+    size_t sent = 0;
+    while (sent < length) {
+        const ssize_t result = write(fd, data + sent, length - sent);
+        if (result > 0) {
+            sent += (size_t) result;
+        } else if (result < 0 && EINTR != errno) {
+            break;  // nothing better to do than losing the records, as stdio would
+        }
+    }
+    return sent;
+}
+
+/*
+ * Crashes
+ */
+static const char *Watchdog_Crash_name(int signal)
+__attribute__((__warn_unused_result__));
+
+void Watchdog_Crash_install(void) {
+#if WATCHDOG_HAS_BACKTRACE
+    // the first call may load the unwinder, which is not async-signal-safe
+    void *frame;
+    backtrace(&frame, 1);
+#endif
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = Watchdog_Crash_onSignal;
+    action.sa_flags = SA_SIGINFO;
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < WATCHDOG_CRASH_SIGNALS_COUNT; i++) {
+        sigaction(gCrashSignals[i], &action, &gPreviousActions[i]);
+    }
+    gPreviousPanicCallback = Panic_registerCallback(Watchdog_Crash_onPanic);
+}
+
+void Watchdog_Crash_onSignal(const int signal, siginfo_t *const info, void *const context) {
+    (void) context;
+    const int previousError = errno;
+    if (!atomic_exchange(&gHasCrashed, true)) {
+        const bool hasAddress = (SIGSEGV == signal || SIGBUS == signal || SIGILL == signal || SIGFPE == signal);
+        Watchdog_Crash_report(signal, (hasAddress && NULL != info) ? info->si_addr : NULL);
+    }
+
+    // hand over to the previous handler: faults are raised again by returning, other signals must be re-sent
+    for (size_t i = 0; i < WATCHDOG_CRASH_SIGNALS_COUNT; i++) {
+        if (gCrashSignals[i] == signal) {
+            sigaction(signal, &gPreviousActions[i], NULL);
+        }
+    }
+    if (NULL == info || info->si_code <= 0 || SIGABRT == signal) {
+        raise(signal);
+    }
+    errno = previousError;
+}
+
+void Watchdog_Crash_onPanic(void) {
+    if (!atomic_exchange(&gHasCrashed, true)) {
+        Watchdog_Crash_report(0, NULL);
+    }
+    if (NULL != gPreviousPanicCallback) {
+        gPreviousPanicCallback();
+    }
+}
+
+void Watchdog_Crash_report(const int signal, const void *const address) {
+    struct Watchdog_Crash_Line line = {.length=0};
+    struct timespec clock;
+    clock_gettime(CLOCK_MONOTONIC, &clock);
+
+    Watchdog_Crash_put(&line, "{\"PID\": ");
+    Watchdog_Crash_putInteger(&line, Process_getCurrentId());
+    Watchdog_Crash_put(&line, ", \"parentPID\": ");
+    Watchdog_Crash_putInteger(&line, Process_getParentId());
+    Watchdog_Crash_put(&line, ", \"record\": \"crash\", \"TID\": ");
+    Watchdog_Crash_putInteger(&line, (NULL != tThread) ? tThread->id : 0);
+    Watchdog_Crash_put(&line, ", \"signal\": ");
+    Watchdog_Crash_putInteger(&line, signal);
+    Watchdog_Crash_put(&line, ", \"cause\": \"");
+    Watchdog_Crash_put(&line, Watchdog_Crash_name(signal));
+    Watchdog_Crash_put(&line, "\", \"address\": \"");
+    Watchdog_Crash_putAddress(&line, (uintptr_t) address);
+    Watchdog_Crash_put(&line, "\", \"timestamp\": ");
+    Watchdog_Crash_putInteger(&line, time(NULL));
+    Watchdog_Crash_put(&line, ", \"clock\": ");
+    Watchdog_Crash_putInteger(&line, clock.tv_sec * 1000000000LL + clock.tv_nsec);
+    Watchdog_Crash_put(&line, ", \"backtrace\": [");
+#if WATCHDOG_HAS_BACKTRACE
+    void *frames[WATCHDOG_CRASH_FRAMES + 2];
+    const int count = backtrace(frames, WATCHDOG_CRASH_FRAMES + 2);
+    // skip this function and the handler
+    for (int i = 2; i < count; i++) {
+        Watchdog_Crash_put(&line, (2 == i) ? "\"" : ", \"");
+        Watchdog_Crash_putAddress(&line, (uintptr_t) frames[i]);
+        Watchdog_Crash_put(&line, "\"");
+    }
+#endif
+    Watchdog_Crash_put(&line, "]}\n");
+
+    // the crashing thread may hold the stream: records in the middle of being copied are left out
+#if WATCHDOG_COLLECTOR
+    if (NULL != gRing) {
+        Watchdog_Collector_write(line.data, line.length);
+        return;
+    }
+#endif
+    if (gBuffer.fd >= 0) {
+        Watchdog_Buffer_drain(&gBuffer);
+        Watchdog_Buffer_send(gBuffer.fd, line.data, line.length);
+    }
+}
+
+void Watchdog_Crash_put(struct Watchdog_Crash_Line *const self, const char *const string) {
+    assert(NULL != self);
+    assert(NULL != string);
+    for (const char *c = string; '\0' != *c && self->length < sizeof(self->data); c++) {
+        self->data[self->length++] = *c;
+    }
+}
+
+void Watchdog_Crash_putInteger(struct Watchdog_Crash_Line *const self, const long long value) {
+    assert(NULL != self);
+    char digits[24];
+    size_t count = 0;
+    unsigned long long magnitude = (value < 0) ? 0ULL - (unsigned long long) value : (unsigned long long) value;
+    do {
+        digits[count++] = (char) ('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (value < 0) {
+        digits[count++] = '-';
+    }
+    while (count > 0 && self->length < sizeof(self->data)) {
+        self->data[self->length++] = digits[--count];
+    }
+}
+
+void Watchdog_Crash_putAddress(struct Watchdog_Crash_Line *const self, uintptr_t value) {
+    assert(NULL != self);
+    char digits[2 * sizeof(value)];
+    size_t count = 0;
+    do {
+        digits[count++] = "0123456789abcdef"[value & 15];
+        value >>= 4;
+    } while (value > 0);
+    Watchdog_Crash_put(self, "0x");
+    while (count > 0 && self->length < sizeof(self->data)) {
+        self->data[self->length++] = digits[--count];
+    }
+}
+
+const char *Watchdog_Crash_name(const int signal) {
+    switch (signal) {
+        case SIGSEGV:
+            return "SIGSEGV";
+        case SIGBUS:
+            return "SIGBUS";
+        case SIGILL:
+            return "SIGILL";
+        case SIGFPE:
+            return "SIGFPE";
+        case SIGABRT:
+            return "SIGABRT";
+        default:
+            return "panic";
+    }
+}
+
+/*
+ * Collector
+ */
+#if WATCHDOG_COLLECTOR
+
+static struct Watchdog_Slot *Watchdog_Collector_reserve(size_t position)
+__attribute__((__warn_unused_result__));
+
+static void Watchdog_Collector_publish(struct Watchdog_Slot *slot, size_t position)
+__attribute__((__nonnull__));
+
+static uint32_t Watchdog_Collector_intern(const char *string)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static bool Watchdog_Collector_hasProducers(struct Watchdog_Ring *ring)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+void Watchdog_Collector_start(void) {
+    void *memory = MAP_FAILED;
+    const int fd = memfd_create(WATCHDOG_COLLECTOR_NAME, MFD_CLOEXEC);
+    if (fd >= 0) {
+        if (0 == ftruncate(fd, sizeof(*gRing))) {
+            memory = mmap(NULL, sizeof(*gRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+    }
+    if (MAP_FAILED == memory) {
+        Panic_terminate("Unable to map the collector ring");
+    }
+
+    gRing = memory;
+    for (size_t i = 0; i < WATCHDOG_COLLECTOR_SLOTS; i++) {
+        atomic_init(&gRing->slots[i].sequence, i);
+    }
+    memcpy(gRing->strings, "?", 2);     // offset 0 is the fallback when strings are exhausted
+    atomic_init(&gRing->stringsLength, 2);
+
+    if (Ok != Process_spawn(&gCollector, Watchdog_Collector_run)) {
+        Panic_terminate("Unable to spawn the collector process");
+    }
+    gRing->collectorId = Process_id(&gCollector);
+    gCollectorParentId = Process_getCurrentId();
+    Watchdog_Collector_attach();
+}
+
+void Watchdog_Collector_attach(void) {
+    const int id = Process_getCurrentId();
+    for (size_t i = 0; i < WATCHDOG_COLLECTOR_PROCESSES; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&gRing->producers[i], &expected, id)) {
+            return;
+        }
+    }
+    // too many producers: records are still collected but the collector may terminate before this process
+}
+
+void Watchdog_Collector_detach(void) {
+    const int id = Process_getCurrentId();
+    for (size_t i = 0; i < WATCHDOG_COLLECTOR_PROCESSES; i++) {
+        int expected = id;
+        if (atomic_compare_exchange_strong(&gRing->producers[i], &expected, 0)) {
+            return;
+        }
+    }
+}
+
+void Watchdog_Collector_emit(const struct Watchdog_Event *const event) {
+    assert(NULL != event);
+    struct Watchdog_Site *site = (struct Watchdog_Site *) event->site;
+    uint_least64_t strings = atomic_load_explicit(&site->sharedStrings, memory_order_acquire);
+    if (0 == strings) {
+        strings = ((uint_least64_t) Watchdog_Collector_intern(site->file) << 32) |
+                  Watchdog_Collector_intern(site->func);
+        atomic_store_explicit(&site->sharedStrings, strings, memory_order_release);
+    }
+    struct Watchdog_Thread *thread = tThread;
+    if (!thread->isNameShared) {
+        thread->sharedName = Watchdog_Collector_intern(thread->name);
+        thread->isNameShared = true;
+    }
+
+    const size_t position = atomic_fetch_add_explicit(&gRing->tail, 1, memory_order_relaxed);
+    struct Watchdog_Slot *slot = Watchdog_Collector_reserve(position);
+    if (NULL != slot) {
+        // stamping after the reservation keeps clocks close to the order of the ring, the collector fixes the rest
+        struct Watchdog_Event stamped = *event;
+        Watchdog_Event_stamp(&stamped);
+        slot->kind = WATCHDOG_SLOT_EVENT;
+        slot->event = (struct Watchdog_PackedEvent) {
+                .file=(uint32_t) (strings >> 32), .func=(uint32_t) strings, .threadName=thread->sharedName,
+                .line=site->line, .PID=(int32_t) event->PID, .parentPID=(int32_t) event->parentPID,
+                .TID=(int32_t) event->TID, .call=event->call, .tag=event->tag, .relocated=event->relocated,
+                .address=event->address, .size=event->size, .timestamp=event->timestamp,
+                .clock=stamped.clock, .sequence=stamped.sequence
+        };
+        Watchdog_Collector_publish(slot, position);
+    }
+}
+
+void Watchdog_Collector_write(const char *const record, const size_t length) {
+    assert(NULL != record);
+    const size_t count = (0 == length) ? 1 : (length + WATCHDOG_COLLECTOR_PAYLOAD_SIZE - 1) /
+                                             WATCHDOG_COLLECTOR_PAYLOAD_SIZE;
+    if (count >= WATCHDOG_COLLECTOR_SLOTS) {
+        atomic_fetch_add_explicit(&gRing->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    // slots are reserved all at once, so the record is contiguous in the ring
+    const size_t position = atomic_fetch_add_explicit(&gRing->tail, count, memory_order_relaxed);
+    for (size_t i = 0, offset = 0; i < count; i++, offset += WATCHDOG_COLLECTOR_PAYLOAD_SIZE) {
+        struct Watchdog_Slot *slot = Watchdog_Collector_reserve(position + i);
+        if (NULL == slot) {
+            return;
+        }
+        const size_t chunk = (length - offset < WATCHDOG_COLLECTOR_PAYLOAD_SIZE) ?
+                             length - offset : WATCHDOG_COLLECTOR_PAYLOAD_SIZE;
+        slot->kind = (0 == i) ? WATCHDOG_SLOT_TEXT : WATCHDOG_SLOT_TEXT_CONTINUATION;
+        slot->length = (uint32_t) length;
+        memcpy(slot->text, record + offset, chunk);
+        Watchdog_Collector_publish(slot, position + i);
+    }
+}
+
+struct Watchdog_Slot *Watchdog_Collector_reserve(const size_t position) {
+    struct Watchdog_Slot *slot = &gRing->slots[position & (WATCHDOG_COLLECTOR_SLOTS - 1)];
+    // wait for the collector to release the slot, a full ring slows down producers instead of losing records
+    for (size_t spins = 1; atomic_load_explicit(&slot->sequence, memory_order_acquire) != position; spins++) {
+        if (atomic_load_explicit(&gRing->isCollectorDead, memory_order_relaxed)) {
+            atomic_fetch_add_explicit(&gRing->dropped, 1, memory_order_relaxed);
+            return NULL;
+        }
+        if (0 == spins % 1024 && 0 != kill(gRing->collectorId, 0)) {
+            atomic_store_explicit(&gRing->isCollectorDead, true, memory_order_relaxed);
+        }
+        sched_yield();
+    }
+    return slot;
+}
+
+void Watchdog_Collector_publish(struct Watchdog_Slot *const slot, const size_t position) {
+    assert(NULL != slot);
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+}
+
+uint32_t Watchdog_Collector_intern(const char *const string) {
+    assert(NULL != string);
+    const size_t length = strlen(string) + 1;
+    const size_t offset = atomic_fetch_add_explicit(&gRing->stringsLength, length, memory_order_relaxed);
+    if (offset + length > WATCHDOG_COLLECTOR_STRINGS_SIZE) {
+        return 0;
+    }
+    // visibility to the collector is granted by the release store publishing the slot referring to it
+    memcpy(gRing->strings + offset, string, length);
+    return (uint32_t) offset;
+}
+
+void Watchdog_Collector_run(void) {
+    struct Watchdog_Ring *ring = gRing;
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    char *text = NULL;
+    size_t textLength = 0, textCapacity = 0;
+    long long clock = 0;
+    bool isDirty = false;
+
+    Watchdog_openStream();
+    gBuffer.stats = &ring->bufferStats;
+    gRing = NULL;   // encode records directly into the stream from now on
+
+    for (unsigned idles = 0;;) {
+        struct Watchdog_Slot *slot = &ring->slots[head & (WATCHDOG_COLLECTOR_SLOTS - 1)];
+
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != head + 1) {
+            if (isDirty) {
+                Watchdog_Buffer_flush(&gBuffer);    // the ring is idle, make the trace up to date
+                isDirty = false;
+            }
+            if (0 == ++idles % 100 && !Watchdog_Collector_hasProducers(ring)) {
+                if (atomic_load_explicit(&slot->sequence, memory_order_acquire) == head + 1) {
+                    continue;
+                }
+                if (atomic_load_explicit(&ring->tail, memory_order_relaxed) == head) {
+                    break;  // every producer is gone and the ring is empty
+                }
+                // the slot has been reserved by a process which terminated before publishing it
+                slot->kind = WATCHDOG_SLOT_SKIPPED;
+                atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            } else {
+                const struct timespec pause = {.tv_sec=0, .tv_nsec=1000000};
+                nanosleep(&pause, NULL);
+                continue;
+            }
+        }
+        idles = 0;
+
+        switch (slot->kind) {
+            case WATCHDOG_SLOT_EVENT: {
+                const struct Watchdog_PackedEvent *packed = &slot->event;
+                const struct Watchdog_Site site = {
+                        .file=ring->strings + packed->file, .func=ring->strings + packed->func,
+                        .fileLength=strlen(ring->strings + packed->file),
+                        .funcLength=strlen(ring->strings + packed->func), .line=packed->line
+                };
+                const struct Watchdog_Event event = {
+                        .PID=packed->PID, .parentPID=packed->parentPID, .TID=packed->TID,
+                        .threadName=ring->strings + packed->threadName, .site=&site,
+                        .call=(enum Watchdog_Call) packed->call, .relocated=(uintptr_t) packed->relocated,
+                        .address=(uintptr_t) packed->address, .size=(size_t) packed->size, .tag=packed->tag,
+                        .timestamp=(long) packed->timestamp,
+                        .clock=(packed->clock > clock) ? packed->clock : clock,     // the trace is ordered by clock
+                        .sequence=packed->sequence
+                };
+                clock = event.clock;
+                Watchdog_Event_write(&event);
+                break;
+            }
+            case WATCHDOG_SLOT_TEXT:
+            case WATCHDOG_SLOT_TEXT_CONTINUATION: {
+                if (WATCHDOG_SLOT_TEXT == slot->kind) {
+                    textLength = 0;
+                    if (slot->length > textCapacity) {
+                        free(text);
+                        textCapacity = slot->length;
+                        text = malloc(textCapacity);
+                        if (NULL == text) {
+                            Panic_terminate("Out of memory");
+                        }
+                    }
+                }
+                const size_t chunk = (slot->length - textLength < WATCHDOG_COLLECTOR_PAYLOAD_SIZE) ?
+                                     slot->length - textLength : WATCHDOG_COLLECTOR_PAYLOAD_SIZE;
+                if (NULL != text && textLength + chunk <= textCapacity) {
+                    memcpy(text + textLength, slot->text, chunk);
+                    textLength += chunk;
+                    if (textLength == slot->length) {
+                        Watchdog_write(text, textLength);
+                    }
+                }
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+
+        isDirty = true;
+        atomic_store_explicit(&slot->sequence, head + WATCHDOG_COLLECTOR_SLOTS, memory_order_release);
+        head += 1;
+        atomic_store_explicit(&ring->head, head, memory_order_relaxed);
+    }
+
+    const size_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+    if (dropped > 0) {
+        Watchdog_writef("{\"PID\": %ld, \"record\": \"collector\", \"dropped\": %zu}\n",
+                        (long) Process_getCurrentId(), dropped);
     }
+    free(text);
+    Watchdog_Chunk_close();
+    Watchdog_Buffer_flush(&gBuffer);
+    fclose(gStream);
+}
+
+bool Watchdog_Collector_hasProducers(struct Watchdog_Ring *const ring) {
+    assert(NULL != ring);
+    bool hasProducers = false;
+    char path[64] = "", line[512] = "";
 
-    fflush(gStream);
+    for (size_t i = 0; i < WATCHDOG_COLLECTOR_PROCESSES; i++) {
+        const int id = atomic_load_explicit(&ring->producers[i], memory_order_relaxed);
+        if (0 == id) {
+            continue;
+        }
+        // a process is still a producer while it maps the ring, this rules out zombies and processes which exec
+        bool isMapping = false;
+        snprintf(path, sizeof(path), "/proc/%d/maps", id);
+        FILE *maps = fopen(path, "r");
+        if (NULL != maps) {
+            while (!isMapping && NULL != fgets(line, sizeof(line), maps)) {
+                isMapping = NULL != strstr(line, "memfd:" WATCHDOG_COLLECTOR_NAME);
+            }
+            fclose(maps);
+        }
+        if (isMapping) {
+            hasProducers = true;
+        } else {
+            int expected = id;
+            atomic_compare_exchange_strong(&ring->producers[i], &expected, 0);
+        }
+    }
+    return hasProducers;
 }
+
+#endif
@@ -27,6 +27,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #pragma once
 
+#include <stdint.h>
 #include <stdlib.h>
 
 #if !(defined(__GNUC__) || defined(__clang__))
@@ -50,6 +51,79 @@ extern "C" {
 #   define WATCHDOG_HAS_C11_SUPPORT 0
 #endif
 
+/*
+ * Compile-time filtering
+ *
+ * WATCHDOG_MODULE tags the translation unit including this header with a module id in range [0, 31],
+ * WATCHDOG_ENABLED_MODULES is the mask of modules whose calls are traced: if the bit of the current module
+ * is not set, the macros below expand to direct calls to the standard allocators, except realloc and free which reach
+ * the library anyway, so that blocks allocated by traced calls are released by their allocator wherever they are freed.
+ *
+ * WATCHDOG_MIN_TRACED_SIZE is the threshold below which allocations whose size is a compile-time constant
+ * are not traced, those calls expand to direct calls to the standard allocators too.
+ * Non constant sizes, realloc and free are always traced; in modules not enabled only realloc and free of blocks
+ * allocated by traced calls are.
+ */
+#ifndef WATCHDOG_MODULE
+#   define WATCHDOG_MODULE              0
+#endif
+
+#ifndef WATCHDOG_ENABLED_MODULES
+#   define WATCHDOG_ENABLED_MODULES     0xFFFFFFFF
+#endif
+
+#ifndef WATCHDOG_MIN_TRACED_SIZE
+#   define WATCHDOG_MIN_TRACED_SIZE     0
+#endif
+
+#if (WATCHDOG_MODULE) < 0 || (WATCHDOG_MODULE) > 31
+#   error "WATCHDOG_MODULE must be in range [0, 31]"
+#endif
+
+#define WATCHDOG_IS_MODULE_ENABLED      ((((WATCHDOG_ENABLED_MODULES) >> (WATCHDOG_MODULE)) & 1) != 0)
+
+/**
+ * @attention this macro must be treated as opaque: the module id passed by realloc and free, offset by 32 if the module
+ * is not enabled, so that the library leaves the blocks it does not trace to the standard allocators untraced.
+ */
+#if WATCHDOG_IS_MODULE_ENABLED
+#   define __WATCHDOG_CALLING_MODULE    (WATCHDOG_MODULE)
+#else
+#   define __WATCHDOG_CALLING_MODULE    ((WATCHDOG_MODULE) + 32)
+#endif
+
+/*
+ * Runtime switch
+ *
+ * WATCHDOG_RUNTIME_SWITCH keeps the macros below in place even if NDEBUG is defined, so that tracing can stay
+ * compiled into release builds: traced calls are guarded by a one-byte flag, predicted to be clear, and expand to
+ * direct calls to the standard allocators until tracing is enabled, see Watchdog_enable.
+ */
+#ifndef WATCHDOG_RUNTIME_SWITCH
+#   define WATCHDOG_RUNTIME_SWITCH      0
+#endif
+
+/**
+ * @attention this variable must be treated as opaque therefore should not be used directly, see Watchdog_enable.
+ */
+extern unsigned char __Watchdog_isEnabled;
+
+#if WATCHDOG_RUNTIME_SWITCH && (defined(__GNUC__) || defined(__clang__))
+#   define __WATCHDOG_GUARD(traced, untraced)   (__builtin_expect(__atomic_load_n(&__Watchdog_isEnabled, __ATOMIC_RELAXED), 0) ? (traced) : (untraced))
+#elif WATCHDOG_RUNTIME_SWITCH
+#   define __WATCHDOG_GUARD(traced, untraced)   ((*(volatile unsigned char *) &__Watchdog_isEnabled) ? (traced) : (untraced))
+#else
+#   define __WATCHDOG_GUARD(traced, untraced)   (traced)
+#endif
+
+#if !WATCHDOG_IS_MODULE_ENABLED
+#   define __WATCHDOG_SELECT(size, traced, untraced)    (untraced)
+#elif (WATCHDOG_MIN_TRACED_SIZE) > 0 && (defined(__GNUC__) || defined(__clang__))
+#   define __WATCHDOG_SELECT(size, traced, untraced)         ((__builtin_constant_p(size) && (size_t) (size) < (size_t) (WATCHDOG_MIN_TRACED_SIZE)) ? (untraced) : __WATCHDOG_GUARD(traced, untraced))
+#else
+#   define __WATCHDOG_SELECT(size, traced, untraced)    __WATCHDOG_GUARD(traced, untraced)
+#endif
+
 #if WATCHDOG_HAS_C11_SUPPORT
 
 /**
@@ -57,11 +131,14 @@ extern "C" {
  *
  * @attention this function must be treated as opaque therefore should not be called directly, use the macro below instead.
  */
-extern void *__Watchdog_aligned_alloc(const char *file, const char *func, int line, size_t alignment, size_t size)
+extern void *__Watchdog_aligned_alloc(const char *file, const char *func, int line, int module,
+                                      size_t alignment, size_t size)
 __attribute__((__warn_unused_result__, __nonnull__(1)));
 
 #   define Watchdog_aligned_alloc(alignment, size) \
-        __Watchdog_aligned_alloc((__FILE__), (__func__), (__LINE__), (alignment), (size))
+        __WATCHDOG_SELECT((size), \
+                          __Watchdog_aligned_alloc((__FILE__), (__func__), (__LINE__), (WATCHDOG_MODULE), (alignment), (size)), \
+                          (aligned_alloc)((alignment), (size)))
 
 #endif
 
@@ -70,49 +147,371 @@ __attribute__((__warn_unused_result__, __nonnull__(1)));
  *
  * @attention this function must be treated as opaque therefore should not be called directly, use the macro below instead.
  */
-extern void *__Watchdog_malloc(const char *file, const char *func, int line, size_t size)
+extern void *__Watchdog_malloc(const char *file, const char *func, int line, int module, size_t size)
 __attribute__((__warn_unused_result__, __nonnull__(1)));
 
 #define Watchdog_malloc(size) \
-    __Watchdog_malloc((__FILE__), (__func__), (__LINE__), (size))
+    __WATCHDOG_SELECT((size), \
+                      __Watchdog_malloc((__FILE__), (__func__), (__LINE__), (WATCHDOG_MODULE), (size)), \
+                      (malloc)((size)))
 
 /**
  * Same as calloc from <stdlib.h>
  *
  * @attention this function must be treated as opaque therefore should not be called directly, use the macro below instead.
  */
-extern void *__Watchdog_calloc(const char *file, const char *func, int line, size_t numberOfMembers, size_t memberSize)
+extern void *__Watchdog_calloc(const char *file, const char *func, int line, int module,
+                               size_t numberOfMembers, size_t memberSize)
 __attribute__((__warn_unused_result__, __nonnull__(1)));
 
 #define Watchdog_calloc(numberOfMembers, memberSize) \
-    __Watchdog_calloc((__FILE__), (__func__), (__LINE__), (numberOfMembers), (memberSize))
+    __WATCHDOG_SELECT((numberOfMembers) * (memberSize), \
+                      __Watchdog_calloc((__FILE__), (__func__), (__LINE__), (WATCHDOG_MODULE), (numberOfMembers), (memberSize)), \
+                      (calloc)((numberOfMembers), (memberSize)))
 
 /**
  * Same as realloc from <stdlib.h>
  *
  * @attention this function must be treated as opaque therefore should not be called directly, use the macro below instead.
  */
-extern void *__Watchdog_realloc(const char *file, const char *func, int line, void *memory, size_t newSize)
+extern void *__Watchdog_realloc(const char *file, const char *func, int line, int module, void *memory, size_t newSize)
 __attribute__((__warn_unused_result__, __nonnull__(1)));
 
 #define Watchdog_realloc(memory, newSize) \
-    __Watchdog_realloc((__FILE__), (__func__), (__LINE__), (memory), (newSize))
+    __WATCHDOG_GUARD(__Watchdog_realloc((__FILE__), (__func__), (__LINE__), (__WATCHDOG_CALLING_MODULE), (memory), (newSize)), \
+                     (realloc)((memory), (newSize)))
 
 /**
  * Same as free from <stdlib.h>
  *
  * @attention this function must be treated as opaque therefore should not be called directly, use the macro below instead.
  */
-extern void __Watchdog_free(const char *file, const char *func, int line, void *memory)
+extern void __Watchdog_free(const char *file, const char *func, int line, int module, void *memory)
 __attribute__((__nonnull__(1)));
 
 #define Watchdog_free(memory) \
-    __Watchdog_free((__FILE__), (__func__), (__LINE__), (memory))
+    __WATCHDOG_GUARD(__Watchdog_free((__FILE__), (__func__), (__LINE__), (__WATCHDOG_CALLING_MODULE), (memory)), \
+                     (free)((memory)))
+
+/**
+ * Enables tracing of the calls compiled with WATCHDOG_RUNTIME_SWITCH, which reach the standard allocators until then;
+ * calls compiled without it are always traced. Tracing can be enabled at load time too, by setting the
+ * WATCHDOG_ENABLE environment variable to a value other than 0, or later by sending SIGUSR2 to the process unless
+ * the program handles that signal itself (both need the library to be built with WATCHDOG_RUNTIME_SWITCH).
+ * Tracing cannot be disabled afterwards, as blocks allocated by traced calls must be released by traced calls.
+ * This function is async-signal-safe.
+ */
+extern void Watchdog_enable(void);
+
+/**
+ * Pushes a tag on the stack of tags of the calling thread, naming the logical owner of the allocations that follow,
+ * e.g. a request type, a tenant or a pipeline stage. The innermost tag is attached to the blocks allocated by the
+ * thread, which keep it until freed wherever they are freed, and its id to the events the thread reports; live and
+ * cumulative totals per tag are appended to snapshots as snapshotTag records, see watchdog-tags.
+ * Tags are interned by name, names longer than 63 characters are truncated; up to 1024 distinct tags are kept, the
+ * following ones are accounted to the tag "?", and tags nested deeper than 32 are ignored.
+ *
+ * @param tag The name of the tag, copied.
+ */
+extern void Watchdog_pushTag(const char *tag)
+__attribute__((__nonnull__));
+
+/**
+ * Pops the innermost tag of the calling thread, pushed by Watchdog_pushTag.
+ *
+ * @attention execution is terminated through Panic_terminate if no tag has been pushed.
+ */
+extern void Watchdog_popTag(void);
+
+/**
+ * Executes the statement following the macro with tag pushed, see Watchdog_pushTag, e.g.
+ *
+ *     WATCHDOG_TAGGED("checkout") {
+ *         handleCheckout(request);
+ *     }
+ *
+ * break and continue leave the statement itself. With GCC and clang the tag is popped however the statement is left,
+ * otherwise the statement must not be left through return or goto.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+
+/**
+ * @attention this function must be treated as opaque therefore should not be called directly, use the macro below instead.
+ */
+static inline void __Watchdog_popTagScope(const int *scope) {
+    (void) scope;
+    Watchdog_popTag();
+}
+
+#   define WATCHDOG_TAGGED(tag) \
+        for (int __watchdogTagScope __attribute__((__cleanup__(__Watchdog_popTagScope))) = (Watchdog_pushTag((tag)), 1); \
+             __watchdogTagScope; __watchdogTagScope = 0)
+#else
+#   define WATCHDOG_TAGGED(tag) \
+        for (int __watchdogTagScope = (Watchdog_pushTag((tag)), 1); \
+             __watchdogTagScope; __watchdogTagScope = (Watchdog_popTag(), 0))
+#endif
+
+/**
+ * Starts a background thread which periodically appends a sample record to the trace, holding the memory usage of
+ * the process (from /proc/self/statm), the allocator statistics (from mallinfo2 where available) and the total of
+ * live traced bytes and blocks. If the sampler is already running it is restarted with the new interval.
+ * The sampler does not survive fork, it must be started again in child processes.
+ *
+ * @param milliseconds The sampling interval, must be greater than 0.
+ */
+extern void Watchdog_startSampler(unsigned milliseconds);
+
+/**
+ * Stops the sampler thread if running, waiting for its termination.
+ */
+extern void Watchdog_stopSampler(void);
+
+/**
+ * Appends a sample record to the trace immediately, e.g. to mark the boundaries of a phase of the program.
+ */
+extern void Watchdog_sample(void);
+
+/**
+ * Writes the records buffered by the calling process to its trace, closing the current chunk, e.g. before leaving
+ * through _exit, which skips the handler flushing them at exit; children of Process_spawn do it on their own.
+ * Records written through the collector process are never buffered, this function has no effect then.
+ */
+extern void Watchdog_flush(void);
+
+/**
+ * Appends a snapshot of the live traced bytes and blocks of every site to the trace, e.g. at the boundaries of a
+ * phase of the program. Snapshots are numbered from 0 in order of time, see watchdog-diff to compare them.
+ */
+extern void Watchdog_snapshot(void);
+
+/**
+ * Classifies the live traced blocks by reachability, through a conservative scan of the writable segments of the
+ * loaded objects, of the stacks of the threads which made traced calls and of the registers of the calling thread,
+ * followed by the blocks reachable from them. Appends to the trace a leakSite record per site holding live blocks,
+ * with the bytes and blocks definitely lost (unreachable), indirectly lost (reachable only from lost blocks) and
+ * still reachable, followed by a leakCheck record with the totals. Blocks referenced only from untraced memory are
+ * reported as lost, while stale words on the stacks may keep unreferenced blocks reachable. Other threads calling the
+ * traced functions wait until the check is over. Linux only.
+ */
+extern void Watchdog_checkLeaks(void);
+
+/**
+ * Checks leaks at exit too, see Watchdog_checkLeaks.
+ */
+extern void Watchdog_checkLeaksAtExit(void);
+
+/**
+ * Enables heap corruption checks, a faster alternative to valgrind: traced blocks are allocated between redzones
+ * filled with a canary, which is verified when they are freed or reallocated (reallocated blocks are always moved).
+ * Freed blocks are filled with poison and parked in a quarantine of the most recently freed ones, whose poison is
+ * verified when they are eventually released, catching writes after free. Freeing a quarantined block is a double
+ * free, freeing an address less aligned than malloc returns is an invalid free; other untraced addresses are left
+ * to the standard allocators. On violation a corruption record holding the kind, the offset of the first damaged
+ * byte and the sites of the allocation, of the free and of the offending call ("?" if unknown) is appended to the
+ * trace and execution is terminated through Panic_terminate.
+ * Guards are also enabled, with a quarantine of 16 MiB, when the environment variable WATCHDOG_GUARDS is set to
+ * a value other than 0 at the first traced call.
+ *
+ * @attention must be called before the first traced allocation, otherwise execution is terminated through
+ * Panic_terminate. Guarded blocks must not reach untraced code freeing or reallocating them.
+ *
+ * @param quarantineBytes The max bytes held by the quarantine, redzones included; 0 releases blocks immediately.
+ */
+extern void Watchdog_enableGuards(size_t quarantineBytes);
+
+/**
+ * Verifies the redzones of the live traced blocks and the poison of the quarantined ones, see Watchdog_enableGuards,
+ * then appends a guardCheck record with their counts to the trace. Called at exit too; has no effect without guards.
+ */
+extern void Watchdog_checkGuards(void);
+
+/**
+ * Starts a background thread which periodically appends a snapshot to the trace, a last one is appended at exit.
+ * If snapshots are already running they are restarted with the new interval.
+ * Snapshots do not survive fork, they must be started again in child processes.
+ *
+ * @param milliseconds The snapshot interval, must be greater than 0.
+ */
+extern void Watchdog_startSnapshots(unsigned milliseconds);
+
+/**
+ * Stops periodic snapshots if running, waiting for the termination of the background thread.
+ */
+extern void Watchdog_stopSnapshots(void);
+
+/**
+ * Starts a background thread, at the lowest priority, which periodically replaces the file at path with the heap
+ * metrics of the process in the Prometheus text exposition format, e.g. for the textfile collector of node_exporter:
+ * live bytes and blocks, their peak, allocations and frees (totals and rates per second since the previous update)
+ * and the topSites sites holding most live bytes and allocating most often. The file is written aside and renamed,
+ * so readers never see it partially written; when it cannot be written the previous one is left in place.
+ * If metrics are already running they are restarted with the new settings.
+ * Metrics do not survive fork, they must be started again in child processes.
+ *
+ * @param path The path of the file, e.g. ending with ".prom"; its directory must be writable.
+ * @param milliseconds The update interval, must be greater than 0.
+ * @param topSites The number of sites listed per ranking, at most 100.
+ */
+extern void Watchdog_startMetrics(const char *path, unsigned milliseconds, unsigned topSites)
+__attribute__((__nonnull__));
+
+/**
+ * Stops metrics if running, waiting for the termination of the background thread; the file is left in place.
+ */
+extern void Watchdog_stopMetrics(void);
+
+/**
+ * Starts a background thread which keeps the time spent reporting traced calls within a fraction of the wall time,
+ * measured over a sliding window of one second: when over budget blocks are sampled, reporting 1 in 2, 4, ... 1024
+ * of them, then only site counters are kept (snapshots, samples and budgets stay exact); detail is restored while
+ * within half the budget. Every change appends a governor record with the rate applying to the blocks allocated
+ * afterwards. If the governor is already running it is restarted with the new budget.
+ * The governor does not survive fork, it must be started again in child processes.
+ *
+ * @param fraction The budget, e.g. 0.03 for 3%; if not greater than 0 the governor is stopped and every call reported.
+ */
+extern void Watchdog_setOverheadBudget(double fraction);
+
+/**
+ * The cost of tracing for the current process, since its start or its fork.
+ */
+struct Watchdog_Stats {
+    size_t reportedCalls;               // traced calls written to the trace
+    size_t sampledOutCalls;             // traced calls not written, see Watchdog_setOverheadBudget
+    size_t droppedRecords;              // records lost because they could not be written
+    size_t writtenBytes;                // bytes written to the trace
+    size_t flushes;                     // writes to the trace
+    size_t bufferHighWater;             // the max number of bytes held by the trace buffer
+    unsigned long long reportingTime;   // total nanoseconds spent reporting traced calls
+    unsigned long long reportingTimeP99;// 99th percentile of nanoseconds spent reporting a traced call
+    size_t footprint;                   // bytes of memory held by watchdog itself
+};
+
+/**
+ * Gets the cost of tracing so far. Counters are kept per thread and merged without locks, so calls in progress
+ * may or may not be accounted. When the collector process is enabled, writtenBytes, flushes and bufferHighWater
+ * describe the collector, which is shared by the processes forked afterwards.
+ * The same statistics are appended as a stats record to the trace along with every sample, and at exit.
+ *
+ * @return The statistics, reportingTimeP99 is rounded up by 25% at most.
+ */
+extern struct Watchdog_Stats Watchdog_getStats(void)
+__attribute__((__warn_unused_result__));
+
+/**
+ * Publishes the live and cumulative counters of every site in a shared memory region named "/watchdog-<PID>" after
+ * the calling process, laid out as described by watchdog_counters.h. Processes forked afterwards, and their own
+ * children, take a slot in the same region, so that the totals of the whole process tree can be read while it runs
+ * (e.g. by watchdog-top) without touching traces. Calls racing with this one may not be accounted.
+ * The region is removed when the calling process exits; calling this function again has no effect.
+ */
+extern void Watchdog_shareCounters(void);
+
+/**
+ * A backing allocator for traced calls, see Watchdog_setAllocator.
+ * Every function receives the context as first argument and has the semantics of its standard counterpart,
+ * release must accept NULL. Functions must not issue traced calls themselves.
+ */
+struct Watchdog_Allocator {
+    void *context;
+    void *(*allocate)(void *context, size_t size);
+    void *(*allocateZeroed)(void *context, size_t numberOfMembers, size_t memberSize);
+    void *(*reallocate)(void *context, void *memory, size_t newSize);
+    void *(*allocateAligned)(void *context, size_t alignment, size_t size);
+    void (*release)(void *context, void *memory);
+};
+
+/**
+ * Routes the traced calls of every module to allocator, the trace stays the same.
+ * Every block is released by the allocator which allocated it wherever it is freed, blocks reallocated by a module
+ * using another allocator are moved; blocks not allocated through traced calls are left to the standard allocators.
+ *
+ * @attention must be called before the first traced allocation, otherwise execution is terminated through
+ * Panic_terminate. Blocks of a custom allocator must not reach untraced code freeing them.
+ *
+ * @param allocator The allocator, copied; if NULL the standard allocators are restored.
+ */
+extern void Watchdog_setAllocator(const struct Watchdog_Allocator *allocator);
+
+/**
+ * Same as Watchdog_setAllocator, for the traced calls of a module only, see WATCHDOG_MODULE.
+ *
+ * @param module The module id in range [0, 31].
+ * @param allocator The allocator, copied; if NULL the standard allocators are restored.
+ */
+extern void Watchdog_setModuleAllocator(int module, const struct Watchdog_Allocator *allocator);
+
+/**
+ * Creates a bump allocator, for batch jobs: blocks are carved in order out of a region of capacity bytes, reserved
+ * upfront and committed by the system as it is touched, and are never released; blocks exceeding the region are
+ * served by the standard allocators. Thread-safe, lock-free.
+ *
+ * @param capacity The size of the region in bytes.
+ * @return The allocator, which is never destroyed.
+ */
+extern struct Watchdog_Allocator Watchdog_newArenaAllocator(size_t capacity)
+__attribute__((__warn_unused_result__));
+
+/**
+ * Creates a size-class allocator: blocks up to 32 KiB are rounded up to one of 40 classes (multiples of 16 bytes up
+ * to 128, then 4 per power of 2) and carved out of 64 KiB slabs, freed blocks are kept on a list per class and
+ * slabs are never returned to the system. Larger blocks are served by the standard allocators.
+ * Thread-safe, with a lock per class.
+ *
+ * @return The allocator, which is never destroyed.
+ */
+extern struct Watchdog_Allocator Watchdog_newSlabAllocator(void)
+__attribute__((__warn_unused_result__));
+
+/**
+ * Type signature of the callback to be executed when a heap budget is exceeded.
+ *
+ * @param message Describes the exceeded budget and lists the sites holding most live bytes.
+ */
+typedef void (*Watchdog_BudgetCallback)(const char *message);
+
+/**
+ * Registers a callback to execute when a heap budget is exceeded.
+ * If no callback is registered, execution is terminated through Panic_terminate.
+ * The callback is executed once per breach, it is executed again only after usage went back within the limits.
+ *
+ * @param callback The callback to be executed, if NULL the default behaviour is restored.
+ * @return The previous registered callback if any else NULL.
+ */
+extern Watchdog_BudgetCallback Watchdog_registerBudgetCallback(Watchdog_BudgetCallback callback);
+
+/**
+ * Sets the limits on the live traced bytes and blocks of the whole process.
+ * The limit is checked against per-thread counters which are merged in batches, so it may be exceeded by a small
+ * amount per thread before being detected.
+ *
+ * @param maxBytes The max number of live bytes, 0 means unlimited.
+ * @param maxBlocks The max number of live blocks, 0 means unlimited.
+ */
+extern void Watchdog_setGlobalBudget(size_t maxBytes, size_t maxBlocks);
+
+/**
+ * Sets the limits on the live traced bytes and blocks allocated by a module, see WATCHDOG_MODULE.
+ *
+ * @param module The module id in range [0, 31].
+ * @param maxBytes The max number of live bytes, 0 means unlimited.
+ * @param maxBlocks The max number of live blocks, 0 means unlimited.
+ */
+extern void Watchdog_setModuleBudget(int module, size_t maxBytes, size_t maxBlocks);
+
+/**
+ * Sets the limits on the live traced bytes and blocks allocated by every single site.
+ *
+ * @param maxBytes The max number of live bytes, 0 means unlimited.
+ * @param maxBlocks The max number of live blocks, 0 means unlimited.
+ */
+extern void Watchdog_setSiteBudget(size_t maxBytes, size_t maxBlocks);
 
 /*
  * Macros
  */
-#if WATCHDOG_FORCE_OVERRIDE || !defined(NDEBUG)
+#if WATCHDOG_FORCE_OVERRIDE || WATCHDOG_RUNTIME_SWITCH || !defined(NDEBUG)
 #   if WATCHDOG_HAS_C11_SUPPORT
 #       undef aligned_alloc
 #       define aligned_alloc(alignment, size)   Watchdog_aligned_alloc((alignment), (size))
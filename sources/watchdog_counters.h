@@ -0,0 +1,75 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * Shared counters
+ *
+ * The layout of the shared memory region published by Watchdog_shareCounters, named "/watchdog-<PID>" after the
+ * process which created it (see shm_open). Every process of the tree owns a slot holding the live and cumulative
+ * counters of its sites, which it updates with relaxed atomics; readers map the region read-only, e.g. watchdog-top.
+ *
+ * A slot belongs to its process while PID is not 0; slots of processes which died without releasing them may be
+ * taken by new ones. Sites are appended to a slot and never removed, readers must load sitesLength with acquire
+ * semantics before reading sites. The first site of every slot accounts the sites exceeding the capacity of the slot.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define WATCHDOG_COUNTERS_MAGIC         0x57444331u     // "WDC1", stored once the region is ready
+#define WATCHDOG_COUNTERS_NAME_FORMAT   "/watchdog-%d"
+#define WATCHDOG_COUNTERS_PROCESSES     256
+#define WATCHDOG_COUNTERS_SITES         1024            // per process, including the first one
+#define WATCHDOG_COUNTERS_FILE_SIZE     64              // including the null terminator, long paths keep their tail
+#define WATCHDOG_COUNTERS_FUNC_SIZE     24              // including the null terminator
+
+struct Watchdog_CounterSite {
+    char file[WATCHDOG_COUNTERS_FILE_SIZE];
+    char func[WATCHDOG_COUNTERS_FUNC_SIZE];
+    int line;
+    int module;
+    atomic_llong liveBytes;
+    atomic_llong liveBlocks;
+    atomic_ullong allocatedBytes;   // since the process started, or since it was forked
+    atomic_ullong allocations;      // as above
+};
+
+struct Watchdog_CounterProcess {
+    atomic_int PID;
+    int parentPID;
+    atomic_size_t sitesLength;
+    struct Watchdog_CounterSite sites[WATCHDOG_COUNTERS_SITES];
+};
+
+struct Watchdog_Counters {
+    atomic_uint magic;
+    int rootPID;
+    struct Watchdog_CounterProcess processes[WATCHDOG_COUNTERS_PROCESSES];
+};
@@ -0,0 +1,13 @@
+message("tests@${CMAKE_CURRENT_LIST_DIR} using: ${CMAKE_CURRENT_LIST_FILE}")
+
+# Golden output of the event formatter, which is private to the library: its translation unit is compiled in
+add_executable(format_test ${CMAKE_CURRENT_LIST_DIR}/format_test.c)
+target_compile_definitions(format_test PRIVATE WATCHDOG_FORCE_OVERRIDE=0)
+target_link_libraries(format_test PRIVATE panic process Threads::Threads)
+add_test(NAME format COMMAND format_test ${CMAKE_CURRENT_LIST_DIR}/format.expected)
+
+add_executable(format_test_thread_names ${CMAKE_CURRENT_LIST_DIR}/format_test.c)
+target_compile_definitions(format_test_thread_names PRIVATE WATCHDOG_FORCE_OVERRIDE=0 WATCHDOG_THREAD_NAMES=1)
+target_link_libraries(format_test_thread_names PRIVATE panic process Threads::Threads)
+add_test(NAME format_thread_names
+         COMMAND format_test_thread_names ${CMAKE_CURRENT_LIST_DIR}/format_thread_names.expected)
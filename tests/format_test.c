@@ -0,0 +1,117 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Checks that events are formatted byte for byte as the checked-in expected output: NULL and relocated addresses,
+ * edge values of every field and, when built with WATCHDOG_THREAD_NAMES, thread names. The values fit in 32 bits
+ * wherever the field is as wide as a pointer, so that the expected output holds on any target.
+ * The formatter is private to the library, which is compiled into the test for this reason.
+ *
+ * Usage: format_test expected
+ */
+
+#include "watchdog.c"
+
+#include <limits.h>
+
+#define EXPECTED_SIZE   8192
+
+#define SITE(file_, func_, line_) \
+        {.file=(file_), .func=(func_), .fileLength=sizeof(file_) - 1, .funcLength=sizeof(func_) - 1, .line=(line_)}
+
+static const struct Watchdog_Site gTestSites[] = {
+        SITE("main.c", "main", 42),
+        SITE("", "", 0),
+        SITE("/a/rather/long/path/to/some/deeply/nested/directory/of/the/project/sources/module.c",
+             "Module_someRatherLongFunctionName", 2147483647),
+        SITE("negative.c", "f", -1),
+};
+
+static const struct Watchdog_Event gTestEvents[] = {
+        {.PID=1234, .parentPID=1, .TID=1234, .threadName="main", .site=&gTestSites[0],
+                .call=WATCHDOG_CALL_MALLOC, .address=0x7f001000, .size=100,
+                .timestamp=1700000000, .clock=123456789, .sequence=0},
+        // failed allocations report NULL as %p does
+        {.PID=1234, .parentPID=1, .TID=1235, .threadName="", .site=&gTestSites[1],
+                .call=WATCHDOG_CALL_CALLOC, .address=0, .size=0,
+                .timestamp=0, .clock=0, .sequence=1},
+        {.PID=1234, .parentPID=1, .TID=1236, .threadName="worker-15", .site=&gTestSites[2],
+                .call=WATCHDOG_CALL_REALLOC, .relocated=0x1000, .address=0x2000, .size=4096, .tag=7,
+                .timestamp=1700000001, .clock=999999999999, .sequence=2},
+        {.PID=9, .parentPID=10, .TID=99, .threadName="pool/worker-1", .site=&gTestSites[3],
+                .call=WATCHDOG_CALL_FREE, .address=0x10, .size=0,
+                .timestamp=100, .clock=-1, .sequence=10000000000000000000ULL},
+        // the widest values of every field
+        {.PID=2147483647, .parentPID=0, .TID=2147483647, .threadName="main", .site=&gTestSites[2],
+                .call=WATCHDOG_CALL_REALLOC, .relocated=0x1, .address=0xffffffff, .size=4294967295U,
+                .tag=UINT32_MAX, .timestamp=2147483647, .clock=LLONG_MIN, .sequence=ULLONG_MAX},
+        {.PID=-2147483647 - 1, .parentPID=-1, .TID=100, .threadName="main", .site=&gTestSites[0],
+                .call=WATCHDOG_CALL_ALIGNED_ALLOC, .address=0x80000000, .size=1,
+                .tag=1, .timestamp=1, .clock=LLONG_MAX, .sequence=9},
+};
+
+int main(int argc, char **argv) {
+    static char expected[EXPECTED_SIZE], actual[EXPECTED_SIZE], scratch[EXPECTED_SIZE];
+    size_t expectedLength, actualLength = 0;
+
+    if (2 != argc) {
+        fprintf(stderr, "Usage: %s expected\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    FILE *stream = fopen(argv[1], "rb");
+    if (NULL == stream) {
+        fprintf(stderr, "Unable to open: %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    expectedLength = fread(expected, 1, sizeof(expected), stream);
+    fclose(stream);
+
+    for (size_t i = 0; i < sizeof(gTestEvents) / sizeof(gTestEvents[0]); i++) {
+        const int length = Watchdog_Event_format(&gTestEvents[i], actual + actualLength,
+                                                 sizeof(actual) - actualLength);
+        if (length < 0 || (size_t) length >= sizeof(actual) - actualLength) {
+            fprintf(stderr, "Event %zu does not fit\n", i);
+            return EXIT_FAILURE;
+        }
+        // callers retry with the returned length when the record may not fit, it must be large enough
+        const int bound = Watchdog_Event_format(&gTestEvents[i], scratch, (size_t) length);
+        if (bound <= length) {
+            fprintf(stderr, "Event %zu: bound %d for a record of %d bytes\n", i, bound, length);
+            return EXIT_FAILURE;
+        }
+        actualLength += (size_t) length;
+    }
+
+    for (size_t i = 0; i < actualLength || i < expectedLength; i++) {
+        if (i >= actualLength || i >= expectedLength || actual[i] != expected[i]) {
+            fprintf(stderr, "Output differs from %s at byte %zu\n--- expected\n%.*s--- actual\n%.*s",
+                    argv[1], i, (int) expectedLength, expected, (int) actualLength, actual);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,33 @@
+set(ARCHIVE_NAME watchdog_trace)
+message("${ARCHIVE_NAME}@${CMAKE_CURRENT_LIST_DIR} using: ${CMAKE_CURRENT_LIST_FILE}")
+
+add_library(${ARCHIVE_NAME} ${CMAKE_CURRENT_LIST_DIR}/trace.h ${CMAKE_CURRENT_LIST_DIR}/trace.c)
+target_link_libraries(${ARCHIVE_NAME} PRIVATE error)
+
+# Offline tools
+add_executable(watchdog-merge ${CMAKE_CURRENT_LIST_DIR}/merge.c)
+target_link_libraries(watchdog-merge PRIVATE ${ARCHIVE_NAME} panic error)
+
+add_executable(watchdog-index ${CMAKE_CURRENT_LIST_DIR}/index.c)
+target_link_libraries(watchdog-index PRIVATE ${ARCHIVE_NAME} panic error)
+
+add_executable(watchdog-query ${CMAKE_CURRENT_LIST_DIR}/query.c)
+target_link_libraries(watchdog-query PRIVATE ${ARCHIVE_NAME} panic error)
+
+add_executable(watchdog-diff ${CMAKE_CURRENT_LIST_DIR}/diff.c)
+target_link_libraries(watchdog-diff PRIVATE ${ARCHIVE_NAME} panic error)
+
+add_executable(watchdog-export ${CMAKE_CURRENT_LIST_DIR}/export.c)
+target_link_libraries(watchdog-export PRIVATE ${ARCHIVE_NAME} panic error)
+
+add_executable(watchdog-tags ${CMAKE_CURRENT_LIST_DIR}/tags.c)
+target_link_libraries(watchdog-tags PRIVATE ${ARCHIVE_NAME} panic error)
+
+add_executable(watchdog-symbolize ${CMAKE_CURRENT_LIST_DIR}/symbolize.c)
+target_link_libraries(watchdog-symbolize PRIVATE ${ARCHIVE_NAME} panic error)
+
+add_executable(watchdog-replay ${CMAKE_CURRENT_LIST_DIR}/replay.c)
+target_link_libraries(watchdog-replay PRIVATE ${ARCHIVE_NAME} panic error Threads::Threads)
+
+add_executable(watchdog-top ${CMAKE_CURRENT_LIST_DIR}/top.c)
+target_link_libraries(watchdog-top PRIVATE panic)
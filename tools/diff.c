@@ -0,0 +1,178 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Ranks the sites of a trace by net growth between two points in time, either two snapshots written by the traced
+ * process (see Watchdog_snapshot) or the live blocks at two clocks, rebuilt through the index of the trace.
+ *
+ * Usage: watchdog-diff trace --snapshots BEFORE AFTER [--pid PID]
+ *        watchdog-diff trace --clocks BEFORE AFTER
+ *
+ * Prints the sites which changed, ranked by net growth in bytes, then the new sites and the vanished ones,
+ * followed by a summary. Without --pid, snapshots of every process sharing the trace are summed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <panic/panic.h>
+#include "trace.h"
+
+static void loadSnapshots(const char *path, long long PID, long long before, long long after,
+                          struct TraceReader *reader, struct TraceSnapshot *snapshots);
+
+static void loadClocks(const char *path, long long before, long long after,
+                       struct TraceIndex *index, struct TraceReader *reader, struct TraceSnapshot *snapshots);
+
+static void printDiff(const struct TraceSnapshot *snapshots, const char *unit, long long before, long long after);
+
+int main(int argc, char *argv[]) {
+    struct TraceIndex index = {0};
+    struct TraceReader reader;
+    struct TraceSnapshot snapshots[2];
+    long long PID = -1;
+
+    if (argc < 5 || (0 != strcmp("--snapshots", argv[2]) && 0 != strcmp("--clocks", argv[2]))) {
+        fprintf(stderr, "Usage: %s trace --snapshots BEFORE AFTER [--pid PID]\n"
+                        "       %s trace --clocks BEFORE AFTER\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+    const bool isSnapshots = 0 == strcmp("--snapshots", argv[2]);
+    const long long before = strtoll(argv[3], NULL, 10), after = strtoll(argv[4], NULL, 10);
+    for (int i = 5; i < argc; i += 2) {
+        if (isSnapshots && i + 1 < argc && 0 == strcmp("--pid", argv[i])) {
+            PID = strtoll(argv[i + 1], NULL, 10);
+        } else {
+            Panic_terminate("Unknown option: %s", argv[i]);
+        }
+    }
+
+    TraceSnapshot_init(&snapshots[0]);
+    TraceSnapshot_init(&snapshots[1]);
+    if (isSnapshots) {
+        loadSnapshots(argv[1], PID, before, after, &reader, snapshots);
+    } else {
+        loadClocks(argv[1], before, after, &index, &reader, snapshots);
+    }
+    printDiff(snapshots, isSnapshots ? "snapshot" : "clock", before, after);
+
+    // sites refer to the mappings of the trace and of the index
+    TraceSnapshot_teardown(&snapshots[0]);
+    TraceSnapshot_teardown(&snapshots[1]);
+    TraceReader_close(&reader);
+    if (!isSnapshots) {
+        TraceIndex_close(&index);
+    }
+    return 0;
+}
+
+void loadSnapshots(const char *const path, const long long PID, const long long before, const long long after,
+                   struct TraceReader *const reader, struct TraceSnapshot *const snapshots) {
+    struct TraceRecord record;
+    bool isFound[2] = {false, false};
+
+    if (Ok != TraceReader_open(reader, path)) {
+        Panic_terminate("Unable to open trace: %s", path);
+    }
+    while (TraceReader_next(reader, &record)) {
+        const char *kind;
+        size_t kindLength;
+        long long id, recordPID;
+        if (record.isEvent || !TraceRecord_getInteger(&record, "snapshot", &id) || (id != before && id != after) ||
+            !TraceRecord_getInteger(&record, "PID", &recordPID) || (PID >= 0 && recordPID != PID)) {
+            continue;
+        }
+        if (TraceRecord_getString(&record, "record", &kind, &kindLength) &&
+            8 == kindLength && 0 == memcmp("snapshot", kind, 8)) {
+            isFound[0] = isFound[0] || id == before;
+            isFound[1] = isFound[1] || id == after;
+            if (PID >= 0 && isFound[0] && isFound[1]) {
+                break;  // a process writes the site records of a snapshot before its summary
+            }
+            continue;
+        }
+        for (size_t i = 0; i < 2; i++) {
+            if (Ok != TraceSnapshot_apply(&snapshots[i], &record, (0 == i) ? before : after)) {
+                Panic_terminate("Out of memory");
+            }
+        }
+    }
+    if (!isFound[0] || !isFound[1]) {
+        Panic_terminate("Snapshot not found: %lld", isFound[0] ? after : before);
+    }
+}
+
+void loadClocks(const char *const path, const long long before, const long long after,
+                struct TraceIndex *const index, struct TraceReader *const reader, struct TraceSnapshot *const snapshots) {
+    struct TraceHeap heap;
+
+    const Error error = TraceIndex_open(index, path);
+    if (Ok != error) {
+        Panic_terminate("Unable to index trace: %s (%s)", path, Error_explain(error));
+    }
+    if (Ok != TraceReader_open(reader, path)) {
+        Panic_terminate("Unable to open trace: %s", path);
+    }
+    TraceHeap_init(&heap);
+    for (size_t i = 0; i < 2; i++) {
+        if (Ok != TraceIndex_rebuild(index, reader, (0 == i) ? before : after, &heap, NULL) ||
+            Ok != TraceSnapshot_addHeap(&snapshots[i], &heap)) {
+            Panic_terminate("Out of memory");
+        }
+    }
+    TraceHeap_teardown(&heap);
+}
+
+void printDiff(const struct TraceSnapshot *const snapshots, const char *const unit,
+               const long long before, const long long after) {
+    static const char *const changes[] = {
+            [TRACE_SITE_CHANGED]="changed", [TRACE_SITE_NEW]="new", [TRACE_SITE_VANISHED]="vanished",
+    };
+    struct TraceSiteDelta *deltas;
+    size_t length, counts[3] = {0};
+
+    if (Ok != TraceSnapshot_diff(&snapshots[0], &snapshots[1], &deltas, &length)) {
+        Panic_terminate("Out of memory");
+    }
+    for (size_t i = 0; i < length; i++) {
+        const struct TraceSiteDelta *delta = &deltas[i];
+        counts[delta->change] += 1;
+        printf("{\"record\": \"%s\", \"file\": \"%.*s\", \"func\": \"%.*s\", \"line\": %ld, \"bytes\": %lld, \"blocks\": %lld, \"bytesBefore\": %zu, \"bytesAfter\": %zu, \"blocksBefore\": %zu, \"blocksAfter\": %zu}\n",
+               changes[delta->change], (int) delta->site.fileLength, delta->site.file,
+               (int) delta->site.funcLength, delta->site.func, delta->site.line, delta->bytes, delta->blocks,
+               delta->bytesBefore, delta->bytesAfter, delta->blocksBefore, delta->blocksAfter);
+    }
+    printf("{\"record\": \"diff\", \"%sBefore\": %lld, \"%sAfter\": %lld, \"bytes\": %lld, \"blocks\": %lld, \"bytesBefore\": %zu, \"bytesAfter\": %zu, \"blocksBefore\": %zu, \"blocksAfter\": %zu, \"changedSites\": %zu, \"newSites\": %zu, \"vanishedSites\": %zu}\n",
+           unit, before, unit, after,
+           (long long) TraceSnapshot_bytes(&snapshots[1]) - (long long) TraceSnapshot_bytes(&snapshots[0]),
+           (long long) TraceSnapshot_blocks(&snapshots[1]) - (long long) TraceSnapshot_blocks(&snapshots[0]),
+           TraceSnapshot_bytes(&snapshots[0]), TraceSnapshot_bytes(&snapshots[1]),
+           TraceSnapshot_blocks(&snapshots[0]), TraceSnapshot_blocks(&snapshots[1]),
+           counts[TRACE_SITE_CHANGED], counts[TRACE_SITE_NEW], counts[TRACE_SITE_VANISHED]);
+    free(deltas);
+}
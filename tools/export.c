@@ -0,0 +1,337 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Exports the allocation profile of traces for profiling tools: pprof profiles or folded stacks for flamegraphs.
+ *
+ * Usage: watchdog-export [--format pprof|folded] [--type TYPE] [--snapshot N] [-o output] trace...
+ *
+ * Profiles hold the alloc_space, alloc_objects, inuse_space and inuse_objects of every site, either computed
+ * replaying the events of the traces or, with --snapshot, read from the snapshots written by the traced processes.
+ * Traces are streamed, memory depends on the number of live blocks and sites only.
+ * Replaying events, blocks moved by realloc stay with the site which allocated them (as for watchdog-query), while
+ * snapshots account them to the site of the realloc, as the traced process does.
+ *
+ * pprof profiles are written as uncompressed profile.proto messages, which pprof reads as they are.
+ * Folded stacks have three frames per site (file, function and line) followed by the value of TYPE,
+ * alloc_space by default.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <panic/panic.h>
+#include "trace.h"
+
+#define OUTPUT_BUFFER_SIZE  (1u << 20)
+
+enum SampleType {
+    ALLOC_OBJECTS,
+    ALLOC_SPACE,
+    INUSE_OBJECTS,
+    INUSE_SPACE,
+    SAMPLE_TYPES_COUNT,
+};
+
+static const char *const gSampleTypes[SAMPLE_TYPES_COUNT][2] = {
+        [ALLOC_OBJECTS]={"alloc_objects", "count"},
+        [ALLOC_SPACE]={"alloc_space", "bytes"},
+        [INUSE_OBJECTS]={"inuse_objects", "count"},
+        [INUSE_SPACE]={"inuse_space", "bytes"},
+};
+
+/*
+ * Message
+ *
+ * A protobuf message being encoded, nested messages are encoded apart and then appended with their length.
+ */
+struct Message {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+};
+
+static void Message_reserve(struct Message *self, size_t size);
+
+static void Message_varint(struct Message *self, uint64_t value);
+
+static void Message_integer(struct Message *self, unsigned field, uint64_t value);
+
+static void Message_bytes(struct Message *self, unsigned field, const void *data, size_t size);
+
+static void Message_message(struct Message *self, unsigned field, const struct Message *message);
+
+static void Message_write(const struct Message *self, FILE *stream);
+
+static void load(struct TraceSnapshot *profile, struct TraceReader *readers, const char *const paths[], size_t count,
+                 long long snapshot);
+
+static size_t getValue(const struct TraceSiteUsage *usage, enum SampleType type);
+
+static void writePprof(const struct TraceSnapshot *profile, FILE *output);
+
+static void writeFolded(const struct TraceSnapshot *profile, enum SampleType type, FILE *output);
+
+int main(int argc, char *argv[]) {
+    struct TraceSnapshot profile;
+    FILE *output = stdout;
+    const char *format = "pprof";
+    enum SampleType type = ALLOC_SPACE;
+    long long snapshot = -1;
+    int first = 1;
+
+    for (; first + 1 < argc && 0 == strncmp("-", argv[first], 1); first += 2) {
+        if (0 == strcmp("--format", argv[first])) {
+            format = argv[first + 1];
+        } else if (0 == strcmp("--type", argv[first])) {
+            for (type = 0; type < SAMPLE_TYPES_COUNT && 0 != strcmp(gSampleTypes[type][0], argv[first + 1]); type++) {}
+            if (SAMPLE_TYPES_COUNT == type) {
+                Panic_terminate("Unknown sample type: %s", argv[first + 1]);
+            }
+        } else if (0 == strcmp("--snapshot", argv[first])) {
+            snapshot = strtoll(argv[first + 1], NULL, 10);
+        } else if (0 == strcmp("-o", argv[first])) {
+            output = fopen(argv[first + 1], "w");
+            if (NULL == output) {
+                Panic_terminate("Unable to open file: %s", argv[first + 1]);
+            }
+        } else {
+            Panic_terminate("Unknown option: %s", argv[first]);
+        }
+    }
+    if (first >= argc || (0 != strcmp("pprof", format) && 0 != strcmp("folded", format))) {
+        fprintf(stderr, "Usage: %s [--format pprof|folded] [--type TYPE] [--snapshot N] [-o output] trace...\n",
+                argv[0]);
+        return 1;
+    }
+    setvbuf(output, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    // sites refer to the traces, readers are closed once the profile is written
+    struct TraceReader *readers = calloc((size_t) (argc - first), sizeof(readers[0]));
+    if (NULL == readers) {
+        Panic_terminate("Out of memory");
+    }
+    TraceSnapshot_init(&profile);
+    load(&profile, readers, (const char *const *) argv + first, (size_t) (argc - first), snapshot);
+    if (0 == strcmp("pprof", format)) {
+        writePprof(&profile, output);
+    } else {
+        writeFolded(&profile, type, output);
+    }
+    if (0 != fclose(output)) {
+        Panic_terminate("Unable to write the profile");
+    }
+
+    TraceSnapshot_teardown(&profile);
+    for (int i = first; i < argc; i++) {
+        TraceReader_close(&readers[i - first]);
+    }
+    free(readers);
+    return 0;
+}
+
+void load(struct TraceSnapshot *const profile, struct TraceReader *const readers, const char *const paths[],
+          const size_t count, const long long snapshot) {
+    struct TraceRecord record;
+    struct TraceHeap heap;
+
+    TraceHeap_init(&heap);
+    for (size_t i = 0; i < count; i++) {
+        if (Ok != TraceReader_open(&readers[i], paths[i])) {
+            Panic_terminate("Unable to open trace: %s", paths[i]);
+        }
+        // blocks are keyed by PID as well, as traces of the collector process interleave processes
+        while (TraceReader_next(&readers[i], &record)) {
+            const Error error = (snapshot >= 0) ?
+                                TraceSnapshot_apply(profile, &record, snapshot) :
+                                (Ok == TraceHeap_apply(&heap, &record)) ?
+                                TraceSnapshot_addEvent(profile, &record) : OutOfMemory;
+            if (Ok != error) {
+                Panic_terminate("Out of memory");
+            }
+        }
+        if (Ok != TraceSnapshot_addHeap(profile, &heap)) {
+            Panic_terminate("Out of memory");
+        }
+        TraceHeap_clear(&heap);
+    }
+    TraceHeap_teardown(&heap);
+}
+
+size_t getValue(const struct TraceSiteUsage *const usage, const enum SampleType type) {
+    switch (type) {
+        case ALLOC_OBJECTS:
+            return usage->allocations;
+        case ALLOC_SPACE:
+            return usage->allocatedBytes;
+        case INUSE_OBJECTS:
+            return usage->blocks;
+        case INUSE_SPACE:
+        default:
+            return usage->bytes;
+    }
+}
+
+void writePprof(const struct TraceSnapshot *const profile, FILE *const output) {
+    // profile.proto field numbers
+    enum {
+        PROFILE_SAMPLE_TYPE = 1, PROFILE_SAMPLE = 2, PROFILE_LOCATION = 4, PROFILE_FUNCTION = 5,
+        PROFILE_STRING_TABLE = 6, PROFILE_PERIOD_TYPE = 11, PROFILE_PERIOD = 12, PROFILE_DEFAULT_SAMPLE_TYPE = 14,
+        VALUE_TYPE_TYPE = 1, VALUE_TYPE_UNIT = 2,
+        SAMPLE_LOCATION_ID = 1, SAMPLE_VALUE = 2,
+        LOCATION_ID = 1, LOCATION_LINE = 4,
+        LINE_FUNCTION_ID = 1, LINE_LINE = 2,
+        FUNCTION_ID = 1, FUNCTION_NAME = 2, FUNCTION_SYSTEM_NAME = 3, FUNCTION_FILENAME = 4,
+    };
+    // fixed strings come first: "" (mandatory), then type and unit of every sample type, then func and file of sites
+    const uint64_t fixedStrings = 1 + 2 * SAMPLE_TYPES_COUNT;
+    struct Message message = {0}, nested = {0}, inner = {0};
+    const struct TraceSiteUsage *usage;
+    size_t cursor = 0;
+    uint64_t id = 0;
+
+    Message_bytes(&message, PROFILE_STRING_TABLE, "", 0);
+    for (size_t i = 0; i < SAMPLE_TYPES_COUNT; i++) {
+        Message_bytes(&message, PROFILE_STRING_TABLE, gSampleTypes[i][0], strlen(gSampleTypes[i][0]));
+        Message_bytes(&message, PROFILE_STRING_TABLE, gSampleTypes[i][1], strlen(gSampleTypes[i][1]));
+        nested.length = 0;
+        Message_integer(&nested, VALUE_TYPE_TYPE, 1 + 2 * i);
+        Message_integer(&nested, VALUE_TYPE_UNIT, 2 + 2 * i);
+        Message_message(&message, PROFILE_SAMPLE_TYPE, &nested);
+    }
+    nested.length = 0;
+    Message_integer(&nested, VALUE_TYPE_TYPE, 1 + 2 * INUSE_SPACE);
+    Message_integer(&nested, VALUE_TYPE_UNIT, 2 + 2 * INUSE_SPACE);
+    Message_message(&message, PROFILE_PERIOD_TYPE, &nested);
+    Message_integer(&message, PROFILE_PERIOD, 1);
+    Message_integer(&message, PROFILE_DEFAULT_SAMPLE_TYPE, 1 + 2 * INUSE_SPACE);
+    Message_write(&message, output);
+
+    // a sample, a location and a function per site, written as they come so that memory stays bounded
+    while (NULL != (usage = TraceSnapshot_next(profile, &cursor))) {
+        const uint64_t name = fixedStrings + 2 * id, fileName = name + 1;
+        id += 1;
+        message.length = 0;
+
+        nested.length = 0;
+        Message_integer(&nested, SAMPLE_LOCATION_ID, id);
+        inner.length = 0;
+        for (size_t i = 0; i < SAMPLE_TYPES_COUNT; i++) {
+            Message_varint(&inner, getValue(usage, i));
+        }
+        Message_message(&nested, SAMPLE_VALUE, &inner);     // packed
+        Message_message(&message, PROFILE_SAMPLE, &nested);
+
+        nested.length = 0;
+        Message_integer(&nested, LOCATION_ID, id);
+        inner.length = 0;
+        Message_integer(&inner, LINE_FUNCTION_ID, id);
+        Message_integer(&inner, LINE_LINE, (uint64_t) usage->site.line);
+        Message_message(&nested, LOCATION_LINE, &inner);
+        Message_message(&message, PROFILE_LOCATION, &nested);
+
+        nested.length = 0;
+        Message_integer(&nested, FUNCTION_ID, id);
+        Message_integer(&nested, FUNCTION_NAME, name);
+        Message_integer(&nested, FUNCTION_SYSTEM_NAME, name);
+        Message_integer(&nested, FUNCTION_FILENAME, fileName);
+        Message_message(&message, PROFILE_FUNCTION, &nested);
+
+        Message_bytes(&message, PROFILE_STRING_TABLE, usage->site.func, usage->site.funcLength);
+        Message_bytes(&message, PROFILE_STRING_TABLE, usage->site.file, usage->site.fileLength);
+        Message_write(&message, output);
+    }
+
+    free(message.data);
+    free(nested.data);
+    free(inner.data);
+}
+
+void writeFolded(const struct TraceSnapshot *const profile, const enum SampleType type, FILE *const output) {
+    const struct TraceSiteUsage *usage;
+    size_t cursor = 0;
+    while (NULL != (usage = TraceSnapshot_next(profile, &cursor))) {
+        const size_t value = getValue(usage, type);
+        if (value > 0) {
+            fprintf(output, "%.*s;%.*s;%.*s:%ld %zu\n",
+                    (int) usage->site.fileLength, usage->site.file, (int) usage->site.funcLength, usage->site.func,
+                    (int) usage->site.fileLength, usage->site.file, usage->site.line, value);
+        }
+    }
+}
+
+/*
+ * Message
+ */
+void Message_reserve(struct Message *const self, const size_t size) {
+    if (self->length + size > self->capacity) {
+        size_t capacity = (0 == self->capacity) ? 256 : self->capacity;
+        while (self->length + size > capacity) {
+            capacity *= 2;
+        }
+        uint8_t *data = realloc(self->data, capacity);
+        if (NULL == data) {
+            Panic_terminate("Out of memory");
+        }
+        self->data = data;
+        self->capacity = capacity;
+    }
+}
+
+void Message_varint(struct Message *const self, uint64_t value) {
+    Message_reserve(self, 10);
+    do {
+        self->data[self->length++] = (uint8_t) ((value & 0x7F) | ((value > 0x7F) ? 0x80 : 0));
+        value >>= 7;
+    } while (0 != value);
+}
+
+void Message_integer(struct Message *const self, const unsigned field, const uint64_t value) {
+    Message_varint(self, (uint64_t) field << 3);    // wire type 0: varint
+    Message_varint(self, value);
+}
+
+void Message_bytes(struct Message *const self, const unsigned field, const void *const data, const size_t size) {
+    Message_varint(self, ((uint64_t) field << 3) | 2);  // wire type 2: length-delimited
+    Message_varint(self, size);
+    Message_reserve(self, size);
+    if (size > 0) {
+        memcpy(self->data + self->length, data, size);
+        self->length += size;
+    }
+}
+
+void Message_message(struct Message *const self, const unsigned field, const struct Message *const message) {
+    Message_bytes(self, field, message->data, message->length);
+}
+
+void Message_write(const struct Message *const self, FILE *const stream) {
+    if (self->length > 0) {
+        fwrite(self->data, 1, self->length, stream);
+    }
+}
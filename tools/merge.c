@@ -0,0 +1,74 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Merges many traces, e.g. the shards written by different processes or threads, into a single time-ordered trace.
+ *
+ * Usage: watchdog-merge [-o output] trace...
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <panic/panic.h>
+#include "trace.h"
+
+#define OUTPUT_BUFFER_SIZE  (1u << 20)
+
+int main(int argc, char *argv[]) {
+    struct TraceMerger merger;
+    struct TraceRecord record;
+    FILE *output = stdout;
+    int first = 1;
+
+    if (argc > 2 && 0 == strcmp("-o", argv[1])) {
+        output = fopen(argv[2], "w");
+        if (NULL == output) {
+            Panic_terminate("Unable to open file: %s", argv[2]);
+        }
+        first = 3;
+    }
+    if (first >= argc) {
+        fprintf(stderr, "Usage: %s [-o output] trace...\n", argv[0]);
+        return 1;
+    }
+    setvbuf(output, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    const Error error = TraceMerger_open(&merger, (const char *const *) argv + first, (size_t) (argc - first));
+    if (Ok != error) {
+        Panic_terminate("Unable to open traces: %s", Error_explain(error));
+    }
+    while (TraceMerger_next(&merger, &record)) {
+        fwrite(record.line, 1, record.length, output);
+        fputc('\n', output);
+    }
+    TraceMerger_close(&merger);
+
+    if (0 != fclose(output)) {
+        Panic_terminate("Unable to write the merged trace");
+    }
+    return 0;
+}
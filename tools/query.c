@@ -0,0 +1,187 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Answers point queries on a trace through its index, reading only the chunks which may be relevant.
+ *
+ * Usage: watchdog-query trace --at CLOCK
+ *        watchdog-query trace [--from CLOCK] [--to CLOCK] [--address ADDRESS] [--site FILE:LINE]
+ *
+ * The first form prints the blocks live at CLOCK followed by a summary, the second one prints the events
+ * matching every given filter.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <inttypes.h>
+#include <panic/panic.h>
+#include "trace.h"
+
+struct Query {
+    long long from;
+    long long to;
+    uintptr_t address;
+    bool hasAddress;
+    struct TraceSite site;
+    uint64_t siteHash;
+    bool hasSite;
+};
+
+static void printLive(struct TraceIndex *index, const char *path, long long clock);
+
+static void printEvents(struct TraceIndex *index, const char *path, const struct Query *query);
+
+static bool matches(const struct Query *query, const struct TraceRecord *record);
+
+int main(int argc, char *argv[]) {
+    struct TraceIndex index;
+    struct Query query = {.from=LLONG_MIN, .to=LLONG_MAX};
+    long long at = 0;
+    bool hasAt = false;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s trace --at CLOCK\n"
+                        "       %s trace [--from CLOCK] [--to CLOCK] [--address ADDRESS] [--site FILE:LINE]\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (0 == strcmp("--at", argv[i])) {
+            at = strtoll(argv[i + 1], NULL, 10);
+            hasAt = true;
+        } else if (0 == strcmp("--from", argv[i])) {
+            query.from = strtoll(argv[i + 1], NULL, 10);
+        } else if (0 == strcmp("--to", argv[i])) {
+            query.to = strtoll(argv[i + 1], NULL, 10);
+        } else if (0 == strcmp("--address", argv[i])) {
+            query.address = (uintptr_t) strtoull(argv[i + 1], NULL, 16);
+            query.hasAddress = true;
+        } else if (0 == strcmp("--site", argv[i])) {
+            const char *separator = strrchr(argv[i + 1], ':');
+            if (NULL == separator) {
+                Panic_terminate("Expected FILE:LINE, got: %s", argv[i + 1]);
+            }
+            query.site = (struct TraceSite) {
+                    .file=argv[i + 1], .fileLength=(size_t) (separator - argv[i + 1]), .line=atol(separator + 1)
+            };
+            query.siteHash = TraceSite_hash(&query.site);
+            query.hasSite = true;
+        } else {
+            Panic_terminate("Unknown option: %s", argv[i]);
+        }
+    }
+
+    const Error error = TraceIndex_open(&index, argv[1]);
+    if (Ok != error) {
+        Panic_terminate("Unable to index trace: %s (%s)", argv[1], Error_explain(error));
+    }
+    if (hasAt) {
+        printLive(&index, argv[1], at);
+    } else {
+        printEvents(&index, argv[1], &query);
+    }
+    TraceIndex_close(&index);
+    return 0;
+}
+
+void printLive(struct TraceIndex *const index, const char *const path, const long long clock) {
+    struct TraceReader reader;
+    struct TraceHeap heap;
+    const struct TraceBlock *block;
+    size_t cursor = 0, replayedChunks = 0;
+
+    if (Ok != TraceReader_open(&reader, path)) {
+        Panic_terminate("Unable to open trace: %s", path);
+    }
+    TraceHeap_init(&heap);
+    if (Ok != TraceIndex_rebuild(index, &reader, clock, &heap, &replayedChunks)) {
+        Panic_terminate("Out of memory");
+    }
+
+    while (NULL != (block = TraceHeap_next(&heap, &cursor))) {
+        printf("{\"PID\": %lld, \"address\": \"0x%" PRIxPTR "\", \"size\": %zu, \"clock\": %lld, \"file\": \"%.*s\", \"func\": \"%.*s\", \"line\": %ld}\n",
+               block->PID, block->address, block->size, block->clock, (int) block->site.fileLength, block->site.file,
+               (int) block->site.funcLength, block->site.func, block->site.line);
+    }
+    printf("{\"record\": \"heap\", \"clock\": %lld, \"blocks\": %zu, \"bytes\": %zu, \"replayedChunks\": %zu}\n",
+           clock, TraceHeap_length(&heap), TraceHeap_bytes(&heap), replayedChunks);
+
+    TraceHeap_teardown(&heap);
+    TraceReader_close(&reader);
+}
+
+void printEvents(struct TraceIndex *const index, const char *const path, const struct Query *const query) {
+    struct TraceReader reader;
+    struct TraceRecord record;
+
+    if (Ok != TraceReader_open(&reader, path)) {
+        Panic_terminate("Unable to open trace: %s", path);
+    }
+    for (size_t i = TraceIndex_findChunk(index, query->from); i < TraceIndex_length(index); i++) {
+        const struct TraceChunk *chunk = TraceIndex_getChunk(index, i);
+        if (chunk->events > 0 && chunk->clockMin > query->to) {
+            break;
+        }
+        if ((query->hasAddress && !TraceChunk_mayContainAddress(chunk, query->address)) ||
+            (query->hasSite && !TraceChunk_mayContainSite(chunk, query->siteHash))) {
+            continue;
+        }
+        TraceReader_seek(&reader, chunk->offset);
+        while (TraceReader_offset(&reader) < chunk->offset + chunk->length && TraceReader_next(&reader, &record)) {
+            if (matches(query, &record)) {
+                printf("%.*s\n", (int) record.length, record.line);
+            }
+        }
+    }
+    TraceReader_close(&reader);
+}
+
+bool matches(const struct Query *const query, const struct TraceRecord *const record) {
+    if (!record->isEvent || record->clock < query->from || record->clock > query->to) {
+        return false;
+    }
+    if (query->hasAddress) {
+        uintptr_t address, from, to;
+        const bool isRelocation = TraceRecord_getAddress(record, "from", &from) &&
+                                  TraceRecord_getAddress(record, "to", &to);
+        if (isRelocation ? (from != query->address && to != query->address) :
+            !(TraceRecord_getAddress(record, "address", &address) && address == query->address)) {
+            return false;
+        }
+    }
+    if (query->hasSite) {
+        struct TraceSite site;
+        if (!TraceRecord_getSite(record, &site) || site.line != query->site.line ||
+            site.fileLength != query->site.fileLength ||
+            0 != memcmp(site.file, query->site.file, site.fileLength)) {
+            return false;
+        }
+    }
+    return true;
+}
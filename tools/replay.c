@@ -0,0 +1,625 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Replays the allocations of traces against the allocator of this process, either the one of the C library or any
+ * allocator loaded through LD_PRELOAD, so that allocators can be compared on the workload of a real program.
+ *
+ * Usage: watchdog-replay [--threads] [--timing] [--pid PID] [-o output] trace...
+ *
+ * Events are loaded upfront into a compact list of operations where recorded addresses are mapped to slots, so that
+ * replaying costs no parsing nor lookups. Calls on blocks unknown to the traces (allocated before tracing started or
+ * by untraced code) are skipped, reallocations of unknown blocks are replayed as allocations. Every allocated page
+ * is written once, so that the peak RSS accounts the memory the program actually used. The alignment of
+ * aligned_alloc, which is not recorded, is the one of the recorded address, at most a page.
+ *
+ * Operations are issued by a single thread as fast as possible, unless:
+ *  --threads   the calls of every recorded thread are issued by a thread of its own, calls on blocks allocated by
+ *              other threads wait for the allocation to be replayed;
+ *  --timing    the recorded gaps between calls are kept.
+ * Traces of many processes are replayed as one, unless --pid selects one of them.
+ *
+ * Prints a latency record per call, with percentiles and a log-linear histogram of nanoseconds (4 buckets per power
+ * of 2, each one labeled by its upper bound), followed by a summary holding the throughput and the peak RSS.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <panic/panic.h>
+#include "trace.h"
+
+#define OUTPUT_BUFFER_SIZE  (1u << 20)
+#define HISTOGRAM_BUCKETS   256
+#define PAGE_SIZE           4096u
+#define NO_SLOT             UINT32_MAX
+
+enum Call {
+    CALL_MALLOC,
+    CALL_CALLOC,
+    CALL_REALLOC,
+    CALL_ALIGNED_ALLOC,
+    CALL_FREE,
+    CALLS_COUNT,
+};
+
+static const char *const gCallNames[CALLS_COUNT] = {
+        [CALL_MALLOC]="malloc",
+        [CALL_CALLOC]="calloc",
+        [CALL_REALLOC]="realloc",
+        [CALL_ALIGNED_ALLOC]="aligned_alloc",
+        [CALL_FREE]="free",
+};
+
+struct Operation {
+    long long clock;        // relative to the first operation
+    size_t size;
+    uint32_t slot;          // of the block returned
+    uint32_t from;          // of the block passed to realloc or free, NO_SLOT if none
+    uint32_t thread;
+    uint8_t call;
+    uint8_t alignmentShift;
+};
+
+/*
+ * Workload
+ *
+ * The operations to replay, along with the tables mapping recorded addresses and threads while loading.
+ */
+struct Mapping {
+    long long PID;
+    uintptr_t address;      // 0 if the entry is empty
+    uint32_t slot;
+};
+
+struct Workload {
+    struct Operation *operations;
+    size_t length;
+    size_t capacity;
+    size_t skipped;
+    long long origin;           // clock of the first operation
+    uint32_t slots;
+    struct Mapping *mappings;
+    size_t mappingsCapacity;
+    size_t mappingsLength;
+    long long (*threads)[2];    // PID and TID of every recorded thread
+    size_t threadsLength;
+    size_t threadsCapacity;
+    size_t lastThread;
+};
+
+static void Workload_load(struct Workload *self, const char *const paths[], size_t count, long long PID);
+
+static void Workload_add(struct Workload *self, const struct TraceRecord *record);
+
+static uint32_t Workload_getThread(struct Workload *self, long long PID, long long TID);
+
+static uint32_t Workload_map(struct Workload *self, long long PID, uintptr_t address);
+
+static uint32_t Workload_unmap(struct Workload *self, long long PID, uintptr_t address);
+
+static size_t Workload_getMapping(const struct Workload *self, long long PID, uintptr_t address);
+
+static size_t Workload_hash(long long PID, uintptr_t address);
+
+/*
+ * Replayer
+ *
+ * Issues the operations of a thread, or all of them, recording the latency of every call.
+ * Blocks and their readiness are shared by every replayer.
+ */
+struct Latency {
+    size_t calls;
+    unsigned long long total;
+    unsigned long long max;
+    size_t histogram[HISTOGRAM_BUCKETS];
+};
+
+struct Replayer {
+    const struct Operation *operations;
+    const uint32_t *indexes;    // of the operations of the replayer, NULL to replay all of them
+    size_t length;
+    void **blocks;
+    atomic_bool *isReady;       // the slot holds its block, only needed when replaying many threads
+    pthread_barrier_t *barrier;
+    long long start;
+    bool isTimed;
+    struct Latency latencies[CALLS_COUNT];
+    pthread_t thread;
+};
+
+static void *Replayer_run(void *self);
+
+static void Replayer_issue(struct Replayer *self, const struct Operation *operation);
+
+static void touch(char *block, size_t size);
+
+static long long now(void);
+
+static size_t getBucket(unsigned long long nanoseconds);
+
+static unsigned long long getLimit(size_t bucket);
+
+static size_t readStatus(const char *key);
+
+static void printLatency(FILE *output, enum Call call, const struct Latency *latency);
+
+int main(int argc, char *argv[]) {
+    struct Workload workload = {0};
+    FILE *output = stdout;
+    bool isThreaded = false, isTimed = false;
+    long long PID = -1;
+    int first = 1;
+
+    for (; first < argc && 0 == strncmp("-", argv[first], 1); first++) {
+        if (0 == strcmp("--threads", argv[first])) {
+            isThreaded = true;
+        } else if (0 == strcmp("--timing", argv[first])) {
+            isTimed = true;
+        } else if (first + 1 < argc && 0 == strcmp("--pid", argv[first])) {
+            PID = strtoll(argv[++first], NULL, 10);
+        } else if (first + 1 < argc && 0 == strcmp("-o", argv[first])) {
+            output = fopen(argv[++first], "w");
+            if (NULL == output) {
+                Panic_terminate("Unable to open file: %s", argv[first]);
+            }
+        } else {
+            Panic_terminate("Unknown option: %s", argv[first]);
+        }
+    }
+    if (first >= argc) {
+        fprintf(stderr, "Usage: %s [--threads] [--timing] [--pid PID] [-o output] trace...\n", argv[0]);
+        return 1;
+    }
+    setvbuf(output, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    Workload_load(&workload, (const char *const *) argv + first, (size_t) (argc - first), PID);
+    free(workload.mappings);
+    workload.mappings = NULL;
+
+    // everything the replay needs is allocated upfront, so that only replayed calls reach the allocator
+    const size_t count = isThreaded ? ((0 < workload.threadsLength) ? workload.threadsLength : 1) : 1;
+    struct Replayer *replayers = calloc(count, sizeof(replayers[0]));
+    void **blocks = calloc((size_t) workload.slots + 1, sizeof(blocks[0]));
+    atomic_bool *isReady = calloc((size_t) workload.slots + 1, sizeof(isReady[0]));
+    uint32_t *indexes = isThreaded ? calloc(workload.length + 1, sizeof(indexes[0])) : NULL;
+    size_t *offsets = isThreaded ? calloc(count + 1, sizeof(offsets[0])) : NULL;
+    if (NULL == replayers || NULL == blocks || NULL == isReady ||
+        (isThreaded && (NULL == indexes || NULL == offsets))) {
+        Panic_terminate("Out of memory");
+    }
+    if (isThreaded) {
+        // counting sort of the operations by thread, keeping their order
+        for (size_t i = 0; i < workload.length; i++) {
+            offsets[workload.operations[i].thread + 1] += 1;
+        }
+        for (size_t i = 0; i < count; i++) {
+            offsets[i + 1] += offsets[i];
+        }
+        for (size_t i = 0; i < workload.length; i++) {
+            indexes[offsets[workload.operations[i].thread]++] = (uint32_t) i;
+        }
+        for (size_t i = count; i > 0; i--) {
+            offsets[i] = offsets[i - 1];
+        }
+        offsets[0] = 0;
+    }
+
+    pthread_barrier_t barrier;
+    if (0 != pthread_barrier_init(&barrier, NULL, (unsigned) count + 1)) {
+        Panic_terminate("Unable to initialize the barrier");
+    }
+    for (size_t i = 0; i < count; i++) {
+        replayers[i] = (struct Replayer) {
+                .operations=workload.operations, .indexes=isThreaded ? indexes + offsets[i] : NULL,
+                .length=isThreaded ? offsets[i + 1] - offsets[i] : workload.length,
+                .blocks=blocks, .isReady=isReady, .barrier=&barrier, .isTimed=isTimed
+        };
+        if (0 != pthread_create(&replayers[i].thread, NULL, Replayer_run, &replayers[i])) {
+            Panic_terminate("Unable to create the replaying thread");
+        }
+    }
+
+    // the peak RSS is reset (Linux 4.0 onwards) so that it accounts the replay only
+    const size_t baselineRSS = readStatus("VmRSS:");
+    FILE *clearRefs = fopen("/proc/self/clear_refs", "w");
+    if (NULL != clearRefs) {
+        fputs("5", clearRefs);
+        fclose(clearRefs);
+    }
+
+    const long long start = now() + (isTimed ? 1000000 : 0);   // leaves time to the replayers to wake up
+    for (size_t i = 0; i < count; i++) {
+        replayers[i].start = start;
+    }
+    pthread_barrier_wait(&barrier);
+    for (size_t i = 0; i < count; i++) {
+        pthread_join(replayers[i].thread, NULL);
+    }
+    const double seconds = (double) (now() - start) / 1e9;
+    const size_t peakRSS = readStatus("VmHWM:");
+
+    struct Latency *latencies = calloc(CALLS_COUNT, sizeof(latencies[0]));
+    if (NULL == latencies) {
+        Panic_terminate("Out of memory");
+    }
+    for (size_t i = 0; i < count; i++) {
+        for (size_t call = 0; call < CALLS_COUNT; call++) {
+            const struct Latency *latency = &replayers[i].latencies[call];
+            latencies[call].calls += latency->calls;
+            latencies[call].total += latency->total;
+            latencies[call].max = (latency->max > latencies[call].max) ? latency->max : latencies[call].max;
+            for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+                latencies[call].histogram[bucket] += latency->histogram[bucket];
+            }
+        }
+    }
+    for (size_t call = 0; call < CALLS_COUNT; call++) {
+        printLatency(output, (enum Call) call, &latencies[call]);
+    }
+    const char *allocator = getenv("LD_PRELOAD");
+    fprintf(output, "{\"record\": \"replay\", \"allocator\": \"%s\", \"operations\": %zu, \"skipped\": %zu, \"threads\": %zu, \"seconds\": %.6f, \"operationsPerSecond\": %.0f, \"baselineRSS\": %zu, \"peakRSS\": %zu}\n",
+            (NULL == allocator || '\0' == *allocator) ? "libc" : allocator, workload.length, workload.skipped,
+            count, seconds, (seconds > 0) ? (double) workload.length / seconds : 0, baselineRSS, peakRSS);
+
+    // replayed blocks still live are left to the end of the process, as the traced program may have done
+    pthread_barrier_destroy(&barrier);
+    free(latencies);
+    free(offsets);
+    free(indexes);
+    free(isReady);
+    free(blocks);
+    free(replayers);
+    free(workload.operations);
+    free(workload.threads);
+    if (0 != fclose(output)) {
+        Panic_terminate("Unable to write the results");
+    }
+    return 0;
+}
+
+/*
+ * Workload
+ */
+void Workload_load(struct Workload *const self, const char *const paths[], const size_t count, const long long PID) {
+    struct TraceMerger merger;
+    struct TraceRecord record;
+    long long recordPID;
+
+    const Error error = TraceMerger_open(&merger, paths, count);
+    if (Ok != error) {
+        Panic_terminate("Unable to open traces: %s", Error_explain(error));
+    }
+    while (TraceMerger_next(&merger, &record)) {
+        if (record.isEvent && (PID < 0 || (TraceRecord_getInteger(&record, "PID", &recordPID) && PID == recordPID))) {
+            Workload_add(self, &record);
+        }
+    }
+    TraceMerger_close(&merger);
+}
+
+void Workload_add(struct Workload *const self, const struct TraceRecord *const record) {
+    const char *name;
+    size_t nameLength, call = 0;
+    long long PID = 0, TID = 0, size = 0;
+    uintptr_t address, from;
+
+    if (!TraceRecord_getString(record, "call", &name, &nameLength)) {
+        return;
+    }
+    for (; call < CALLS_COUNT && !(strlen(gCallNames[call]) == nameLength &&
+                                   0 == memcmp(gCallNames[call], name, nameLength)); call++) {}
+    if (CALLS_COUNT == call || !TraceRecord_getInteger(record, "PID", &PID) ||
+        !TraceRecord_getInteger(record, "TID", &TID)) {
+        return;
+    }
+
+    struct Operation operation = {
+            .call=(uint8_t) call, .slot=NO_SLOT, .from=NO_SLOT, .thread=Workload_getThread(self, PID, TID)
+    };
+    if (CALL_FREE == call) {
+        // frees of NULL are not worth replaying, nor are frees of unknown blocks
+        if (!TraceRecord_getAddress(record, "address", &from) ||
+            NO_SLOT == (operation.from = Workload_unmap(self, PID, from))) {
+            self->skipped += 1;
+            return;
+        }
+    } else {
+        if (!TraceRecord_getInteger(record, "size", &size)) {
+            return;
+        }
+        operation.size = (size_t) size;
+        if (CALL_REALLOC == call && TraceRecord_getAddress(record, "from", &from) &&
+            TraceRecord_getAddress(record, "to", &address)) {
+            operation.from = Workload_unmap(self, PID, from);
+        } else if (!TraceRecord_getAddress(record, "address", &address)) {
+            self->skipped += 1;     // failed allocation
+            return;
+        } else if (CALL_REALLOC == call) {
+            operation.from = Workload_unmap(self, PID, address);    // resized in place
+        }
+        if (0 == address) {
+            self->skipped += 1;
+            return;
+        }
+        if (CALL_ALIGNED_ALLOC == call) {
+            const unsigned shift = (unsigned) __builtin_ctzll((unsigned long long) address);
+            operation.alignmentShift = (uint8_t) ((shift < 12) ? shift : 12);
+        }
+        operation.slot = Workload_map(self, PID, address);
+    }
+
+    if (self->length == self->capacity) {
+        self->capacity = (0 == self->capacity) ? 4096 : 2 * self->capacity;
+        struct Operation *operations = realloc(self->operations, self->capacity * sizeof(operations[0]));
+        if (NULL == operations) {
+            Panic_terminate("Out of memory");
+        }
+        self->operations = operations;
+    }
+    if (0 == self->length) {
+        self->origin = record->clock;
+    }
+    operation.clock = record->clock - self->origin;
+    self->operations[self->length++] = operation;
+}
+
+uint32_t Workload_getThread(struct Workload *const self, const long long PID, const long long TID) {
+    // threads are few and calls come in bursts per thread, the last match is checked first
+    if (self->lastThread < self->threadsLength && PID == self->threads[self->lastThread][0] &&
+        TID == self->threads[self->lastThread][1]) {
+        return (uint32_t) self->lastThread;
+    }
+    for (self->lastThread = 0; self->lastThread < self->threadsLength; self->lastThread++) {
+        if (PID == self->threads[self->lastThread][0] && TID == self->threads[self->lastThread][1]) {
+            return (uint32_t) self->lastThread;
+        }
+    }
+    if (self->threadsLength == self->threadsCapacity) {
+        self->threadsCapacity = (0 == self->threadsCapacity) ? 16 : 2 * self->threadsCapacity;
+        long long (*threads)[2] = realloc(self->threads, self->threadsCapacity * sizeof(threads[0]));
+        if (NULL == threads) {
+            Panic_terminate("Out of memory");
+        }
+        self->threads = threads;
+    }
+    self->threads[self->threadsLength][0] = PID;
+    self->threads[self->threadsLength][1] = TID;
+    self->lastThread = self->threadsLength;
+    return (uint32_t) self->threadsLength++;
+}
+
+size_t Workload_getMapping(const struct Workload *const self, const long long PID, const uintptr_t address) {
+    size_t i = Workload_hash(PID, address) & (self->mappingsCapacity - 1);
+    for (; 0 != self->mappings[i].address; i = (i + 1) & (self->mappingsCapacity - 1)) {
+        if (address == self->mappings[i].address && PID == self->mappings[i].PID) {
+            break;
+        }
+    }
+    return i;
+}
+
+uint32_t Workload_map(struct Workload *const self, const long long PID, const uintptr_t address) {
+    if ((self->mappingsLength + 1) * 4 > self->mappingsCapacity * 3) {
+        const struct Mapping *mappings = self->mappings;
+        const size_t capacity = self->mappingsCapacity;
+        self->mappingsCapacity = (0 == capacity) ? 4096 : 2 * capacity;
+        self->mappings = calloc(self->mappingsCapacity, sizeof(self->mappings[0]));
+        if (NULL == self->mappings) {
+            Panic_terminate("Out of memory");
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            if (0 != mappings[i].address) {
+                self->mappings[Workload_getMapping(self, mappings[i].PID, mappings[i].address)] = mappings[i];
+            }
+        }
+        free((void *) mappings);
+    }
+    if (NO_SLOT == self->slots) {
+        Panic_terminate("Too many blocks");
+    }
+
+    // an address allocated again without being freed (e.g. by an untraced realloc) is taken by the new block
+    struct Mapping *mapping = &self->mappings[Workload_getMapping(self, PID, address)];
+    self->mappingsLength += (0 == mapping->address) ? 1 : 0;
+    *mapping = (struct Mapping) {.PID=PID, .address=address, .slot=self->slots};
+    return self->slots++;
+}
+
+uint32_t Workload_unmap(struct Workload *const self, const long long PID, const uintptr_t address) {
+    if (0 == self->mappingsLength) {
+        return NO_SLOT;
+    }
+    size_t i = Workload_getMapping(self, PID, address);
+    if (0 == self->mappings[i].address) {
+        return NO_SLOT;
+    }
+    const uint32_t slot = self->mappings[i].slot;
+
+    // backward shift deletion, so that lookups need no tombstones
+    const size_t mask = self->mappingsCapacity - 1;
+    for (size_t j = (i + 1) & mask; 0 != self->mappings[j].address; j = (j + 1) & mask) {
+        const struct Mapping *mapping = &self->mappings[j];
+        const size_t home = Workload_hash(mapping->PID, mapping->address) & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            self->mappings[i] = *mapping;
+            i = j;
+        }
+    }
+    self->mappings[i].address = 0;
+    self->mappingsLength -= 1;
+    return slot;
+}
+
+size_t Workload_hash(const long long PID, const uintptr_t address) {
+    // blocks are at least 16 bytes apart, the low bits are dropped by taking the high bits of the product
+    return (size_t) ((((uint64_t) address ^ ((uint64_t) PID << 48)) * 0x9E3779B97F4A7C15ull) >> 20);
+}
+
+/*
+ * Replayer
+ */
+void *Replayer_run(void *const self) {
+    struct Replayer *replayer = self;
+    pthread_barrier_wait(replayer->barrier);
+    for (size_t i = 0; i < replayer->length; i++) {
+        Replayer_issue(replayer, &replayer->operations[(NULL == replayer->indexes) ? i : replayer->indexes[i]]);
+    }
+    return NULL;
+}
+
+void Replayer_issue(struct Replayer *const self, const struct Operation *const operation) {
+    if (self->isTimed) {
+        const long long deadline = self->start + operation->clock;
+        const struct timespec time = {.tv_sec=deadline / 1000000000LL, .tv_nsec=deadline % 1000000000LL};
+        while (0 != clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL)) {}
+    }
+    if (NULL != self->indexes && NO_SLOT != operation->from) {
+        // the block may be allocated by another thread, which is behind
+        while (!atomic_load_explicit(&self->isReady[operation->from], memory_order_acquire)) {
+            sched_yield();
+        }
+    }
+
+    void *const block = (NO_SLOT == operation->from) ? NULL : self->blocks[operation->from];
+    void *result = NULL;
+    const long long start = now();
+    switch (operation->call) {
+        case CALL_MALLOC:
+            result = malloc(operation->size);
+            break;
+        case CALL_CALLOC:
+            result = calloc(1, operation->size);
+            break;
+        case CALL_REALLOC:
+            result = realloc(block, operation->size);
+            break;
+        case CALL_ALIGNED_ALLOC:
+            result = aligned_alloc((size_t) 1 << operation->alignmentShift, operation->size);
+            break;
+        default:
+            free(block);
+            break;
+    }
+    const unsigned long long elapsed = (unsigned long long) (now() - start);
+
+    struct Latency *latency = &self->latencies[operation->call];
+    latency->calls += 1;
+    latency->total += elapsed;
+    latency->max = (elapsed > latency->max) ? elapsed : latency->max;
+    latency->histogram[getBucket(elapsed)] += 1;
+
+    if (NO_SLOT != operation->slot) {
+        if (NULL != result) {
+            touch(result, operation->size);
+        }
+        self->blocks[operation->slot] = result;
+        atomic_store_explicit(&self->isReady[operation->slot], true, memory_order_release);
+    }
+}
+
+void touch(char *const block, const size_t size) {
+    volatile char *bytes = block;
+    for (size_t i = 0; i < size; i += PAGE_SIZE) {
+        bytes[i] = 1;
+    }
+}
+
+long long now(void) {
+    struct timespec clock;
+    clock_gettime(CLOCK_MONOTONIC, &clock);
+    return clock.tv_sec * 1000000000LL + clock.tv_nsec;
+}
+
+size_t getBucket(const unsigned long long nanoseconds) {
+    if (nanoseconds < 4) {
+        return (size_t) nanoseconds;
+    }
+    const unsigned exponent = 63u - (unsigned) __builtin_clzll(nanoseconds);
+    return 4 * (exponent - 1) + ((nanoseconds >> (exponent - 2)) & 3u);
+}
+
+unsigned long long getLimit(const size_t bucket) {
+    if (bucket < 4) {
+        return bucket;
+    }
+    const unsigned exponent = (unsigned) (bucket / 4 + 1);
+    return ((4ull + bucket % 4) << (exponent - 2)) + (1ull << (exponent - 2)) - 1;
+}
+
+size_t readStatus(const char *const key) {
+    char line[256];
+    size_t kilobytes = 0;
+    FILE *status = fopen("/proc/self/status", "r");
+    if (NULL == status) {
+        return 0;
+    }
+    while (NULL != fgets(line, sizeof(line), status)) {
+        if (0 == strncmp(key, line, strlen(key))) {
+            kilobytes = strtoull(line + strlen(key), NULL, 10);
+            break;
+        }
+    }
+    fclose(status);
+    return kilobytes * 1024;
+}
+
+void printLatency(FILE *const output, const enum Call call, const struct Latency *const latency) {
+    static const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+    unsigned long long values[sizeof(percentiles) / sizeof(percentiles[0])] = {0};
+
+    if (0 == latency->calls) {
+        return;
+    }
+    for (size_t i = 0, bucket = 0, seen = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        const size_t rank = (size_t) ((double) latency->calls * percentiles[i]);
+        for (; bucket < HISTOGRAM_BUCKETS && seen + latency->histogram[bucket] <= rank; bucket++) {
+            seen += latency->histogram[bucket];
+        }
+        // buckets are labeled by their upper bound, which may exceed the slowest call
+        values[i] = (bucket < HISTOGRAM_BUCKETS && getLimit(bucket) < latency->max) ?
+                    getLimit(bucket) : latency->max;
+    }
+
+    fprintf(output, "{\"record\": \"latency\", \"call\": \"%s\", \"calls\": %zu, \"mean\": %.1f, \"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu, \"histogram\": [",
+            gCallNames[call], latency->calls, (double) latency->total / (double) latency->calls,
+            values[0], values[1], values[2], values[3], latency->max);
+    for (size_t bucket = 0, isFirst = 1; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        if (0 != latency->histogram[bucket]) {
+            fprintf(output, "%s[%llu, %zu]", isFirst ? "" : ", ", getLimit(bucket), latency->histogram[bucket]);
+            isFirst = 0;
+        }
+    }
+    fputs("]}\n", output);
+}
@@ -0,0 +1,121 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Symbolizes the return addresses recorded by traced processes, e.g. the backtraces of crash records, using the
+ * object records written by the same processes and the ELF symbol tables of the objects.
+ *
+ * Usage: watchdog-symbolize [-o output] trace...
+ *
+ * Traces are copied as they are, except for records holding a backtrace which get a symbols array, one entry per
+ * address: "path(function+0xoffset)", "path(+0xoffset)" when the function is unknown, "??" when the object is.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <panic/panic.h>
+#include "trace.h"
+
+#define OUTPUT_BUFFER_SIZE  (1u << 20)
+#define FRAMES_COUNT        256
+
+static void symbolize(struct TraceSymbolizer *symbolizer, const struct TraceRecord *record, FILE *output);
+
+int main(int argc, char *argv[]) {
+    struct TraceSymbolizer symbolizer;
+    struct TraceReader reader;
+    struct TraceRecord record;
+    FILE *output = stdout;
+    int first = 1;
+
+    if (first + 1 < argc && 0 == strcmp("-o", argv[first])) {
+        output = fopen(argv[first + 1], "w");
+        if (NULL == output) {
+            Panic_terminate("Unable to open file: %s", argv[first + 1]);
+        }
+        first += 2;
+    }
+    if (first >= argc) {
+        fprintf(stderr, "Usage: %s [-o output] trace...\n", argv[0]);
+        return 1;
+    }
+    setvbuf(output, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    // symbol tables are cached across traces, processes forked by a traced program load the same objects
+    TraceSymbolizer_init(&symbolizer);
+    for (int i = first; i < argc; i++) {
+        if (Ok != TraceReader_open(&reader, argv[i])) {
+            Panic_terminate("Unable to open trace: %s", argv[i]);
+        }
+        while (TraceReader_next(&reader, &record)) {
+            if (Ok != TraceSymbolizer_apply(&symbolizer, &record)) {
+                Panic_terminate("Out of memory");
+            }
+            symbolize(&symbolizer, &record, output);
+        }
+        TraceReader_close(&reader);
+    }
+    TraceSymbolizer_teardown(&symbolizer);
+
+    if (0 != fclose(output)) {
+        Panic_terminate("Unable to write output");
+    }
+    return 0;
+}
+
+void symbolize(struct TraceSymbolizer *const symbolizer, const struct TraceRecord *const record, FILE *const output) {
+    uintptr_t frames[FRAMES_COUNT];
+    long long PID;
+    const size_t count = record->isEvent ? 0 : TraceRecord_getAddresses(record, "backtrace", frames, FRAMES_COUNT);
+
+    // records end with a closing brace: symbols are appended right before it
+    if (0 == count || !TraceRecord_getInteger(record, "PID", &PID) || '}' != record->line[record->length - 1]) {
+        fwrite(record->line, 1, record->length, output);
+        fputc('\n', output);
+        return;
+    }
+    fwrite(record->line, 1, record->length - 1, output);
+    fputs(", \"symbols\": [", output);
+    for (size_t i = 0; i < count; i++) {
+        struct TraceSymbol symbol;
+        // return addresses point past the call, the call belongs to the function before them
+        if (Ok != TraceSymbolizer_resolve(symbolizer, PID, frames[i] - 1, &symbol)) {
+            Panic_terminate("Out of memory");
+        }
+        fputs((0 == i) ? "\"" : ", \"", output);
+        if (NULL == symbol.path) {
+            fputs("??", output);
+        } else {
+            fprintf(output, "%s(%s+0x%" PRIxPTR ")", symbol.path, (NULL == symbol.name) ? "" : symbol.name,
+                    symbol.offset + 1);
+        }
+        fputc('"', output);
+    }
+    fputs("]}\n", output);
+}
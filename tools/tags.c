@@ -0,0 +1,292 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Ranks the tags of traces (see Watchdog_pushTag) by live bytes, so that the kinds of work driving the growth and
+ * the churn of the heap can be told apart whatever the sites they allocate from.
+ *
+ * Usage: watchdog-tags [--snapshot N] trace...
+ *
+ * Prints a tag record per tag holding its live bytes and blocks at the end of the traces and its cumulative
+ * allocations, ranked by live bytes, followed by a summary with the totals and the untagged share. Totals are
+ * either computed replaying the events of the traces or, with --snapshot, read from the snapshots written by the
+ * traced processes, which is the only way when calls were not reported (see Watchdog_setOverheadBudget).
+ * Tags of different processes and traces are merged by id. Replaying events, blocks moved by realloc keep the tag
+ * of their allocation, while snapshots account them to the tag of the realloc, as the traced process does.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <panic/panic.h>
+#include "trace.h"
+
+struct TagUsage {
+    uint32_t id;            // 0 for the untagged blocks
+    bool isUsed;
+    const char *name;       // JSON escaped, refers to the traces, NULL until a tag record is read
+    size_t nameLength;
+    size_t bytes;
+    size_t blocks;
+    size_t allocatedBytes;  // cumulative
+    size_t allocations;     // as above
+};
+
+/*
+ * TagTable
+ *
+ * The usages of the tags met so far, in an open-addressing table keyed by id.
+ */
+struct TagTable {
+    struct TagUsage *usages;
+    size_t capacity;
+    size_t length;
+};
+
+static struct TagUsage *TagTable_get(struct TagTable *self, uint32_t id)
+__attribute__((__warn_unused_result__, __nonnull__, __returns_nonnull__));
+
+static void load(struct TagTable *tags, struct TagUsage *totals, struct TraceReader *readers,
+                 const char *const paths[], size_t count, long long snapshot);
+
+static bool isKind(const struct TraceRecord *record, const char *kind);
+
+static int compareUsages(const void *a, const void *b);
+
+static void printTags(const struct TagTable *tags, const struct TagUsage *totals);
+
+int main(int argc, char *argv[]) {
+    struct TagTable tags = {0};
+    struct TagUsage totals = {0};
+    long long snapshot = -1;
+    int first = 1;
+
+    for (; first + 1 < argc && 0 == strncmp("-", argv[first], 1); first += 2) {
+        if (0 == strcmp("--snapshot", argv[first])) {
+            snapshot = strtoll(argv[first + 1], NULL, 10);
+        } else {
+            Panic_terminate("Unknown option: %s", argv[first]);
+        }
+    }
+    if (first >= argc) {
+        fprintf(stderr, "Usage: %s [--snapshot N] trace...\n", argv[0]);
+        return 1;
+    }
+
+    // names refer to the traces, readers are closed once the tags are printed
+    struct TraceReader *readers = calloc((size_t) (argc - first), sizeof(readers[0]));
+    if (NULL == readers) {
+        Panic_terminate("Out of memory");
+    }
+    load(&tags, &totals, readers, (const char *const *) argv + first, (size_t) (argc - first), snapshot);
+    printTags(&tags, &totals);
+
+    free(tags.usages);
+    for (int i = first; i < argc; i++) {
+        TraceReader_close(&readers[i - first]);
+    }
+    free(readers);
+    return 0;
+}
+
+struct TagUsage *TagTable_get(struct TagTable *const self, const uint32_t id) {
+    assert(NULL != self);
+    if ((self->length + 1) * 4 > self->capacity * 3) {
+        const size_t capacity = (0 == self->capacity) ? 64 : 2 * self->capacity;
+        struct TagUsage *usages = calloc(capacity, sizeof(usages[0]));
+        if (NULL == usages) {
+            Panic_terminate("Out of memory");
+        }
+        for (size_t i = 0; i < self->capacity; i++) {
+            if (self->usages[i].isUsed) {
+                size_t j = (size_t) ((self->usages[i].id * UINT64_C(0x9E3779B97F4A7C15)) >> 20) & (capacity - 1);
+                for (; usages[j].isUsed; j = (j + 1) & (capacity - 1)) {}
+                usages[j] = self->usages[i];
+            }
+        }
+        free(self->usages);
+        self->usages = usages;
+        self->capacity = capacity;
+    }
+
+    const size_t mask = self->capacity - 1;
+    size_t i = (size_t) ((id * UINT64_C(0x9E3779B97F4A7C15)) >> 20) & mask;
+    for (; self->usages[i].isUsed; i = (i + 1) & mask) {
+        if (self->usages[i].id == id) {
+            return &self->usages[i];
+        }
+    }
+    self->usages[i].isUsed = true;
+    self->usages[i].id = id;
+    self->length += 1;
+    return &self->usages[i];
+}
+
+void load(struct TagTable *const tags, struct TagUsage *const totals, struct TraceReader *const readers,
+          const char *const paths[], const size_t count, const long long snapshot) {
+    struct TraceRecord record;
+    struct TraceHeap heap;
+
+    TraceHeap_init(&heap);
+    for (size_t i = 0; i < count; i++) {
+        if (Ok != TraceReader_open(&readers[i], paths[i])) {
+            Panic_terminate("Unable to open trace: %s", paths[i]);
+        }
+        // blocks are keyed by PID as well, as traces of the collector process interleave processes
+        while (TraceReader_next(&readers[i], &record)) {
+            const char *call, *name;
+            size_t callLength, nameLength;
+            long long id = 0, bytes = 0, blocks = 0, allocatedBytes = 0, allocations = 0, size;
+            uintptr_t address;
+
+            if (!record.isEvent && isKind(&record, "tag")) {
+                struct TagUsage *usage;
+                if (TraceRecord_getInteger(&record, "tag", &id) &&
+                    TraceRecord_getString(&record, "name", &name, &nameLength) &&
+                    NULL == (usage = TagTable_get(tags, (uint32_t) id))->name) {
+                    usage->name = name;
+                    usage->nameLength = nameLength;
+                }
+            } else if (snapshot >= 0) {
+                const bool isTag = isKind(&record, "snapshotTag");
+                if (record.isEvent || !(isTag || isKind(&record, "snapshotSite")) ||
+                    !TraceRecord_getInteger(&record, "snapshot", &id) || id != snapshot ||
+                    !TraceRecord_getInteger(&record, "liveBytes", &bytes) ||
+                    !TraceRecord_getInteger(&record, "liveBlocks", &blocks)) {
+                    continue;
+                }
+                // cumulative allocations are missing from the snapshots of older traces
+                if (!TraceRecord_getInteger(&record, "allocatedBytes", &allocatedBytes) ||
+                    !TraceRecord_getInteger(&record, "allocations", &allocations)) {
+                    allocatedBytes = allocations = 0;
+                }
+                struct TagUsage *usage = totals;
+                if (isTag) {
+                    if (!TraceRecord_getInteger(&record, "tag", &id)) {
+                        continue;
+                    }
+                    usage = TagTable_get(tags, (uint32_t) id);
+                    if (NULL == usage->name && TraceRecord_getString(&record, "name", &name, &nameLength)) {
+                        usage->name = name;
+                        usage->nameLength = nameLength;
+                    }
+                }
+                usage->bytes += (size_t) bytes;
+                usage->blocks += (size_t) blocks;
+                usage->allocatedBytes += (size_t) allocatedBytes;
+                usage->allocations += (size_t) allocations;
+            } else {
+                if (Ok != TraceHeap_apply(&heap, &record)) {
+                    Panic_terminate("Out of memory");
+                }
+                // reallocations count as allocations of their new size, as for watchdog-export
+                if (!record.isEvent || !TraceRecord_getString(&record, "call", &call, &callLength) ||
+                    (4 == callLength && 0 == memcmp("free", call, 4)) ||
+                    !(TraceRecord_getAddress(&record, "to", &address) ||
+                      TraceRecord_getAddress(&record, "address", &address)) ||
+                    0 == address || !TraceRecord_getInteger(&record, "size", &size)) {
+                    continue;
+                }
+                struct TagUsage *usage = TagTable_get(tags, TraceRecord_getInteger(&record, "tag", &id) ?
+                                                            (uint32_t) id : 0);
+                usage->allocatedBytes += (size_t) size;
+                usage->allocations += 1;
+                totals->allocatedBytes += (size_t) size;
+                totals->allocations += 1;
+            }
+        }
+
+        const struct TraceBlock *block;
+        size_t cursor = 0;
+        while (NULL != (block = TraceHeap_next(&heap, &cursor))) {
+            struct TagUsage *usage = TagTable_get(tags, block->tag);
+            usage->bytes += block->size;
+            usage->blocks += 1;
+            totals->bytes += block->size;
+            totals->blocks += 1;
+        }
+        TraceHeap_clear(&heap);
+    }
+    TraceHeap_teardown(&heap);
+}
+
+bool isKind(const struct TraceRecord *const record, const char *const kind) {
+    assert(NULL != record);
+    assert(NULL != kind);
+    const char *value;
+    size_t length;
+    return TraceRecord_getString(record, "record", &value, &length) &&
+           strlen(kind) == length && 0 == memcmp(kind, value, length);
+}
+
+int compareUsages(const void *const a, const void *const b) {
+    const struct TagUsage *x = a, *y = b;
+    if (x->bytes != y->bytes) {
+        return (x->bytes < y->bytes) ? 1 : -1;
+    }
+    if (x->allocatedBytes != y->allocatedBytes) {
+        return (x->allocatedBytes < y->allocatedBytes) ? 1 : -1;
+    }
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+void printTags(const struct TagTable *const tags, const struct TagUsage *const totals) {
+    struct TagUsage *ranked = malloc((tags->length + 1) * sizeof(ranked[0]));
+    struct TagUsage untagged = *totals;
+    size_t length = 0;
+
+    if (NULL == ranked) {
+        Panic_terminate("Out of memory");
+    }
+    for (size_t i = 0; i < tags->capacity; i++) {
+        const struct TagUsage *usage = &tags->usages[i];
+        // blocks have a single tag each, what is left of the totals is untagged
+        if (usage->isUsed && 0 != usage->id && (0 != usage->allocations || 0 != usage->blocks)) {
+            ranked[length++] = *usage;
+            untagged.bytes -= usage->bytes;
+            untagged.blocks -= usage->blocks;
+            untagged.allocatedBytes -= usage->allocatedBytes;
+            untagged.allocations -= usage->allocations;
+        }
+    }
+    qsort(ranked, length, sizeof(ranked[0]), compareUsages);
+
+    for (size_t i = 0; i < length; i++) {
+        const struct TagUsage *usage = &ranked[i];
+        printf("{\"record\": \"tag\", \"tag\": %" PRIu32 ", \"name\": \"%.*s\", \"liveBytes\": %zu, \"liveBlocks\": %zu, \"allocatedBytes\": %zu, \"allocations\": %zu}\n",
+               usage->id, (int) ((NULL == usage->name) ? 1 : usage->nameLength),
+               (NULL == usage->name) ? "?" : usage->name,
+               usage->bytes, usage->blocks, usage->allocatedBytes, usage->allocations);
+    }
+    printf("{\"record\": \"tags\", \"tags\": %zu, \"liveBytes\": %zu, \"liveBlocks\": %zu, \"allocatedBytes\": %zu, \"allocations\": %zu, \"untaggedLiveBytes\": %zu, \"untaggedLiveBlocks\": %zu, \"untaggedAllocatedBytes\": %zu, \"untaggedAllocations\": %zu}\n",
+           length, totals->bytes, totals->blocks, totals->allocatedBytes, totals->allocations,
+           untagged.bytes, untagged.blocks, untagged.allocatedBytes, untagged.allocations);
+    free(ranked);
+}
@@ -0,0 +1,220 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Shows the live totals of a tree of traced processes sharing their counters (see Watchdog_shareCounters), reading
+ * the shared memory region of the root process while they run, without trace files.
+ *
+ * Usage: watchdog-top PID [--interval MILLISECONDS] [--count N] [--top N]
+ *
+ * Every interval (1000 milliseconds by default) prints a process record per live process of the tree, holding its
+ * live bytes and blocks, its cumulative allocations and the allocation rate since the previous interval, followed
+ * by a site record for each one of its N sites holding most live bytes (10 by default), then a tree record with
+ * the totals. Stops after N intervals, or once the root process has exited.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <panic/panic.h>
+#include "watchdog_counters.h"
+
+#define OUTPUT_BUFFER_SIZE  (64u << 10)
+
+struct Ranked {
+    const struct Watchdog_CounterSite *site;
+    long long liveBytes;
+};
+
+struct Previous {
+    int PID;
+    unsigned long long allocatedBytes;
+    unsigned long long allocations;
+};
+
+static const struct Watchdog_Counters *openCounters(int PID);
+
+static bool isAlive(int PID);
+
+static long long now(void);
+
+static int compareRanked(const void *a, const void *b);
+
+static void printProcess(FILE *output, const struct Watchdog_CounterProcess *process, struct Previous *previous,
+                         double seconds, size_t top, struct Ranked *ranked, long long *totals);
+
+int main(int argc, char *argv[]) {
+    static struct Previous previous[WATCHDOG_COUNTERS_PROCESSES];
+    static struct Ranked ranked[WATCHDOG_COUNTERS_SITES];
+    FILE *output = stdout;
+    long long interval = 1000, count = -1;
+    size_t top = 10;
+
+    if (argc < 2 || '-' == argv[1][0]) {
+        fprintf(stderr, "Usage: %s PID [--interval MILLISECONDS] [--count N] [--top N]\n", argv[0]);
+        return 1;
+    }
+    const int PID = (int) strtol(argv[1], NULL, 10);
+    for (int i = 2; i < argc; i += 2) {
+        if (i + 1 < argc && 0 == strcmp("--interval", argv[i])) {
+            interval = strtoll(argv[i + 1], NULL, 10);
+        } else if (i + 1 < argc && 0 == strcmp("--count", argv[i])) {
+            count = strtoll(argv[i + 1], NULL, 10);
+        } else if (i + 1 < argc && 0 == strcmp("--top", argv[i])) {
+            top = strtoull(argv[i + 1], NULL, 10);
+        } else {
+            Panic_terminate("Unknown option: %s", argv[i]);
+        }
+    }
+    if (interval <= 0) {
+        Panic_terminate("Invalid interval: %lld", interval);
+    }
+    setvbuf(output, NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+
+    const struct Watchdog_Counters *counters = openCounters(PID);
+    long long last = now();
+    bool isRunning = true;
+    for (long long tick = 0; (count < 0 || tick < count) && isRunning; tick++) {
+        const struct timespec delay = {.tv_sec = interval / 1000, .tv_nsec = (interval % 1000) * 1000000};
+        while (0 != nanosleep(&delay, NULL) && EINTR == errno) {}
+
+        const long long clock = now();
+        const double seconds = (double) (clock - last) / 1e9;
+        long long totals[4] = {0};  // live bytes, live blocks, allocation rate, processes
+        last = clock;
+        isRunning = false;  // until the slot of the root process is found
+        for (size_t i = 0; i < WATCHDOG_COUNTERS_PROCESSES; i++) {
+            const struct Watchdog_CounterProcess *process = &counters->processes[i];
+            const int processPID = atomic_load_explicit(&process->PID, memory_order_acquire);
+            if (0 != processPID && isAlive(processPID)) {
+                printProcess(output, process, &previous[i], seconds, top, ranked, totals);
+                totals[3] += 1;
+                isRunning = isRunning || processPID == counters->rootPID;
+            }
+        }
+        fprintf(output, "{\"record\": \"tree\", \"rootPID\": %d, \"clock\": %lld, \"processes\": %lld, "
+                        "\"liveBytes\": %lld, \"liveBlocks\": %lld, \"allocationRate\": %lld}\n",
+                counters->rootPID, clock, totals[3], totals[0], totals[1], totals[2]);
+        if (0 != fflush(output)) {
+            Panic_terminate("Unable to write the results");
+        }
+    }
+    return 0;
+}
+
+const struct Watchdog_Counters *openCounters(const int PID) {
+    char name[32];
+    snprintf(name, sizeof(name), WATCHDOG_COUNTERS_NAME_FORMAT, PID);
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        Panic_terminate("No shared counters for process: %d (see Watchdog_shareCounters)", PID);
+    }
+    const struct Watchdog_Counters *counters = mmap(NULL, sizeof(*counters), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (MAP_FAILED == counters) {
+        Panic_terminate("Unable to map shared counters: %s", name);
+    }
+
+    // the region is named before it is ready
+    const struct timespec delay = {.tv_sec = 0, .tv_nsec = 1000000};
+    for (size_t i = 0; WATCHDOG_COUNTERS_MAGIC != atomic_load_explicit(&counters->magic, memory_order_acquire); i++) {
+        if (i >= 1000) {
+            Panic_terminate("Shared counters not ready: %s", name);
+        }
+        nanosleep(&delay, NULL);
+    }
+    return counters;
+}
+
+bool isAlive(const int PID) {
+    return 0 == kill(PID, 0) || EPERM == errno;
+}
+
+long long now(void) {
+    struct timespec clock;
+    clock_gettime(CLOCK_MONOTONIC, &clock);
+    return clock.tv_sec * 1000000000LL + clock.tv_nsec;
+}
+
+int compareRanked(const void *const a, const void *const b) {
+    const long long x = ((const struct Ranked *) a)->liveBytes, y = ((const struct Ranked *) b)->liveBytes;
+    return (x < y) - (x > y);
+}
+
+void printProcess(FILE *const output, const struct Watchdog_CounterProcess *const process,
+                  struct Previous *const previous, const double seconds, const size_t top,
+                  struct Ranked *const ranked, long long *const totals) {
+    const int PID = atomic_load_explicit(&process->PID, memory_order_relaxed);
+    const size_t length = atomic_load_explicit(&process->sitesLength, memory_order_acquire);
+    long long liveBytes = 0, liveBlocks = 0;
+    unsigned long long allocatedBytes = 0, allocations = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        const struct Watchdog_CounterSite *site = &process->sites[i];
+        ranked[i].site = site;
+        ranked[i].liveBytes = atomic_load_explicit(&site->liveBytes, memory_order_relaxed);
+        liveBytes += ranked[i].liveBytes;
+        liveBlocks += atomic_load_explicit(&site->liveBlocks, memory_order_relaxed);
+        allocatedBytes += atomic_load_explicit(&site->allocatedBytes, memory_order_relaxed);
+        allocations += atomic_load_explicit(&site->allocations, memory_order_relaxed);
+    }
+
+    // a slot taken by a new process starts a new history
+    if (previous->PID != PID) {
+        *previous = (struct Previous) {.PID = PID};
+    }
+    const long long rate = (seconds > 0) ? (long long) ((double) (allocations - previous->allocations) / seconds) : 0;
+    fprintf(output, "{\"record\": \"process\", \"PID\": %d, \"parentPID\": %d, \"liveBytes\": %lld, "
+                    "\"liveBlocks\": %lld, \"allocatedBytes\": %llu, \"allocations\": %llu, \"allocationRate\": %lld, "
+                    "\"allocatedBytesRate\": %lld}\n",
+            PID, process->parentPID, liveBytes, liveBlocks, allocatedBytes, allocations, rate,
+            (seconds > 0) ? (long long) ((double) (allocatedBytes - previous->allocatedBytes) / seconds) : 0);
+    previous->allocatedBytes = allocatedBytes;
+    previous->allocations = allocations;
+    totals[0] += liveBytes;
+    totals[1] += liveBlocks;
+    totals[2] += rate;
+
+    qsort(ranked, length, sizeof(ranked[0]), compareRanked);
+    for (size_t i = 0; i < length && i < top && ranked[i].liveBytes > 0; i++) {
+        const struct Watchdog_CounterSite *site = ranked[i].site;
+        fprintf(output, "{\"record\": \"site\", \"PID\": %d, \"file\": \"%.*s\", \"func\": \"%.*s\", \"line\": %d, "
+                        "\"module\": %d, \"liveBytes\": %lld, \"liveBlocks\": %lld, \"allocations\": %llu}\n",
+                PID, WATCHDOG_COUNTERS_FILE_SIZE, site->file, WATCHDOG_COUNTERS_FUNC_SIZE, site->func, site->line,
+                site->module, ranked[i].liveBytes, atomic_load_explicit(&site->liveBlocks, memory_order_relaxed),
+                atomic_load_explicit(&site->allocations, memory_order_relaxed));
+    }
+}
@@ -0,0 +1,1671 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "trace.h"
+
+#define TRACE_RELEASE_SIZE  (64u << 20)     // bytes read before releasing the pages behind
+#define TRACE_HEAP_CAPACITY 1024            // initial capacity, must be a power of 2
+#define TRACE_SNAPSHOT_CAPACITY 256         // as above
+#define TRACE_INDEX_BLOCK_SIZE  128         // approximate size of a block of a checkpoint in the index
+#define TRACE_DEBUG_DIRECTORY   "/usr/lib/debug/.build-id"
+#define TRACE_ELF_CLASS         ((8 == sizeof(void *)) ? ELFCLASS64 : ELFCLASS32)  // only native objects are read
+
+/*
+ * TraceRecord
+ */
+static const char *TraceRecord_find(const struct TraceRecord *self, const char *key)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * TraceHeap
+ */
+static size_t TraceHeap_home(const struct TraceHeap *self, long long PID, uintptr_t address)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static size_t TraceHeap_slot(const struct TraceHeap *self, long long PID, uintptr_t address)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static Error TraceHeap_grow(struct TraceHeap *self, size_t length)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * TraceIndex
+ */
+static void TraceIndex_writeChunk(FILE *stream, const struct TraceChunk *chunk)
+__attribute__((__nonnull__));
+
+static void TraceIndex_writeCheckpoint(FILE *stream, size_t chunk, const struct TraceHeap *heap)
+__attribute__((__nonnull__));
+
+static bool TraceIndex_isUpToDate(const char *path, const char *indexPath)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static void TraceChunk_add(struct TraceChunk *self, const struct TraceRecord *event)
+__attribute__((__nonnull__));
+
+static bool TraceChunk_parse(struct TraceChunk *self, const struct TraceRecord *record)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * TraceSnapshot
+ */
+static uint64_t TraceSnapshot_hash(const struct TraceSite *site)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static size_t TraceSnapshot_slot(const struct TraceSnapshot *self, const struct TraceSite *site, uint64_t hash)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static Error TraceSnapshot_grow(struct TraceSnapshot *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static Error TraceSnapshot_get(struct TraceSnapshot *self, const struct TraceSite *site, struct TraceSiteUsage **out)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static int TraceSiteDelta_compare(const void *a, const void *b)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * TraceSymbolizer
+ */
+struct TraceLoadedObject {
+    long long PID;
+    uintptr_t base;
+    uintptr_t start;
+    uintptr_t end;
+    size_t file;        // index in the files of the symbolizer
+    bool isPending;     // listed by an object record, not yet confirmed by the objects record
+};
+
+struct TraceFunction {
+    uintptr_t address;  // relative to the load address of the object
+    size_t size;
+    const char *name;   // in the mapping of the file
+};
+
+struct TraceObjectFile {
+    char *path;
+    char *buildId;
+    bool isRead;
+    void *mapping;
+    size_t size;
+    struct TraceFunction *functions;
+    size_t length;
+};
+
+static Error TraceSymbolizer_getFile(struct TraceSymbolizer *self, const char *path, size_t pathLength,
+                                     const char *buildId, size_t buildIdLength, size_t *out)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static Error TraceObjectFile_read(struct TraceObjectFile *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static Error TraceObjectFile_load(struct TraceObjectFile *self, const char *path, bool *hasSymbols)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static void TraceObjectFile_unescape(char *path)
+__attribute__((__nonnull__));
+
+static bool TraceObjectFile_hasBuildId(const struct TraceObjectFile *self, const ElfW(Ehdr) *header)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static void TraceObjectFile_release(struct TraceObjectFile *self)
+__attribute__((__nonnull__));
+
+static int TraceFunction_compare(const void *a, const void *b)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * TraceMerger
+ */
+static bool TraceMerger_isBefore(const struct TraceMerger *self, size_t a, size_t b)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+static void TraceMerger_siftDown(struct TraceMerger *self, size_t index)
+__attribute__((__nonnull__));
+
+/*
+ * TraceRecord
+ */
+bool TraceRecord_getInteger(const struct TraceRecord *const self, const char *const key, long long *const out) {
+    assert(NULL != self);
+    assert(NULL != key);
+    assert(NULL != out);
+    const char *value = TraceRecord_find(self, key);
+    if (NULL == value || !(('0' <= *value && *value <= '9') || '-' == *value)) {
+        return false;
+    }
+    // every record ends with a closing brace, so parsing cannot run past the line
+    *out = strtoll(value, NULL, 10);
+    return true;
+}
+
+bool TraceRecord_getString(const struct TraceRecord *const self, const char *const key,
+                           const char **const begin, size_t *const length) {
+    assert(NULL != self);
+    assert(NULL != key);
+    assert(NULL != begin);
+    assert(NULL != length);
+    const char *value = TraceRecord_find(self, key);
+    if (NULL == value || '"' != *value) {
+        return false;
+    }
+    const char *const end = self->line + self->length;
+    const char *cursor = ++value;
+    while (cursor < end && '"' != *cursor) {
+        cursor += ('\\' == *cursor) ? 2 : 1;
+    }
+    if (cursor >= end) {
+        return false;
+    }
+    *begin = value;
+    *length = (size_t) (cursor - value);
+    return true;
+}
+
+bool TraceRecord_getAddress(const struct TraceRecord *const self, const char *const key, uintptr_t *const out) {
+    assert(NULL != self);
+    assert(NULL != key);
+    assert(NULL != out);
+    const char *value = TraceRecord_find(self, key);
+    if (NULL == value || '"' != *value) {
+        return false;
+    }
+    // "(nil)" yields 0 as well
+    *out = (uintptr_t) strtoull(value + 1, NULL, 16);
+    return true;
+}
+
+size_t TraceRecord_getAddresses(const struct TraceRecord *const self, const char *const key,
+                                uintptr_t *const out, const size_t size) {
+    assert(NULL != self);
+    assert(NULL != key);
+    assert(NULL != out);
+    const char *value = TraceRecord_find(self, key);
+    if (NULL == value || '[' != *value) {
+        return 0;
+    }
+    const char *const end = self->line + self->length;
+    size_t count = 0;
+    for (const char *cursor = value + 1; cursor < end && ']' != *cursor && count < size; cursor++) {
+        if ('"' == *cursor) {
+            char *next;
+            out[count++] = (uintptr_t) strtoull(cursor + 1, &next, 16);
+            cursor = next;  // at the closing quote
+        }
+    }
+    return count;
+}
+
+bool TraceRecord_getSite(const struct TraceRecord *const self, struct TraceSite *const out) {
+    assert(NULL != self);
+    assert(NULL != out);
+    long long line;
+    if (!TraceRecord_getString(self, "file", &out->file, &out->fileLength) ||
+        !TraceRecord_getString(self, "func", &out->func, &out->funcLength) ||
+        !TraceRecord_getInteger(self, "line", &line)) {
+        return false;
+    }
+    out->line = (long) line;
+    return true;
+}
+
+uint64_t TraceSite_hash(const struct TraceSite *const self) {
+    assert(NULL != self);
+    char digits[24];
+    uint64_t hash = UINT64_C(14695981039346656037);
+    const int length = snprintf(digits, sizeof(digits), ":%ld", self->line);
+    for (size_t i = 0; i < self->fileLength; i++) {
+        hash = (hash ^ (unsigned char) self->file[i]) * UINT64_C(1099511628211);
+    }
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) digits[i]) * UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+const char *TraceRecord_find(const struct TraceRecord *const self, const char *const key) {
+    assert(NULL != self);
+    assert(NULL != key);
+    char pattern[64];
+    const size_t keyLength = strlen(key);
+    assert(keyLength + 4 < sizeof(pattern));
+    pattern[0] = '"';
+    memcpy(pattern + 1, key, keyLength);
+    memcpy(pattern + 1 + keyLength, "\": ", 3);
+    const char *const match = memmem(self->line, self->length, pattern, keyLength + 4);
+    return (NULL == match) ? NULL : match + keyLength + 4;
+}
+
+/*
+ * TraceReader
+ */
+Error TraceReader_open(struct TraceReader *const self, const char *const path) {
+    assert(NULL != self);
+    assert(NULL != path);
+    struct stat info;
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return IllegalState;
+    }
+    if (0 != fstat(fd, &info)) {
+        close(fd);
+        return IllegalState;
+    }
+
+    memset(self, 0, sizeof(*self));
+    self->_size = (size_t) info.st_size;
+    if (self->_size > 0) {
+        void *data = mmap(NULL, self->_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (MAP_FAILED == data) {
+            close(fd);
+            return IllegalState;
+        }
+        madvise(data, self->_size, MADV_SEQUENTIAL);
+        self->_data = data;
+    }
+    close(fd);
+    return Ok;
+}
+
+bool TraceReader_next(struct TraceReader *const self, struct TraceRecord *const out) {
+    assert(NULL != self);
+    assert(NULL != out);
+
+    if (self->_offset - self->_released >= TRACE_RELEASE_SIZE) {
+        const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+        const size_t released = self->_offset & ~(pageSize - 1);
+        madvise((void *) (self->_data + self->_released), released - self->_released, MADV_DONTNEED);
+        self->_released = released;
+    }
+
+    while (self->_offset < self->_size) {
+        const char *const line = self->_data + self->_offset;
+        const char *const newline = memchr(line, '\n', self->_size - self->_offset);
+        const size_t length = (NULL == newline) ? self->_size - self->_offset : (size_t) (newline - line);
+        self->_offset += length + (NULL != newline);
+        if (0 == length) {
+            continue;
+        }
+
+        long long clock, sequence;
+        *out = (struct TraceRecord) {.line=line, .length=length};
+        out->isEvent = NULL != TraceRecord_find(out, "call");
+        if (TraceRecord_getInteger(out, "clock", &clock) && TraceRecord_getInteger(out, "sequence", &sequence)) {
+            self->_clock = clock;
+            self->_sequence = (unsigned long long) sequence;
+        }
+        out->clock = self->_clock;
+        out->sequence = self->_sequence;
+        return true;
+    }
+    return false;
+}
+
+void TraceReader_seek(struct TraceReader *const self, const size_t offset) {
+    assert(NULL != self);
+    assert(offset <= self->_size);
+    const size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    self->_offset = offset;
+    if (offset < self->_released) {
+        self->_released = offset & ~(pageSize - 1);
+    }
+}
+
+size_t TraceReader_offset(const struct TraceReader *const self) {
+    assert(NULL != self);
+    return self->_offset;
+}
+
+void TraceReader_close(struct TraceReader *const self) {
+    assert(NULL != self);
+    if (NULL != self->_data) {
+        munmap((void *) self->_data, self->_size);
+    }
+    memset(self, 0, sizeof(*self));
+}
+
+/*
+ * TraceMerger
+ */
+Error TraceMerger_open(struct TraceMerger *const self, const char *const paths[], const size_t count) {
+    assert(NULL != self);
+    assert(NULL != paths);
+    memset(self, 0, sizeof(*self));
+    self->_readers = calloc(count + 1, sizeof(self->_readers[0]));
+    self->_heads = calloc(count + 1, sizeof(self->_heads[0]));
+    self->_heap = calloc(count + 1, sizeof(self->_heap[0]));
+    if (NULL == self->_readers || NULL == self->_heads || NULL == self->_heap) {
+        TraceMerger_close(self);
+        return OutOfMemory;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const Error error = TraceReader_open(&self->_readers[i], paths[i]);
+        if (Ok != error) {
+            TraceMerger_close(self);
+            return error;
+        }
+        self->_count += 1;
+        if (TraceReader_next(&self->_readers[i], &self->_heads[i])) {
+            self->_heap[self->_length++] = i;
+        }
+    }
+    for (size_t i = self->_length / 2; i-- > 0;) {
+        TraceMerger_siftDown(self, i);
+    }
+    self->_last = SIZE_MAX;
+    return Ok;
+}
+
+bool TraceMerger_next(struct TraceMerger *const self, struct TraceRecord *const out) {
+    assert(NULL != self);
+    assert(NULL != out);
+
+    // the reader of the previous record is advanced only now, so that its line is valid until this call
+    if (SIZE_MAX != self->_last) {
+        const size_t reader = self->_last;
+        if (!TraceReader_next(&self->_readers[reader], &self->_heads[reader])) {
+            self->_heap[0] = self->_heap[--self->_length];
+        }
+        if (self->_length > 0) {
+            TraceMerger_siftDown(self, 0);
+        }
+        self->_last = SIZE_MAX;
+    }
+
+    if (0 == self->_length) {
+        return false;
+    }
+    self->_last = self->_heap[0];
+    *out = self->_heads[self->_last];
+    return true;
+}
+
+void TraceMerger_close(struct TraceMerger *const self) {
+    assert(NULL != self);
+    for (size_t i = 0; i < self->_count; i++) {
+        TraceReader_close(&self->_readers[i]);
+    }
+    free(self->_readers);
+    free(self->_heads);
+    free(self->_heap);
+    memset(self, 0, sizeof(*self));
+}
+
+bool TraceMerger_isBefore(const struct TraceMerger *const self, const size_t a, const size_t b) {
+    assert(NULL != self);
+    const struct TraceRecord *const x = &self->_heads[a], *const y = &self->_heads[b];
+    if (x->clock != y->clock) {
+        return x->clock < y->clock;
+    }
+    if (x->sequence != y->sequence) {
+        return x->sequence < y->sequence;
+    }
+    return a < b;
+}
+
+void TraceMerger_siftDown(struct TraceMerger *const self, size_t index) {
+    assert(NULL != self);
+    for (;;) {
+        const size_t left = 2 * index + 1, right = left + 1;
+        size_t smallest = index;
+        if (left < self->_length && TraceMerger_isBefore(self, self->_heap[left], self->_heap[smallest])) {
+            smallest = left;
+        }
+        if (right < self->_length && TraceMerger_isBefore(self, self->_heap[right], self->_heap[smallest])) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            return;
+        }
+        const size_t swap = self->_heap[index];
+        self->_heap[index] = self->_heap[smallest];
+        self->_heap[smallest] = swap;
+        index = smallest;
+    }
+}
+
+/*
+ * TraceHeap
+ */
+void TraceHeap_init(struct TraceHeap *const self) {
+    assert(NULL != self);
+    memset(self, 0, sizeof(*self));
+}
+
+Error TraceHeap_apply(struct TraceHeap *const self, const struct TraceRecord *const record) {
+    assert(NULL != self);
+    assert(NULL != record);
+    const char *call;
+    size_t callLength;
+    uintptr_t from, to;
+    long long size, clock, tag;
+    struct TraceBlock block = {.clock=record->clock};
+
+    if (!record->isEvent || !TraceRecord_getString(record, "call", &call, &callLength)) {
+        return Ok;
+    }
+    if (!TraceRecord_getInteger(record, "PID", &block.PID)) {
+        block.PID = 0;
+    }
+    if (4 == callLength && 0 == memcmp("free", call, 4)) {
+        if (TraceRecord_getAddress(record, "address", &from)) {
+            TraceHeap_remove(self, block.PID, from);
+        }
+        return Ok;
+    }
+    if (!TraceRecord_getInteger(record, "size", &size) || !TraceRecord_getSite(record, &block.site)) {
+        return Ok;
+    }
+    if (TraceRecord_getInteger(record, "clock", &clock)) {
+        block.clock = clock;
+    }
+    if (TraceRecord_getInteger(record, "tag", &tag)) {
+        block.tag = (uint32_t) tag;
+    }
+    block.size = (size_t) size;
+
+    if (TraceRecord_getAddress(record, "from", &from) && TraceRecord_getAddress(record, "to", &to)) {
+        // relocation: the block keeps its original site, clock and tag
+        const size_t slot = TraceHeap_slot(self, block.PID, from);
+        if (NULL != self->_blocks && 0 != self->_blocks[slot].address) {
+            block.site = self->_blocks[slot].site;
+            block.clock = self->_blocks[slot].clock;
+            block.tag = self->_blocks[slot].tag;
+        }
+        TraceHeap_remove(self, block.PID, from);
+        block.address = to;
+    } else if (!TraceRecord_getAddress(record, "address", &block.address)) {
+        return Ok;
+    }
+    return (0 == block.address) ? Ok : TraceHeap_insert(self, &block);
+}
+
+Error TraceHeap_insert(struct TraceHeap *const self, const struct TraceBlock *const block) {
+    assert(NULL != self);
+    assert(NULL != block);
+    assert(0 != block->address);
+    if ((self->_length + 1) * 4 > self->_capacity * 3) {
+        const Error error = TraceHeap_grow(self, self->_length + 1);
+        if (Ok != error) {
+            return error;
+        }
+    }
+
+    struct TraceBlock *const slot = &self->_blocks[TraceHeap_slot(self, block->PID, block->address)];
+    if (0 == slot->address) {
+        self->_length += 1;
+    } else {
+        self->_bytes -= slot->size;
+    }
+    *slot = *block;
+    self->_bytes += block->size;
+    return Ok;
+}
+
+bool TraceHeap_remove(struct TraceHeap *const self, const long long PID, const uintptr_t address) {
+    assert(NULL != self);
+    if (0 == self->_length || 0 == address) {
+        return false;
+    }
+    const size_t mask = self->_capacity - 1;
+    size_t hole = TraceHeap_slot(self, PID, address);
+    if (0 == self->_blocks[hole].address) {
+        return false;
+    }
+    self->_bytes -= self->_blocks[hole].size;
+    self->_length -= 1;
+
+    // backward shift deletion, so that lookups never need tombstones
+    for (size_t i = (hole + 1) & mask; 0 != self->_blocks[i].address; i = (i + 1) & mask) {
+        const size_t home = TraceHeap_home(self, self->_blocks[i].PID, self->_blocks[i].address);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            self->_blocks[hole] = self->_blocks[i];
+            hole = i;
+        }
+    }
+    memset(&self->_blocks[hole], 0, sizeof(self->_blocks[hole]));
+    return true;
+}
+
+const struct TraceBlock *TraceHeap_next(const struct TraceHeap *const self, size_t *const cursor) {
+    assert(NULL != self);
+    assert(NULL != cursor);
+    for (; *cursor < self->_capacity; *cursor += 1) {
+        if (0 != self->_blocks[*cursor].address) {
+            return &self->_blocks[(*cursor)++];
+        }
+    }
+    return NULL;
+}
+
+size_t TraceHeap_length(const struct TraceHeap *const self) {
+    assert(NULL != self);
+    return self->_length;
+}
+
+size_t TraceHeap_bytes(const struct TraceHeap *const self) {
+    assert(NULL != self);
+    return self->_bytes;
+}
+
+void TraceHeap_clear(struct TraceHeap *const self) {
+    assert(NULL != self);
+    if (NULL != self->_blocks) {
+        memset(self->_blocks, 0, self->_capacity * sizeof(self->_blocks[0]));
+    }
+    self->_length = 0;
+    self->_bytes = 0;
+}
+
+void TraceHeap_teardown(struct TraceHeap *const self) {
+    assert(NULL != self);
+    free(self->_blocks);
+    memset(self, 0, sizeof(*self));
+}
+
+size_t TraceHeap_home(const struct TraceHeap *const self, const long long PID, const uintptr_t address) {
+    assert(NULL != self);
+    assert(self->_capacity > 0);
+    // the low bits of addresses are mostly zeros because of alignment: mix all of them into the low bits (the
+    // finalizer of splitmix64), so that tables of different capacities iterated in order do not cluster
+    uint64_t hash = (uint64_t) address ^ ((uint64_t) PID * UINT64_C(0x9E3779B97F4A7C15));
+    hash = (hash ^ (hash >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+    hash = (hash ^ (hash >> 27)) * UINT64_C(0x94D049BB133111EB);
+    return (size_t) (hash ^ (hash >> 31)) & (self->_capacity - 1);
+}
+
+size_t TraceHeap_slot(const struct TraceHeap *const self, const long long PID, const uintptr_t address) {
+    assert(NULL != self);
+    if (0 == self->_capacity) {
+        return 0;
+    }
+    const size_t mask = self->_capacity - 1;
+    size_t i = TraceHeap_home(self, PID, address);
+    while (0 != self->_blocks[i].address &&
+           !(address == self->_blocks[i].address && PID == self->_blocks[i].PID)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+Error TraceHeap_grow(struct TraceHeap *const self, const size_t length) {
+    assert(NULL != self);
+    struct TraceHeap grown = {._capacity=(0 == self->_capacity) ? TRACE_HEAP_CAPACITY : self->_capacity};
+    while (length * 4 > grown._capacity * 3) {
+        grown._capacity *= 2;
+    }
+    if (grown._capacity == self->_capacity) {
+        return Ok;
+    }
+    grown._blocks = calloc(grown._capacity, sizeof(grown._blocks[0]));
+    if (NULL == grown._blocks) {
+        return OutOfMemory;
+    }
+    for (size_t i = 0; i < self->_capacity; i++) {
+        if (0 != self->_blocks[i].address) {
+            grown._blocks[TraceHeap_slot(&grown, self->_blocks[i].PID, self->_blocks[i].address)] = self->_blocks[i];
+        }
+    }
+    grown._length = self->_length;
+    grown._bytes = self->_bytes;
+    free(self->_blocks);
+    *self = grown;
+    return Ok;
+}
+
+/*
+ * TraceIndex
+ */
+bool TraceChunk_mayContainAddress(const struct TraceChunk *const self, const uintptr_t address) {
+    assert(NULL != self);
+    return self->events > 0 && self->addressMin <= address && address <= self->addressMax;
+}
+
+bool TraceChunk_mayContainSite(const struct TraceChunk *const self, const uint64_t siteHash) {
+    assert(NULL != self);
+    const uint64_t first = siteHash & 0xFF, second = (siteHash >> 8) & 0xFF;
+    return 0 != (self->sites[first >> 6] & (UINT64_C(1) << (first & 63))) &&
+           0 != (self->sites[second >> 6] & (UINT64_C(1) << (second & 63)));
+}
+
+Error TraceIndex_build(const char *const path) {
+    assert(NULL != path);
+    char indexPath[4096], temporaryPath[4096];
+    struct TraceReader reader;
+    struct TraceRecord record;
+    struct TraceHeap heap;
+    struct TraceChunk chunk = {0};
+    size_t chunks = 0, sinceCheckpoint = 0, replayed = 0;
+    Error error = Ok;
+
+    if (snprintf(indexPath, sizeof(indexPath), "%s.index", path) >= (int) sizeof(indexPath) ||
+        snprintf(temporaryPath, sizeof(temporaryPath), "%s.index.tmp", path) >= (int) sizeof(temporaryPath)) {
+        return IllegalState;
+    }
+    error = TraceReader_open(&reader, path);
+    if (Ok != error) {
+        return error;
+    }
+    FILE *stream = fopen(temporaryPath, "w");
+    if (NULL == stream) {
+        TraceReader_close(&reader);
+        return IllegalState;
+    }
+    setvbuf(stream, NULL, _IOFBF, 1u << 20);
+    TraceHeap_init(&heap);
+
+    for (size_t start = 0; Ok == error;) {
+        const size_t offset = TraceReader_offset(&reader);
+        const bool isRecord = TraceReader_next(&reader, &record);
+        const char *kind;
+        size_t kindLength;
+
+        if (isRecord && !(TraceRecord_getString(&record, "record", &kind, &kindLength) &&
+                          5 == kindLength && 0 == memcmp("chunk", kind, 5))) {
+            if (record.isEvent) {
+                TraceChunk_add(&chunk, &record);
+                error = TraceHeap_apply(&heap, &record);
+            }
+            continue;
+        }
+
+        // a chunk record, written by the traced process, or the end of the trace closes the current chunk
+        chunk.offset = start;
+        chunk.length = offset - start;
+        if (chunk.length > 0) {
+            TraceIndex_writeChunk(stream, &chunk);
+            chunks += 1;
+            replayed += chunk.length;
+            // a checkpoint must be cheaper to read than the chunks it saves replaying
+            if (++sinceCheckpoint >= TRACE_INDEX_CHECKPOINT_INTERVAL &&
+                replayed >= TraceHeap_length(&heap) * TRACE_INDEX_BLOCK_SIZE) {
+                TraceIndex_writeCheckpoint(stream, chunks - 1, &heap);
+                sinceCheckpoint = 0;
+                replayed = 0;
+            }
+        }
+        if (!isRecord) {
+            break;
+        }
+        chunk = (struct TraceChunk) {0};
+        start = TraceReader_offset(&reader);
+    }
+
+    TraceHeap_teardown(&heap);
+    TraceReader_close(&reader);
+    if (0 != fclose(stream) || Ok != error || 0 != rename(temporaryPath, indexPath)) {
+        remove(temporaryPath);
+        return (Ok != error) ? error : IllegalState;
+    }
+    return Ok;
+}
+
+Error TraceIndex_open(struct TraceIndex *const self, const char *const path) {
+    assert(NULL != self);
+    assert(NULL != path);
+    char indexPath[4096];
+    struct TraceRecord record;
+    size_t capacity = 0;
+
+    memset(self, 0, sizeof(*self));
+    if (snprintf(indexPath, sizeof(indexPath), "%s.index", path) >= (int) sizeof(indexPath)) {
+        return IllegalState;
+    }
+    if (!TraceIndex_isUpToDate(path, indexPath)) {
+        const Error error = TraceIndex_build(path);
+        if (Ok != error) {
+            return error;
+        }
+    }
+    const Error error = TraceReader_open(&self->_reader, indexPath);
+    if (Ok != error) {
+        return error;
+    }
+
+    for (size_t offset = 0; TraceReader_next(&self->_reader, &record); offset = TraceReader_offset(&self->_reader)) {
+        long long blocks, length;
+        if (self->_length > 0 && TraceRecord_getInteger(&record, "blocks", &blocks)) {
+            // skip the blocks of the checkpoint, they are read only when loading it
+            self->_chunks[self->_length - 1].checkpoint = offset;
+            if (TraceRecord_getInteger(&record, "length", &length)) {
+                TraceReader_seek(&self->_reader, TraceReader_offset(&self->_reader) + (size_t) length);
+            } else {
+                for (long long i = 0; i < blocks && TraceReader_next(&self->_reader, &record); i++) {}
+            }
+            continue;
+        }
+        if (self->_length == capacity) {
+            capacity = (0 == capacity) ? 64 : capacity * 2;
+            struct TraceChunk *chunks = realloc(self->_chunks, capacity * sizeof(chunks[0]));
+            if (NULL == chunks) {
+                TraceIndex_close(self);
+                return OutOfMemory;
+            }
+            self->_chunks = chunks;
+        }
+        if (TraceChunk_parse(&self->_chunks[self->_length], &record)) {
+            self->_length += 1;
+        }
+    }
+    return Ok;
+}
+
+size_t TraceIndex_length(const struct TraceIndex *const self) {
+    assert(NULL != self);
+    return self->_length;
+}
+
+const struct TraceChunk *TraceIndex_getChunk(const struct TraceIndex *const self, const size_t index) {
+    assert(NULL != self);
+    assert(index < self->_length);
+    return &self->_chunks[index];
+}
+
+size_t TraceIndex_findChunk(const struct TraceIndex *const self, const long long clock) {
+    assert(NULL != self);
+    // chunks are ordered by clock: binary search the first one ending at or after clock
+    size_t low = 0, high = self->_length;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (self->_chunks[middle].events > 0 && self->_chunks[middle].clockMax < clock) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+size_t TraceIndex_loadCheckpoint(struct TraceIndex *const self, const size_t chunk, struct TraceHeap *const heap) {
+    assert(NULL != self);
+    assert(NULL != heap);
+    struct TraceRecord record;
+    long long blocks;
+    size_t i = (chunk < self->_length) ? chunk : self->_length;
+
+    TraceHeap_clear(heap);
+    while (i > 0 && SIZE_MAX == self->_chunks[i - 1].checkpoint) {
+        i -= 1;
+    }
+    if (0 == i) {
+        return 0;
+    }
+
+    TraceReader_seek(&self->_reader, self->_chunks[i - 1].checkpoint);
+    if (!TraceReader_next(&self->_reader, &record) || !TraceRecord_getInteger(&record, "blocks", &blocks)) {
+        return 0;
+    }
+    // blocks come in the order of the table they were written from: growing while inserting them would fill
+    // the first slots twice as densely as the others, clustering them
+    if (Ok != TraceHeap_grow(heap, (size_t) blocks)) {
+        return 0;
+    }
+    for (long long j = 0; j < blocks && TraceReader_next(&self->_reader, &record); j++) {
+        struct TraceBlock block;
+        long long size, clock, tag;
+        // blocks of indexes written before they carried a PID cannot be told apart, the trace is replayed instead
+        if (!TraceRecord_getInteger(&record, "PID", &block.PID)) {
+            TraceHeap_clear(heap);
+            return 0;
+        }
+        if (TraceRecord_getAddress(&record, "address", &block.address) &&
+            TraceRecord_getInteger(&record, "size", &size) && TraceRecord_getInteger(&record, "clock", &clock) &&
+            TraceRecord_getSite(&record, &block.site)) {
+            block.size = (size_t) size;
+            block.clock = clock;
+            block.tag = TraceRecord_getInteger(&record, "tag", &tag) ? (uint32_t) tag : 0;
+            if (Ok != TraceHeap_insert(heap, &block)) {
+                TraceHeap_clear(heap);
+                return 0;
+            }
+        }
+    }
+    return i;
+}
+
+Error TraceIndex_rebuild(struct TraceIndex *const self, struct TraceReader *const trace, const long long clock,
+                         struct TraceHeap *const heap, size_t *const replayedChunks) {
+    assert(NULL != self);
+    assert(NULL != trace);
+    assert(NULL != heap);
+    struct TraceRecord record;
+
+    // restore the closest checkpoint, then replay the chunks up to the one holding clock
+    const size_t last = TraceIndex_findChunk(self, clock);
+    const size_t first = TraceIndex_loadCheckpoint(self, last, heap);
+    if (first < self->_length) {
+        const struct TraceChunk *end = &self->_chunks[(last < self->_length) ? last : last - 1];
+        TraceReader_seek(trace, self->_chunks[first].offset);
+        while (TraceReader_offset(trace) < end->offset + end->length && TraceReader_next(trace, &record) &&
+               record.clock <= clock) {
+            const Error error = TraceHeap_apply(heap, &record);
+            if (Ok != error) {
+                return error;
+            }
+        }
+    }
+    if (NULL != replayedChunks) {
+        *replayedChunks = (last < self->_length ? last + 1 : last) - first;
+    }
+    return Ok;
+}
+
+void TraceIndex_close(struct TraceIndex *const self) {
+    assert(NULL != self);
+    TraceReader_close(&self->_reader);
+    free(self->_chunks);
+    memset(self, 0, sizeof(*self));
+}
+
+void TraceIndex_writeChunk(FILE *const stream, const struct TraceChunk *const chunk) {
+    assert(NULL != stream);
+    assert(NULL != chunk);
+    fprintf(stream,
+            "{\"record\": \"chunk\", \"offset\": %zu, \"length\": %zu, \"events\": %zu, \"clockMin\": %lld, \"clockMax\": %lld, \"addressMin\": \"0x%" PRIxPTR "\", \"addressMax\": \"0x%" PRIxPTR "\", \"sites\": \"%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "%016" PRIx64 "\"}\n",
+            chunk->offset, chunk->length, chunk->events, chunk->clockMin, chunk->clockMax,
+            chunk->addressMin, chunk->addressMax, chunk->sites[0], chunk->sites[1], chunk->sites[2], chunk->sites[3]);
+}
+
+void TraceIndex_writeCheckpoint(FILE *const stream, const size_t chunk, const struct TraceHeap *const heap) {
+    assert(NULL != stream);
+    assert(NULL != heap);
+    const struct TraceBlock *block;
+    size_t cursor = 0;
+    const long start = ftell(stream);
+
+    // the length of the blocks is patched once written, so that readers can skip them, hence the fixed width
+    fprintf(stream, "{\"record\": \"checkpoint\", \"chunk\": %zu, \"blocks\": %zu, \"bytes\": %zu, \"length\": %-20zu}\n",
+            chunk, TraceHeap_length(heap), TraceHeap_bytes(heap), (size_t) 0);
+    const long header = ftell(stream);
+    while (NULL != (block = TraceHeap_next(heap, &cursor))) {
+        fprintf(stream,
+                "{\"PID\": %lld, \"address\": \"0x%" PRIxPTR "\", \"size\": %zu, \"clock\": %lld, \"file\": \"%.*s\", \"func\": \"%.*s\", \"line\": %ld",
+                block->PID, block->address, block->size, block->clock, (int) block->site.fileLength, block->site.file,
+                (int) block->site.funcLength, block->site.func, block->site.line);
+        if (0 != block->tag) {
+            fprintf(stream, ", \"tag\": %" PRIu32, block->tag);
+        }
+        fputs("}\n", stream);
+    }
+    const long end = ftell(stream);
+    if (start >= 0 && header >= 0 && end >= 0 && 0 == fseek(stream, start, SEEK_SET)) {
+        fprintf(stream, "{\"record\": \"checkpoint\", \"chunk\": %zu, \"blocks\": %zu, \"bytes\": %zu, \"length\": %-20zu}\n",
+                chunk, TraceHeap_length(heap), TraceHeap_bytes(heap), (size_t) (end - header));
+        fseek(stream, end, SEEK_SET);
+    }
+}
+
+bool TraceIndex_isUpToDate(const char *const path, const char *const indexPath) {
+    assert(NULL != path);
+    assert(NULL != indexPath);
+    struct stat trace, index;
+    if (0 != stat(path, &trace) || 0 != stat(indexPath, &index)) {
+        return false;
+    }
+    return index.st_mtim.tv_sec > trace.st_mtim.tv_sec ||
+           (index.st_mtim.tv_sec == trace.st_mtim.tv_sec && index.st_mtim.tv_nsec >= trace.st_mtim.tv_nsec);
+}
+
+void TraceChunk_add(struct TraceChunk *const self, const struct TraceRecord *const event) {
+    assert(NULL != self);
+    assert(NULL != event);
+    uintptr_t low, high;
+    struct TraceSite site;
+
+    if (TraceRecord_getAddress(event, "from", &low) && TraceRecord_getAddress(event, "to", &high)) {
+        if (0 != low && low > high) {
+            const uintptr_t swap = low;
+            low = high;
+            high = swap;
+        }
+        low = (0 == low) ? high : low;
+    } else if (TraceRecord_getAddress(event, "address", &low)) {
+        high = low;
+    } else {
+        return;
+    }
+
+    if (0 == self->events++) {
+        self->clockMin = self->clockMax = event->clock;
+        self->addressMin = low;
+        self->addressMax = high;
+    } else {
+        self->clockMin = (event->clock < self->clockMin) ? event->clock : self->clockMin;
+        self->clockMax = (event->clock > self->clockMax) ? event->clock : self->clockMax;
+        self->addressMin = (low < self->addressMin) ? low : self->addressMin;
+        self->addressMax = (high > self->addressMax) ? high : self->addressMax;
+    }
+    if (TraceRecord_getSite(event, &site)) {
+        const uint64_t hash = TraceSite_hash(&site), first = hash & 0xFF, second = (hash >> 8) & 0xFF;
+        self->sites[first >> 6] |= UINT64_C(1) << (first & 63);
+        self->sites[second >> 6] |= UINT64_C(1) << (second & 63);
+    }
+}
+
+bool TraceChunk_parse(struct TraceChunk *const self, const struct TraceRecord *const record) {
+    assert(NULL != self);
+    assert(NULL != record);
+    long long offset, length, events, clockMin, clockMax;
+    const char *sites;
+    size_t sitesLength;
+
+    if (!TraceRecord_getInteger(record, "offset", &offset) || !TraceRecord_getInteger(record, "length", &length) ||
+        !TraceRecord_getInteger(record, "events", &events) ||
+        !TraceRecord_getInteger(record, "clockMin", &clockMin) ||
+        !TraceRecord_getInteger(record, "clockMax", &clockMax) ||
+        !TraceRecord_getAddress(record, "addressMin", &self->addressMin) ||
+        !TraceRecord_getAddress(record, "addressMax", &self->addressMax) ||
+        !TraceRecord_getString(record, "sites", &sites, &sitesLength) || 64 != sitesLength) {
+        return false;
+    }
+    for (size_t i = 0; i < 4; i++) {
+        char digits[17] = {0};
+        memcpy(digits, sites + 16 * i, 16);
+        self->sites[i] = (uint64_t) strtoull(digits, NULL, 16);
+    }
+    self->offset = (size_t) offset;
+    self->length = (size_t) length;
+    self->events = (size_t) events;
+    self->clockMin = clockMin;
+    self->clockMax = clockMax;
+    self->checkpoint = SIZE_MAX;
+    return true;
+}
+
+/*
+ * TraceSnapshot
+ */
+void TraceSnapshot_init(struct TraceSnapshot *const self) {
+    assert(NULL != self);
+    memset(self, 0, sizeof(*self));
+}
+
+Error TraceSnapshot_add(struct TraceSnapshot *const self, const struct TraceSite *const site,
+                        const size_t bytes, const size_t blocks) {
+    assert(NULL != self);
+    assert(NULL != site);
+    struct TraceSiteUsage *usage;
+    const Error error = TraceSnapshot_get(self, site, &usage);
+    if (Ok != error) {
+        return error;
+    }
+    usage->bytes += bytes;
+    usage->blocks += blocks;
+    self->_bytes += bytes;
+    self->_blocks += blocks;
+    return Ok;
+}
+
+Error TraceSnapshot_addAllocation(struct TraceSnapshot *const self, const struct TraceSite *const site,
+                                  const size_t size) {
+    assert(NULL != self);
+    assert(NULL != site);
+    struct TraceSiteUsage *usage;
+    const Error error = TraceSnapshot_get(self, site, &usage);
+    if (Ok != error) {
+        return error;
+    }
+    usage->allocatedBytes += size;
+    usage->allocations += 1;
+    self->_allocatedBytes += size;
+    self->_allocations += 1;
+    return Ok;
+}
+
+Error TraceSnapshot_addEvent(struct TraceSnapshot *const self, const struct TraceRecord *const record) {
+    assert(NULL != self);
+    assert(NULL != record);
+    const char *call;
+    size_t callLength;
+    uintptr_t address;
+    long long size;
+    struct TraceSite site;
+
+    if (!record->isEvent || !TraceRecord_getString(record, "call", &call, &callLength) ||
+        (4 == callLength && 0 == memcmp("free", call, 4)) ||
+        !(TraceRecord_getAddress(record, "to", &address) || TraceRecord_getAddress(record, "address", &address)) ||
+        0 == address || !TraceRecord_getInteger(record, "size", &size) || !TraceRecord_getSite(record, &site)) {
+        return Ok;
+    }
+    return TraceSnapshot_addAllocation(self, &site, (size_t) size);
+}
+
+Error TraceSnapshot_apply(struct TraceSnapshot *const self, const struct TraceRecord *const record,
+                          const long long snapshot) {
+    assert(NULL != self);
+    assert(NULL != record);
+    const char *kind;
+    size_t kindLength;
+    long long id, bytes, blocks, allocatedBytes, allocations;
+    struct TraceSite site;
+    struct TraceSiteUsage *usage;
+
+    if (record->isEvent || !TraceRecord_getString(record, "record", &kind, &kindLength) ||
+        12 != kindLength || 0 != memcmp("snapshotSite", kind, 12) ||
+        !TraceRecord_getInteger(record, "snapshot", &id) || id != snapshot ||
+        !TraceRecord_getInteger(record, "liveBytes", &bytes) ||
+        !TraceRecord_getInteger(record, "liveBlocks", &blocks) || !TraceRecord_getSite(record, &site)) {
+        return Ok;
+    }
+    const Error error = TraceSnapshot_get(self, &site, &usage);
+    if (Ok != error) {
+        return error;
+    }
+    usage->bytes += (size_t) bytes;
+    usage->blocks += (size_t) blocks;
+    self->_bytes += (size_t) bytes;
+    self->_blocks += (size_t) blocks;
+    // cumulative allocations are missing from the snapshots of older traces
+    if (TraceRecord_getInteger(record, "allocatedBytes", &allocatedBytes) &&
+        TraceRecord_getInteger(record, "allocations", &allocations)) {
+        usage->allocatedBytes += (size_t) allocatedBytes;
+        usage->allocations += (size_t) allocations;
+        self->_allocatedBytes += (size_t) allocatedBytes;
+        self->_allocations += (size_t) allocations;
+    }
+    return Ok;
+}
+
+Error TraceSnapshot_addHeap(struct TraceSnapshot *const self, const struct TraceHeap *const heap) {
+    assert(NULL != self);
+    assert(NULL != heap);
+    const struct TraceBlock *block;
+    size_t cursor = 0;
+    while (NULL != (block = TraceHeap_next(heap, &cursor))) {
+        const Error error = TraceSnapshot_add(self, &block->site, block->size, 1);
+        if (Ok != error) {
+            return error;
+        }
+    }
+    return Ok;
+}
+
+const struct TraceSiteUsage *TraceSnapshot_find(const struct TraceSnapshot *const self,
+                                                const struct TraceSite *const site) {
+    assert(NULL != self);
+    assert(NULL != site);
+    if (0 == self->_length) {
+        return NULL;
+    }
+    const struct TraceSiteUsage *usage = &self->_usages[TraceSnapshot_slot(self, site, TraceSnapshot_hash(site))];
+    return (NULL == usage->site.file) ? NULL : usage;
+}
+
+const struct TraceSiteUsage *TraceSnapshot_next(const struct TraceSnapshot *const self, size_t *const cursor) {
+    assert(NULL != self);
+    assert(NULL != cursor);
+    for (; *cursor < self->_capacity; *cursor += 1) {
+        if (NULL != self->_usages[*cursor].site.file) {
+            return &self->_usages[(*cursor)++];
+        }
+    }
+    return NULL;
+}
+
+size_t TraceSnapshot_length(const struct TraceSnapshot *const self) {
+    assert(NULL != self);
+    return self->_length;
+}
+
+size_t TraceSnapshot_bytes(const struct TraceSnapshot *const self) {
+    assert(NULL != self);
+    return self->_bytes;
+}
+
+size_t TraceSnapshot_blocks(const struct TraceSnapshot *const self) {
+    assert(NULL != self);
+    return self->_blocks;
+}
+
+size_t TraceSnapshot_allocatedBytes(const struct TraceSnapshot *const self) {
+    assert(NULL != self);
+    return self->_allocatedBytes;
+}
+
+size_t TraceSnapshot_allocations(const struct TraceSnapshot *const self) {
+    assert(NULL != self);
+    return self->_allocations;
+}
+
+void TraceSnapshot_teardown(struct TraceSnapshot *const self) {
+    assert(NULL != self);
+    free(self->_usages);
+    memset(self, 0, sizeof(*self));
+}
+
+Error TraceSnapshot_diff(const struct TraceSnapshot *const before, const struct TraceSnapshot *const after,
+                         struct TraceSiteDelta **const deltas, size_t *const length) {
+    assert(NULL != before);
+    assert(NULL != after);
+    assert(NULL != deltas);
+    assert(NULL != length);
+    const struct TraceSiteUsage *usage;
+    size_t cursor = 0, count = 0;
+
+    *deltas = NULL;
+    *length = 0;
+    struct TraceSiteDelta *result = malloc((before->_length + after->_length + 1) * sizeof(result[0]));
+    if (NULL == result) {
+        return OutOfMemory;
+    }
+
+    // sites without live blocks, e.g. in snapshots holding cumulative allocations too, count as missing
+    while (NULL != (usage = TraceSnapshot_next(after, &cursor))) {
+        const struct TraceSiteUsage *previous = TraceSnapshot_find(before, &usage->site);
+        struct TraceSiteDelta delta = {
+                .site=usage->site, .bytesAfter=usage->bytes, .blocksAfter=usage->blocks,
+                .bytesBefore=(NULL == previous) ? 0 : previous->bytes,
+                .blocksBefore=(NULL == previous) ? 0 : previous->blocks,
+        };
+        if (0 == delta.blocksBefore && 0 == delta.blocksAfter) {
+            continue;
+        }
+        delta.change = (0 == delta.blocksBefore) ? TRACE_SITE_NEW :
+                       (0 == delta.blocksAfter) ? TRACE_SITE_VANISHED : TRACE_SITE_CHANGED;
+        delta.bytes = (long long) delta.bytesAfter - (long long) delta.bytesBefore;
+        delta.blocks = (long long) delta.blocksAfter - (long long) delta.blocksBefore;
+        if (TRACE_SITE_CHANGED != delta.change || 0 != delta.bytes || 0 != delta.blocks) {
+            result[count++] = delta;
+        }
+    }
+    for (cursor = 0; NULL != (usage = TraceSnapshot_next(before, &cursor));) {
+        if (0 != usage->blocks && NULL == TraceSnapshot_find(after, &usage->site)) {
+            result[count++] = (struct TraceSiteDelta) {
+                    .site=usage->site, .change=TRACE_SITE_VANISHED,
+                    .bytesBefore=usage->bytes, .blocksBefore=usage->blocks,
+                    .bytes=-(long long) usage->bytes, .blocks=-(long long) usage->blocks,
+            };
+        }
+    }
+
+    qsort(result, count, sizeof(result[0]), TraceSiteDelta_compare);
+    *deltas = result;
+    *length = count;
+    return Ok;
+}
+
+uint64_t TraceSnapshot_hash(const struct TraceSite *const site) {
+    assert(NULL != site);
+    uint64_t hash = UINT64_C(14695981039346656037) ^ (uint64_t) site->line;
+    for (size_t i = 0; i < site->fileLength; i++) {
+        hash = (hash ^ (unsigned char) site->file[i]) * UINT64_C(1099511628211);
+    }
+    for (size_t i = 0; i < site->funcLength; i++) {
+        hash = (hash ^ (unsigned char) site->func[i]) * UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+size_t TraceSnapshot_slot(const struct TraceSnapshot *const self, const struct TraceSite *const site,
+                          const uint64_t hash) {
+    assert(NULL != self);
+    assert(NULL != site);
+    assert(self->_capacity > 0);
+    const size_t mask = self->_capacity - 1;
+    size_t i = (size_t) (hash & mask);
+    for (;; i = (i + 1) & mask) {
+        const struct TraceSiteUsage *usage = &self->_usages[i];
+        if (NULL == usage->site.file ||
+            (hash == usage->hash && site->line == usage->site.line &&
+             site->fileLength == usage->site.fileLength && site->funcLength == usage->site.funcLength &&
+             0 == memcmp(site->file, usage->site.file, site->fileLength) &&
+             0 == memcmp(site->func, usage->site.func, site->funcLength))) {
+            return i;
+        }
+    }
+}
+
+Error TraceSnapshot_grow(struct TraceSnapshot *const self) {
+    assert(NULL != self);
+    struct TraceSnapshot grown = {._capacity=(0 == self->_capacity) ? TRACE_SNAPSHOT_CAPACITY : self->_capacity * 2};
+    grown._usages = calloc(grown._capacity, sizeof(grown._usages[0]));
+    if (NULL == grown._usages) {
+        return OutOfMemory;
+    }
+    for (size_t i = 0; i < self->_capacity; i++) {
+        const struct TraceSiteUsage *usage = &self->_usages[i];
+        if (NULL != usage->site.file) {
+            grown._usages[TraceSnapshot_slot(&grown, &usage->site, usage->hash)] = *usage;
+        }
+    }
+    grown._length = self->_length;
+    grown._bytes = self->_bytes;
+    grown._blocks = self->_blocks;
+    grown._allocatedBytes = self->_allocatedBytes;
+    grown._allocations = self->_allocations;
+    free(self->_usages);
+    *self = grown;
+    return Ok;
+}
+
+Error TraceSnapshot_get(struct TraceSnapshot *const self, const struct TraceSite *const site,
+                        struct TraceSiteUsage **const out) {
+    assert(NULL != self);
+    assert(NULL != site);
+    assert(NULL != out);
+    if ((self->_length + 1) * 4 > self->_capacity * 3) {
+        const Error error = TraceSnapshot_grow(self);
+        if (Ok != error) {
+            return error;
+        }
+    }
+
+    const uint64_t hash = TraceSnapshot_hash(site);
+    struct TraceSiteUsage *const usage = &self->_usages[TraceSnapshot_slot(self, site, hash)];
+    if (NULL == usage->site.file) {
+        *usage = (struct TraceSiteUsage) {.site=*site, .hash=hash};
+        self->_length += 1;
+    }
+    *out = usage;
+    return Ok;
+}
+
+int TraceSiteDelta_compare(const void *const a, const void *const b) {
+    assert(NULL != a);
+    assert(NULL != b);
+    const struct TraceSiteDelta *x = a, *y = b;
+    if (x->change != y->change) {
+        return (x->change < y->change) ? -1 : 1;
+    }
+    // vanished sites have negative growth only: the most shrunk comes first
+    const long long sign = (TRACE_SITE_VANISHED == x->change) ? -1 : 1;
+    if (x->bytes != y->bytes) {
+        return (sign * x->bytes > sign * y->bytes) ? -1 : 1;
+    }
+    if (x->blocks != y->blocks) {
+        return (sign * x->blocks > sign * y->blocks) ? -1 : 1;
+    }
+    return 0;
+}
+
+/*
+ * TraceSymbolizer
+ */
+void TraceSymbolizer_init(struct TraceSymbolizer *const self) {
+    assert(NULL != self);
+    memset(self, 0, sizeof(*self));
+}
+
+Error TraceSymbolizer_apply(struct TraceSymbolizer *const self, const struct TraceRecord *const record) {
+    assert(NULL != self);
+    assert(NULL != record);
+    const char *kind, *path, *buildId;
+    size_t kindLength, pathLength, buildIdLength;
+    long long PID;
+
+    if (record->isEvent || !TraceRecord_getString(record, "record", &kind, &kindLength) ||
+        !TraceRecord_getInteger(record, "PID", &PID)) {
+        return Ok;
+    }
+
+    if (7 == kindLength && 0 == memcmp("objects", kind, 7)) {
+        // the listing is complete: it replaces the previous one of the process
+        size_t length = 0;
+        for (size_t i = 0; i < self->_objectsLength; i++) {
+            struct TraceLoadedObject *const object = &self->_objects[i];
+            if (object->PID != PID || object->isPending) {
+                object->isPending = object->isPending && object->PID != PID;
+                self->_objects[length++] = *object;
+            }
+        }
+        self->_objectsLength = length;
+        return Ok;
+    }
+
+    struct TraceLoadedObject object = {.PID=PID, .isPending=true};
+    if (!(6 == kindLength && 0 == memcmp("object", kind, 6)) ||
+        !TraceRecord_getString(record, "path", &path, &pathLength) ||
+        !TraceRecord_getString(record, "buildId", &buildId, &buildIdLength) ||
+        !TraceRecord_getAddress(record, "base", &object.base) ||
+        !TraceRecord_getAddress(record, "start", &object.start) ||
+        !TraceRecord_getAddress(record, "end", &object.end)) {
+        return Ok;
+    }
+    if (self->_objectsLength == self->_objectsCapacity) {
+        const size_t capacity = (0 == self->_objectsCapacity) ? 16 : 2 * self->_objectsCapacity;
+        struct TraceLoadedObject *objects = realloc(self->_objects, capacity * sizeof(objects[0]));
+        if (NULL == objects) {
+            return OutOfMemory;
+        }
+        self->_objects = objects;
+        self->_objectsCapacity = capacity;
+    }
+    const Error error = TraceSymbolizer_getFile(self, path, pathLength, buildId, buildIdLength, &object.file);
+    if (Ok != error) {
+        return error;
+    }
+    self->_objects[self->_objectsLength++] = object;
+    return Ok;
+}
+
+Error TraceSymbolizer_resolve(struct TraceSymbolizer *const self, const long long PID, const uintptr_t address,
+                              struct TraceSymbol *const out) {
+    assert(NULL != self);
+    assert(NULL != out);
+    *out = (struct TraceSymbol) {.path=NULL, .name=NULL, .offset=address};
+
+    const struct TraceLoadedObject *object = NULL;
+    for (size_t i = 0; i < self->_objectsLength && NULL == object; i++) {
+        const struct TraceLoadedObject *const candidate = &self->_objects[i];
+        if (candidate->PID == PID && !candidate->isPending && candidate->start <= address && address < candidate->end) {
+            object = candidate;
+        }
+    }
+    if (NULL == object) {
+        return Ok;
+    }
+
+    struct TraceObjectFile *const file = &self->_files[object->file];
+    if (!file->isRead) {
+        const Error error = TraceObjectFile_read(file);
+        if (Ok != error) {
+            return error;
+        }
+    }
+    const uintptr_t relative = address - object->base;
+    out->path = file->path;
+    out->offset = relative;
+
+    // the last function starting at or before the address
+    size_t low = 0, high = file->length;
+    while (low < high) {
+        const size_t middle = low + (high - low) / 2;
+        if (file->functions[middle].address <= relative) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low > 0) {
+        const struct TraceFunction *const function = &file->functions[low - 1];
+        if (0 == function->size || relative < function->address + function->size) {
+            out->name = function->name;
+            out->offset = relative - function->address;
+        }
+    }
+    return Ok;
+}
+
+void TraceSymbolizer_teardown(struct TraceSymbolizer *const self) {
+    assert(NULL != self);
+    for (size_t i = 0; i < self->_filesLength; i++) {
+        TraceObjectFile_release(&self->_files[i]);
+        free(self->_files[i].path);
+        free(self->_files[i].buildId);
+    }
+    free(self->_files);
+    free(self->_objects);
+    memset(self, 0, sizeof(*self));
+}
+
+Error TraceSymbolizer_getFile(struct TraceSymbolizer *const self, const char *const path, const size_t pathLength,
+                              const char *const buildId, const size_t buildIdLength, size_t *const out) {
+    assert(NULL != self);
+    assert(NULL != path);
+    assert(NULL != buildId);
+    assert(NULL != out);
+    // files are few and shared by the processes of a trace: a linear scan is enough
+    for (size_t i = 0; i < self->_filesLength; i++) {
+        const struct TraceObjectFile *const file = &self->_files[i];
+        if (0 == strncmp(file->path, path, pathLength) && '\0' == file->path[pathLength] &&
+            0 == strncmp(file->buildId, buildId, buildIdLength) && '\0' == file->buildId[buildIdLength]) {
+            *out = i;
+            return Ok;
+        }
+    }
+
+    if (self->_filesLength == self->_filesCapacity) {
+        const size_t capacity = (0 == self->_filesCapacity) ? 16 : 2 * self->_filesCapacity;
+        struct TraceObjectFile *files = realloc(self->_files, capacity * sizeof(files[0]));
+        if (NULL == files) {
+            return OutOfMemory;
+        }
+        self->_files = files;
+        self->_filesCapacity = capacity;
+    }
+    struct TraceObjectFile file = {.path=strndup(path, pathLength), .buildId=strndup(buildId, buildIdLength)};
+    if (NULL == file.path || NULL == file.buildId) {
+        free(file.path);
+        free(file.buildId);
+        return OutOfMemory;
+    }
+    *out = self->_filesLength;
+    self->_files[self->_filesLength++] = file;
+    return Ok;
+}
+
+Error TraceObjectFile_read(struct TraceObjectFile *const self) {
+    assert(NULL != self);
+    bool hasSymbols = false;
+    self->isRead = true;
+
+    // paths are kept JSON escaped as in the trace, since symbols are written back into records
+    char *path = strdup(self->path);
+    if (NULL == path) {
+        return OutOfMemory;
+    }
+    TraceObjectFile_unescape(path);
+    Error error = TraceObjectFile_load(self, path, &hasSymbols);
+    free(path);
+    if (Ok != error || hasSymbols || '\0' == self->buildId[0] || '\0' == self->buildId[1]) {
+        return error;
+    }
+
+    // stripped objects may have their symbols installed apart, named after the build id
+    char *debugPath = NULL;
+    if (asprintf(&debugPath, TRACE_DEBUG_DIRECTORY "/%.2s/%s.debug", self->buildId, self->buildId + 2) < 0) {
+        return OutOfMemory;
+    }
+    struct TraceObjectFile debug = {.buildId=self->buildId};
+    error = TraceObjectFile_load(&debug, debugPath, &hasSymbols);
+    free(debugPath);
+    if (Ok == error && hasSymbols) {
+        TraceObjectFile_release(self);
+        self->mapping = debug.mapping;
+        self->size = debug.size;
+        self->functions = debug.functions;
+        self->length = debug.length;
+    } else {
+        TraceObjectFile_release(&debug);
+    }
+    return error;
+}
+
+void TraceObjectFile_unescape(char *const path) {
+    assert(NULL != path);
+    char *out = path;
+    for (const char *cursor = path; '\0' != *cursor; cursor++) {
+        unsigned int code;
+        if ('\\' != cursor[0] || '\0' == cursor[1]) {
+            *out++ = *cursor;
+        } else if ('u' == cursor[1] && 1 == sscanf(cursor + 2, "%4x", &code) && code < 0x80) {
+            // the library escapes control characters only
+            *out++ = (char) code;
+            cursor += 5;
+        } else {
+            *out++ = *++cursor;
+        }
+    }
+    *out = '\0';
+}
+
+Error TraceObjectFile_load(struct TraceObjectFile *const self, const char *const path, bool *const hasSymbols) {
+    assert(NULL != self);
+    assert(NULL != path);
+    assert(NULL != hasSymbols);
+    struct stat info;
+    *hasSymbols = false;
+
+    // files which cannot be read, e.g. the vDSO, resolve addresses to the object only
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return Ok;
+    }
+    if (0 != fstat(fd, &info) || (size_t) info.st_size < sizeof(ElfW(Ehdr))) {
+        close(fd);
+        return Ok;
+    }
+    void *mapping = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == mapping) {
+        return Ok;
+    }
+
+    const char *const data = mapping;
+    const size_t size = (size_t) info.st_size;
+    const ElfW(Ehdr) *const header = mapping;
+    if (0 != memcmp(ELFMAG, header->e_ident, SELFMAG) || TRACE_ELF_CLASS != header->e_ident[EI_CLASS] ||
+        header->e_shoff > size || header->e_shnum > (size - header->e_shoff) / sizeof(ElfW(Shdr)) ||
+        !TraceObjectFile_hasBuildId(self, header)) {
+        munmap(mapping, size);
+        return Ok;
+    }
+
+    // the full symbol table if any, else the dynamic one
+    const ElfW(Shdr) *const sections = (const ElfW(Shdr) *) (data + header->e_shoff);
+    const ElfW(Shdr) *table = NULL;
+    for (size_t i = 0; i < header->e_shnum; i++) {
+        if (SHT_SYMTAB == sections[i].sh_type ||
+            (SHT_DYNSYM == sections[i].sh_type && NULL == table)) {
+            table = &sections[i];
+        }
+    }
+    if (NULL == table || table->sh_link >= header->e_shnum || table->sh_offset > size ||
+        table->sh_size > size - table->sh_offset || sections[table->sh_link].sh_offset > size ||
+        sections[table->sh_link].sh_size > size - sections[table->sh_link].sh_offset) {
+        munmap(mapping, size);
+        return Ok;
+    }
+
+    const ElfW(Sym) *const symbols = (const ElfW(Sym) *) (data + table->sh_offset);
+    const size_t count = table->sh_size / sizeof(ElfW(Sym));
+    const char *const strings = data + sections[table->sh_link].sh_offset;
+    const size_t stringsSize = sections[table->sh_link].sh_size;
+    struct TraceFunction *functions = malloc((count + 1) * sizeof(functions[0]));
+    if (NULL == functions) {
+        munmap(mapping, size);
+        return OutOfMemory;
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+        const ElfW(Sym) *const symbol = &symbols[i];
+        const unsigned type = ELF64_ST_TYPE(symbol->st_info);   // the same for both classes
+        if ((STT_FUNC == type || STT_GNU_IFUNC == type) && SHN_UNDEF != symbol->st_shndx &&
+            0 != symbol->st_value && symbol->st_name < stringsSize &&
+            NULL != memchr(strings + symbol->st_name, '\0', stringsSize - symbol->st_name)) {
+            functions[length++] = (struct TraceFunction) {
+                    .address=(uintptr_t) symbol->st_value, .size=(size_t) symbol->st_size,
+                    .name=strings + symbol->st_name
+            };
+        }
+    }
+    qsort(functions, length, sizeof(functions[0]), TraceFunction_compare);
+
+    TraceObjectFile_release(self);
+    self->mapping = mapping;
+    self->size = size;
+    self->functions = functions;
+    self->length = length;
+    *hasSymbols = SHT_SYMTAB == table->sh_type;
+    return Ok;
+}
+
+bool TraceObjectFile_hasBuildId(const struct TraceObjectFile *const self, const ElfW(Ehdr) *const header) {
+    assert(NULL != self);
+    assert(NULL != header);
+    const char *const data = (const char *) header;
+    const ElfW(Shdr) *const sections = (const ElfW(Shdr) *) (data + header->e_shoff);
+    if ('\0' == self->buildId[0]) {
+        return true;    // nothing to compare with
+    }
+
+    for (size_t i = 0; i < header->e_shnum; i++) {
+        if (SHT_NOTE != sections[i].sh_type) {
+            continue;
+        }
+        const size_t alignment = (8 == sections[i].sh_addralign) ? 8 : 4;
+        const char *note = data + sections[i].sh_offset;
+        const char *const end = note + sections[i].sh_size;
+        while (note + sizeof(ElfW(Nhdr)) <= end) {
+            const ElfW(Nhdr) *const entry = (const ElfW(Nhdr) *) note;
+            const char *const name = note + sizeof(*entry);
+            const unsigned char *const description = (const unsigned char *) name +
+                                                     ((entry->n_namesz + alignment - 1) & ~(alignment - 1));
+            if (NT_GNU_BUILD_ID == entry->n_type && 4 == entry->n_namesz && 0 == memcmp("GNU", name, 4)) {
+                char digits[3];
+                if (strlen(self->buildId) != 2 * (size_t) entry->n_descsz) {
+                    return false;
+                }
+                for (size_t j = 0; j < entry->n_descsz; j++) {
+                    snprintf(digits, sizeof(digits), "%02x", description[j]);
+                    if (0 != memcmp(digits, self->buildId + 2 * j, 2)) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            note = (const char *) description + ((entry->n_descsz + alignment - 1) & ~(alignment - 1));
+        }
+    }
+    return false;
+}
+
+void TraceObjectFile_release(struct TraceObjectFile *const self) {
+    assert(NULL != self);
+    if (NULL != self->mapping) {
+        munmap(self->mapping, self->size);
+    }
+    free(self->functions);
+    self->mapping = NULL;
+    self->size = 0;
+    self->functions = NULL;
+    self->length = 0;
+}
+
+int TraceFunction_compare(const void *const a, const void *const b) {
+    assert(NULL != a);
+    assert(NULL != b);
+    const struct TraceFunction *x = a, *y = b;
+    if (x->address != y->address) {
+        return (x->address < y->address) ? -1 : 1;
+    }
+    // aliases of the same function: prefer the sized one
+    return (x->size > y->size) ? -1 : (x->size < y->size);
+}
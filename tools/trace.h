@@ -0,0 +1,472 @@
+/*
+Author: daddinuz
+email:  daddinuz@gmail.com
+
+Copyright (c) 2018 Davide Di Carlo
+
+Permission is hereby granted, free of charge, to any person
+obtaining a copy of this software and associated documentation
+files (the "Software"), to deal in the Software without
+restriction, including without limitation the rights to use,
+copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <error/error.h>
+
+#if !(defined(__GNUC__) || defined(__clang__))
+__attribute__(...)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * TraceRecord
+ *
+ * A single line of a trace. Fields are looked up lazily, only the ones needed for ordering are decoded upfront.
+ */
+struct TraceRecord {
+    const char *line;               // not NUL-terminated, without the trailing newline
+    size_t length;
+    long long clock;                // records without clock inherit the one of the previous event of their trace
+    unsigned long long sequence;    // as above
+    bool isEvent;                   // true for traced calls, false for summaries, samples and other records
+};
+
+extern bool TraceRecord_getInteger(const struct TraceRecord *self, const char *key, long long *out)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Finds a string value, storing its start and length (quotes excluded, escapes kept).
+ */
+extern bool TraceRecord_getString(const struct TraceRecord *self, const char *key, const char **begin, size_t *length)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Finds an address, for realloc key may be "from" or "to" as well.
+ */
+extern bool TraceRecord_getAddress(const struct TraceRecord *self, const char *key, uintptr_t *out)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Finds an array of addresses, e.g. the backtrace of a crash record, storing up to size of them.
+ * Returns the number of addresses stored.
+ */
+extern size_t TraceRecord_getAddresses(const struct TraceRecord *self, const char *key, uintptr_t *out, size_t size)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Finds the site of an event, file and func are not NUL-terminated.
+ */
+struct TraceSite {
+    const char *file;
+    const char *func;
+    size_t fileLength;
+    size_t funcLength;
+    long line;
+};
+
+extern bool TraceRecord_getSite(const struct TraceRecord *self, struct TraceSite *out)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * The hash of a site, as used by the bloom filters of chunks (FNV-1a of "file:line").
+ */
+extern uint64_t TraceSite_hash(const struct TraceSite *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * TraceReader
+ *
+ * Reads a trace sequentially through a memory mapping, releasing pages already read so that memory stays bounded
+ * regardless of the size of the trace.
+ */
+struct TraceReader {
+    /* Do not access these members directly! */
+    const char *_data;
+    size_t _size;
+    size_t _offset;
+    size_t _released;
+    long long _clock;
+    unsigned long long _sequence;
+};
+
+extern ErrorOf(Ok, IllegalState) TraceReader_open(struct TraceReader *self, const char *path)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Returns false at the end of the trace, records stay valid until the reader is closed
+ * (released pages are read back from the file when accessed again).
+ */
+extern bool TraceReader_next(struct TraceReader *self, struct TraceRecord *out)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Moves to offset, which must be the start of a record, e.g. the one of a chunk.
+ */
+extern void TraceReader_seek(struct TraceReader *self, size_t offset)
+__attribute__((__nonnull__));
+
+extern size_t TraceReader_offset(const struct TraceReader *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern void TraceReader_close(struct TraceReader *self)
+__attribute__((__nonnull__));
+
+/*
+ * TraceMerger
+ *
+ * Streams the records of many traces ordered by clock and sequence through a heap of readers.
+ * Every trace is already ordered by clock, so memory does not depend on the size of the traces.
+ */
+struct TraceMerger {
+    /* Do not access these members directly! */
+    struct TraceReader *_readers;
+    struct TraceRecord *_heads;
+    size_t *_heap;
+    size_t _length;
+    size_t _count;
+    size_t _last;
+};
+
+extern ErrorOf(Ok, OutOfMemory, IllegalState) TraceMerger_open(struct TraceMerger *self, const char *const paths[], size_t count)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Returns false when every trace is exhausted, records stay valid until the merger is closed.
+ */
+extern bool TraceMerger_next(struct TraceMerger *self, struct TraceRecord *out)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern void TraceMerger_close(struct TraceMerger *self)
+__attribute__((__nonnull__));
+
+/*
+ * TraceHeap
+ *
+ * The live blocks of a trace, reconstructed by applying its events in order.
+ * Blocks are keyed by PID and address, as forked processes reuse the addresses of their parent and traces written
+ * through the collector process or merged by watchdog-merge interleave the events of many processes.
+ */
+struct TraceBlock {
+    long long PID;          // 0 if the events lack it
+    uintptr_t address;
+    size_t size;
+    long long clock;        // of the allocation
+    struct TraceSite site;
+    uint32_t tag;           // id of the tag of the allocation, 0 if untagged (see Watchdog_pushTag)
+};
+
+struct TraceHeap {
+    /* Do not access these members directly! */
+    struct TraceBlock *_blocks;
+    size_t _capacity;
+    size_t _length;
+    size_t _bytes;
+};
+
+extern void TraceHeap_init(struct TraceHeap *self)
+__attribute__((__nonnull__));
+
+/*
+ * Applies an event, other records are ignored. Frees of unknown blocks are ignored as well.
+ * Blocks moved by realloc keep the site, clock and tag of their allocation.
+ */
+extern ErrorOf(Ok, OutOfMemory) TraceHeap_apply(struct TraceHeap *self, const struct TraceRecord *record)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern ErrorOf(Ok, OutOfMemory) TraceHeap_insert(struct TraceHeap *self, const struct TraceBlock *block)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern bool TraceHeap_remove(struct TraceHeap *self, long long PID, uintptr_t address)
+__attribute__((__nonnull__));
+
+/*
+ * Iterates the live blocks, cursor must start at 0. Returns NULL at the end.
+ */
+extern const struct TraceBlock *TraceHeap_next(const struct TraceHeap *self, size_t *cursor)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern size_t TraceHeap_length(const struct TraceHeap *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern size_t TraceHeap_bytes(const struct TraceHeap *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern void TraceHeap_clear(struct TraceHeap *self)
+__attribute__((__nonnull__));
+
+extern void TraceHeap_teardown(struct TraceHeap *self)
+__attribute__((__nonnull__));
+
+/*
+ * TraceIndex
+ *
+ * The sidecar index of a trace ("<trace>.index"), listing its chunks and checkpoints of the live blocks taken
+ * every few chunks, so that readers can skip chunks and rebuild the heap at any point replaying a few chunks only.
+ * Checkpoints are taken only when the chunks replayed since the previous one are larger than the checkpoint itself,
+ * so that the size of the index is bounded by the size of the trace even when millions of blocks are live.
+ */
+#define TRACE_INDEX_CHECKPOINT_INTERVAL     16  // min chunks between checkpoints
+
+struct TraceChunk {
+    size_t offset;
+    size_t length;
+    size_t events;
+    long long clockMin;
+    long long clockMax;
+    uintptr_t addressMin;
+    uintptr_t addressMax;
+    uint64_t sites[4];
+    size_t checkpoint;      // offset in the index of the checkpoint taken after the chunk, SIZE_MAX if none
+};
+
+extern bool TraceChunk_mayContainAddress(const struct TraceChunk *self, uintptr_t address)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern bool TraceChunk_mayContainSite(const struct TraceChunk *self, uint64_t siteHash)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+struct TraceIndex {
+    /* Do not access these members directly! */
+    struct TraceReader _reader;
+    struct TraceChunk *_chunks;
+    size_t _length;
+};
+
+/*
+ * Scans the trace at path writing its index.
+ */
+extern ErrorOf(Ok, OutOfMemory, IllegalState) TraceIndex_build(const char *path)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Loads the index of the trace at path, building it if missing or older than the trace.
+ */
+extern ErrorOf(Ok, OutOfMemory, IllegalState) TraceIndex_open(struct TraceIndex *self, const char *path)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern size_t TraceIndex_length(const struct TraceIndex *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern const struct TraceChunk *TraceIndex_getChunk(const struct TraceIndex *self, size_t index)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Returns the index of the first chunk holding events at or after clock, the number of chunks if none.
+ */
+extern size_t TraceIndex_findChunk(const struct TraceIndex *self, long long clock)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Rebuilds into heap the live blocks at clock, restoring the closest checkpoint and replaying the following chunks
+ * of trace, which must be a reader of the indexed trace. Blocks refer to both the index and trace, they stay valid
+ * until both are closed. The number of replayed chunks is stored in replayedChunks if not NULL.
+ */
+extern ErrorOf(Ok, OutOfMemory) TraceIndex_rebuild(struct TraceIndex *self, struct TraceReader *trace, long long clock,
+                                                   struct TraceHeap *heap, size_t *replayedChunks)
+__attribute__((__warn_unused_result__, __nonnull__(1, 2, 4)));
+
+/*
+ * Loads into heap the live blocks at the end of the last chunk before chunk having a checkpoint,
+ * returning the index of the chunk replaying should start from.
+ */
+extern size_t TraceIndex_loadCheckpoint(struct TraceIndex *self, size_t chunk, struct TraceHeap *heap)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern void TraceIndex_close(struct TraceIndex *self)
+__attribute__((__nonnull__));
+
+/*
+ * TraceSnapshot
+ *
+ * The live bytes and blocks of a trace grouped by site, either as recorded by the traced process (snapshotSite
+ * records, see Watchdog_snapshot) or computed from the live blocks at some point of the trace.
+ * Sites are kept in an open-addressing table, they refer to the traces they come from.
+ */
+struct TraceSiteUsage {
+    struct TraceSite site;
+    uint64_t hash;
+    size_t bytes;
+    size_t blocks;
+    size_t allocatedBytes;  // cumulative, including the blocks freed since
+    size_t allocations;     // as above
+};
+
+struct TraceSnapshot {
+    /* Do not access these members directly! */
+    struct TraceSiteUsage *_usages;
+    size_t _capacity;
+    size_t _length;
+    size_t _bytes;
+    size_t _blocks;
+    size_t _allocatedBytes;
+    size_t _allocations;
+};
+
+extern void TraceSnapshot_init(struct TraceSnapshot *self)
+__attribute__((__nonnull__));
+
+/*
+ * Adds bytes and blocks to the usage of site.
+ */
+extern ErrorOf(Ok, OutOfMemory) TraceSnapshot_add(struct TraceSnapshot *self, const struct TraceSite *site,
+                                                  size_t bytes, size_t blocks)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Adds an allocation of size bytes to the cumulative usage of site.
+ */
+extern ErrorOf(Ok, OutOfMemory) TraceSnapshot_addAllocation(struct TraceSnapshot *self, const struct TraceSite *site,
+                                                            size_t size)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Adds every allocation of an event (reallocations count as allocations of their new size), other records are ignored.
+ */
+extern ErrorOf(Ok, OutOfMemory) TraceSnapshot_addEvent(struct TraceSnapshot *self, const struct TraceRecord *record)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Adds record if it is a snapshotSite record of the given snapshot, other records are ignored.
+ */
+extern ErrorOf(Ok, OutOfMemory) TraceSnapshot_apply(struct TraceSnapshot *self, const struct TraceRecord *record,
+                                                    long long snapshot)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Adds every live block of heap.
+ */
+extern ErrorOf(Ok, OutOfMemory) TraceSnapshot_addHeap(struct TraceSnapshot *self, const struct TraceHeap *heap)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern const struct TraceSiteUsage *TraceSnapshot_find(const struct TraceSnapshot *self, const struct TraceSite *site)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Iterates the sites, cursor must start at 0. Returns NULL at the end.
+ */
+extern const struct TraceSiteUsage *TraceSnapshot_next(const struct TraceSnapshot *self, size_t *cursor)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern size_t TraceSnapshot_length(const struct TraceSnapshot *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern size_t TraceSnapshot_bytes(const struct TraceSnapshot *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern size_t TraceSnapshot_blocks(const struct TraceSnapshot *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern size_t TraceSnapshot_allocatedBytes(const struct TraceSnapshot *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern size_t TraceSnapshot_allocations(const struct TraceSnapshot *self)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern void TraceSnapshot_teardown(struct TraceSnapshot *self)
+__attribute__((__nonnull__));
+
+/*
+ * The change of a site between two snapshots.
+ */
+enum TraceSiteChange {
+    TRACE_SITE_CHANGED,
+    TRACE_SITE_NEW,
+    TRACE_SITE_VANISHED,
+};
+
+struct TraceSiteDelta {
+    struct TraceSite site;
+    enum TraceSiteChange change;
+    size_t bytesBefore;
+    size_t blocksBefore;
+    size_t bytesAfter;
+    size_t blocksAfter;
+    long long bytes;    // net growth
+    long long blocks;   // as above
+};
+
+/*
+ * Compares the live blocks of two snapshots through a hashed merge: sites of after are looked up in before, the ones
+ * of before missing from after (or without live blocks) are the vanished ones. Unchanged sites are omitted,
+ * deltas are ordered by change (changed, new, vanished), then by net bytes, the most grown first (the most shrunk
+ * first for vanished sites). The caller must free deltas.
+ */
+extern ErrorOf(Ok, OutOfMemory) TraceSnapshot_diff(const struct TraceSnapshot *before, const struct TraceSnapshot *after,
+                                                   struct TraceSiteDelta **deltas, size_t *length)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * TraceSymbolizer
+ *
+ * Resolves the raw return addresses recorded by traced processes into function names, offline.
+ * Processes list their loaded objects through object records followed by an objects record (see watchdog.c),
+ * the symbol tables of objects are read from their ELF files when first needed and cached, files without a symbol
+ * table are looked up in /usr/lib/debug/.build-id by build id. Files whose build id differs from the one recorded
+ * have been rebuilt since, their addresses are resolved to the object only.
+ */
+struct TraceSymbol {
+    const char *path;   // of the object, NULL if the address does not belong to any
+    const char *name;   // of the function, NULL if not found
+    uintptr_t offset;   // from the start of the function, or of the object if name is NULL
+};
+
+struct TraceLoadedObject;
+
+struct TraceObjectFile;
+
+struct TraceSymbolizer {
+    /* Do not access these members directly! */
+    struct TraceLoadedObject *_objects;
+    size_t _objectsCapacity;
+    size_t _objectsLength;
+    struct TraceObjectFile *_files;
+    size_t _filesCapacity;
+    size_t _filesLength;
+};
+
+extern void TraceSymbolizer_init(struct TraceSymbolizer *self)
+__attribute__((__nonnull__));
+
+/*
+ * Applies object and objects records, other records are ignored.
+ */
+extern ErrorOf(Ok, OutOfMemory) TraceSymbolizer_apply(struct TraceSymbolizer *self, const struct TraceRecord *record)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+/*
+ * Resolves an address of the process PID, as loaded by the records applied so far.
+ * Return addresses point past the call: address - 1 resolves the calling function.
+ * Symbols stay valid until the symbolizer is torn down.
+ */
+extern ErrorOf(Ok, OutOfMemory) TraceSymbolizer_resolve(struct TraceSymbolizer *self, long long PID, uintptr_t address,
+                                                        struct TraceSymbol *out)
+__attribute__((__warn_unused_result__, __nonnull__));
+
+extern void TraceSymbolizer_teardown(struct TraceSymbolizer *self)
+__attribute__((__nonnull__));
+
+#ifdef __cplusplus
+}
+#endif